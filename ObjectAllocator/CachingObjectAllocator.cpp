@@ -0,0 +1,1135 @@
+/******************************************************************************/
+/*!
+\file   CachingObjectAllocator.cpp
+\brief
+    Implementation of the per CPU (rseq) and per thread caches in front of
+    the CachingObjectAllocator's pool.
+
+    Each CPU's slab is a count followed by CacheBlocks block pointers.
+    A push or pop reads the current CPU from the thread's rseq area and
+    commits with a single store of the count; if the thread is preempted
+    or migrated in between, the kernel restarts it at the abort handler
+    and the operation is retried.
+
+    A thread cache is used by its owner under the cache's busy flag (one
+    exchange, the owner only spins if another thread is draining it).
+    Nobody else waits for the flag: FreeEmptyPages and decay try it
+    (holding pool_lock_) to drain caches of idle threads, and leave busy
+    ones to their owner. A thread's caches are listed in a thread_local whose
+    destructor gives them back to their allocators (if those still
+    exist, see live_allocators) at exit.
+
+    Functions include:
+    - ThreadRseq, RseqPop, RseqPush
+    - OAThreadCache (Constructor, Destructor, ThreadExit, Lock, TryLock,
+      Unlock)
+    - CachingObjectAllocator (Constructor, Destructor, Allocate, Free,
+      GetStats, FreeEmptyPages, GetConfig, UsesPerCpuCaches,
+      AllocateFromCpu, FreeToCpu, LocalCache, PopLocal, PushLocal, Tick,
+      Decay, DecayIdle, DecayCpu, Flush, Drain, DropCache, FlushCpuCaches,
+      TakeFromPool, ReturnToPool, CachedBlocks)
+
+*/
+/******************************************************************************/
+
+#include "CachingObjectAllocator.h"
+
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#if OA_HAVE_RSEQ
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sched.h>
+
+#ifndef __NR_rseq
+#define __NR_rseq 334
+#endif
+
+  // Set by glibc 2.35+ when it registers rseq for every thread itself
+extern "C"
+{
+  extern const std::ptrdiff_t __rseq_offset __attribute__((weak));
+  extern const unsigned int __rseq_size __attribute__((weak));
+}
+#endif
+
+// Largest batch moved between a cache and the pool
+static const unsigned MAX_BATCH = 128;
+
+// A thread's own cache, used when per CPU caches aren't
+class OAThreadCache
+{
+  public:
+    OAThreadCache(CachingObjectAllocator* allocator, unsigned capacity);
+    ~OAThreadCache();
+
+      // Gives the cache back to its allocator if it is still alive
+    static void ThreadExit(CachingObjectAllocator* allocator, unsigned id,
+                           OAThreadCache* cache);
+
+      // The busy flag, Lock by the owner, TryLock by other threads
+    void Lock(void);
+    bool TryLock(void);
+    void Unlock(void);
+
+      // Holds the busy flag for a scope
+    struct Guard
+    {
+      explicit Guard(OAThreadCache* cache) : cache(cache) { cache->Lock(); }
+      ~Guard() { cache->Unlock(); }
+      OAThreadCache* cache;
+    };
+
+    CachingObjectAllocator* allocator;
+    void** blocks;
+    std::atomic<bool> busy;        // set while someone uses the cache
+    std::atomic<unsigned> count;   // read without the flag by GetStats
+    unsigned low;                  // fewest blocks since the last decay
+    unsigned ops;                  // operations since the last decay
+    std::atomic<bool> flush;       // set by FreeEmptyPages when the owner was busy
+
+  private:
+      // Make private to prevent copy construction and assignment
+    OAThreadCache(const OAThreadCache& cache);
+    OAThreadCache& operator=(const OAThreadCache& cache);
+};
+
+namespace
+{
+    // Last thread cache each thread used
+  struct OACacheSlot
+  {
+    unsigned allocator;   // CachingObjectAllocator::id_ (0 = none)
+    OAThreadCache* cache;
+  };
+
+  thread_local OACacheSlot cache_slot = {0, NULL};
+
+    // Every cache the thread created, flushed by the destructor
+  struct OAThreadCaches
+  {
+    struct Entry
+    {
+      CachingObjectAllocator* allocator;
+      unsigned id;          // allocator's id_, the address may be reused
+      OAThreadCache* cache;
+    };
+
+    ~OAThreadCaches()
+    {
+      for(unsigned i = 0; i < entries.size(); ++i)
+        OAThreadCache::ThreadExit(entries[i].allocator, entries[i].id, entries[i].cache);
+    }
+
+    OAThreadCache* Find(unsigned id) const
+    {
+      for(unsigned i = 0; i < entries.size(); ++i)
+        if(entries[i].id == id)
+          return entries[i].cache;
+      return NULL;
+    }
+
+    std::vector<Entry> entries;
+  };
+
+  thread_local OAThreadCaches thread_caches;
+
+  std::atomic<unsigned> next_allocator_id(1);
+
+    // Allocators that are alive, a thread exiting may only touch those
+  std::mutex registry_lock;
+  std::vector<std::pair<CachingObjectAllocator*, unsigned> > live_allocators;
+
+  bool IsLive(CachingObjectAllocator* allocator, unsigned id)
+  {
+    for(unsigned i = 0; i < live_allocators.size(); ++i)
+      if(live_allocators[i].first == allocator && live_allocators[i].second == id)
+        return true;
+    return false;
+  }
+
+#if OA_HAVE_RSEQ
+  const unsigned RSEQ_SIG = 0x53053053;
+
+    // struct rseq from <linux/rseq.h>
+  struct OARseqArea
+  {
+    uint32_t cpu_id_start;
+    uint32_t cpu_id;
+    uint64_t rseq_cs;
+    uint32_t flags;
+    uint32_t padding[3];
+  } __attribute__((aligned(32)));
+
+  thread_local OARseqArea own_rseq;
+  thread_local OARseqArea* rseq_area = NULL;
+  thread_local int rseq_state = 0;   // 0 = not checked, 1 = usable, -1 = not
+
+    // Operations on per CPU caches since the calling thread last decayed one
+  thread_local unsigned cpu_ops = 0;
+
+    // The calling thread's rseq area, registering one if glibc hasn't
+  OARseqArea* ThreadRseq(void)
+  {
+    if(rseq_state)
+      return rseq_area;
+
+    if(&__rseq_size && __rseq_size)
+      rseq_area = reinterpret_cast<OARseqArea*>(
+                    static_cast<char*>(__builtin_thread_pointer()) + __rseq_offset);
+    else if(syscall(__NR_rseq, &own_rseq, sizeof(own_rseq), 0, RSEQ_SIG) == 0)
+      rseq_area = &own_rseq;
+
+    rseq_state = rseq_area ? 1 : -1;
+    return rseq_area;
+  }
+
+    // Pops the top block of the current CPU's slab.
+    // Returns 1 (popped), 0 (empty), -1 (aborted, retry), -2 (no slab)
+  inline int RseqPop(OARseqArea* rseq, char* slabs, unsigned long stride,
+                     unsigned cpus, void** block)
+  {
+    int status;
+    void* result;
+    __asm__ __volatile__(
+      "leaq 3f(%%rip), %%rax\n\t"
+      "movq %%rax, 8(%[rseq])\n\t"
+      "1:\n\t"
+      "movl 4(%[rseq]), %%eax\n\t"
+      "cmpl %[cpus], %%eax\n\t"
+      "jae 5f\n\t"
+      "imulq %[stride], %%rax\n\t"
+      "addq %[slabs], %%rax\n\t"
+      "movq (%%rax), %%rcx\n\t"
+      "testq %%rcx, %%rcx\n\t"
+      "jz 6f\n\t"
+      "movq (%%rax,%%rcx,8), %[result]\n\t"
+      "decq %%rcx\n\t"
+      "movq %%rcx, (%%rax)\n\t"
+      "2:\n\t"
+      "movl $1, %[status]\n\t"
+      "jmp 7f\n\t"
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0, 0\n\t"
+      ".quad 1b, 2b - 1b, 4f\n\t"
+      ".popsection\n\t"
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".byte 0x0f, 0xb9, 0x3d\n\t"
+      ".long 0x53053053\n\t"
+      "4:\n\t"
+      "movl $-1, %[status]\n\t"
+      "jmp 7f\n\t"
+      ".popsection\n\t"
+      "5:\n\t"
+      "movl $-2, %[status]\n\t"
+      "jmp 7f\n\t"
+      "6:\n\t"
+      "movl $0, %[status]\n\t"
+      "7:\n\t"
+      : [status] "=&r" (status), [result] "=&r" (result)
+      : [rseq] "r" (rseq), [slabs] "r" (slabs), [stride] "r" (stride), [cpus] "r" (cpus)
+      : "rax", "rcx", "memory", "cc");
+    *block = result;
+    return status;
+  }
+
+    // Pushes a block on the current CPU's slab.
+    // Returns 1 (pushed), 0 (full), -1 (aborted, retry), -2 (no slab)
+  inline int RseqPush(OARseqArea* rseq, char* slabs, unsigned long stride,
+                      unsigned cpus, unsigned long capacity, void* block)
+  {
+    int status;
+    __asm__ __volatile__(
+      "leaq 3f(%%rip), %%rax\n\t"
+      "movq %%rax, 8(%[rseq])\n\t"
+      "1:\n\t"
+      "movl 4(%[rseq]), %%eax\n\t"
+      "cmpl %[cpus], %%eax\n\t"
+      "jae 5f\n\t"
+      "imulq %[stride], %%rax\n\t"
+      "addq %[slabs], %%rax\n\t"
+      "movq (%%rax), %%rcx\n\t"
+      "cmpq %[capacity], %%rcx\n\t"
+      "jae 6f\n\t"
+      "movq %[block], 8(%%rax,%%rcx,8)\n\t"
+      "incq %%rcx\n\t"
+      "movq %%rcx, (%%rax)\n\t"
+      "2:\n\t"
+      "movl $1, %[status]\n\t"
+      "jmp 7f\n\t"
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0, 0\n\t"
+      ".quad 1b, 2b - 1b, 4f\n\t"
+      ".popsection\n\t"
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      ".byte 0x0f, 0xb9, 0x3d\n\t"
+      ".long 0x53053053\n\t"
+      "4:\n\t"
+      "movl $-1, %[status]\n\t"
+      "jmp 7f\n\t"
+      ".popsection\n\t"
+      "5:\n\t"
+      "movl $-2, %[status]\n\t"
+      "jmp 7f\n\t"
+      "6:\n\t"
+      "movl $0, %[status]\n\t"
+      "7:\n\t"
+      : [status] "=&r" (status)
+      : [rseq] "r" (rseq), [slabs] "r" (slabs), [stride] "r" (stride), [cpus] "r" (cpus),
+        [capacity] "r" (capacity), [block] "r" (block)
+      : "rax", "rcx", "memory", "cc");
+    return status;
+  }
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the OAThreadCache class, for the calling thread
+
+      \param allocator
+        the allocator the cache belongs to
+
+      \param capacity
+        most blocks the cache can hold
+
+*/
+/******************************************************************************/
+OAThreadCache::OAThreadCache(CachingObjectAllocator* allocator, unsigned capacity)
+  : allocator(allocator), blocks(new void *[capacity]), busy(false), count(0), low(0),
+    ops(0), flush(false)
+{
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Destructor for the OAThreadCache class, the blocks belong to the
+        pool and are freed with it
+
+*/
+/******************************************************************************/
+OAThreadCache::~OAThreadCache()
+{
+  delete [] blocks;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Called when the thread owning a cache exits, the blocks go back to
+        the pool unless the allocator (and the cache with it) is gone
+
+      \param allocator
+        the allocator the cache was created by
+
+      \param id
+        that allocator's id
+
+      \param cache
+        the cache, only read if the allocator is alive
+
+*/
+/******************************************************************************/
+void OAThreadCache::ThreadExit(CachingObjectAllocator* allocator, unsigned id,
+                               OAThreadCache* cache)
+{
+  std::lock_guard<std::mutex> lock(registry_lock);
+  if(IsLive(allocator, id))
+    allocator->DropCache(cache);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Sets the busy flag for the owner, waiting while another thread
+        drains the cache
+
+*/
+/******************************************************************************/
+void OAThreadCache::Lock(void)
+{
+  while(busy.exchange(true, std::memory_order_acquire))
+    std::this_thread::yield();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Sets the busy flag if nobody holds it
+
+      \return
+        true if it was set
+
+*/
+/******************************************************************************/
+bool OAThreadCache::TryLock(void)
+{
+  return !busy.load(std::memory_order_relaxed) &&
+         !busy.exchange(true, std::memory_order_acquire);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Clears the busy flag
+
+*/
+/******************************************************************************/
+void OAThreadCache::Unlock(void)
+{
+  busy.store(false, std::memory_order_release);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the CachingObjectAllocator class
+
+      \param ObjectSize
+        Size of each object on a page
+
+      \param config
+        the specifications of the config struct for the pool
+
+      \param CacheBlocks
+        capacity of each cache
+
+      \param PerCpu
+        false to always use per thread caches
+
+      \param DecayOps
+        operations of a thread cache between decays, 0 for none
+
+*/
+/******************************************************************************/
+CachingObjectAllocator::CachingObjectAllocator(unsigned ObjectSize, const OAConfig& config,
+                                               unsigned CacheBlocks, bool PerCpu,
+                                               unsigned DecayOps) OA_THROW(OAException)
+  : id_(next_allocator_id.fetch_add(1)), pool_(ObjectSize, config),
+    cache_blocks_(CacheBlocks ? CacheBlocks : 1), batch_(cache_blocks_ / 2),
+    decay_ops_(DecayOps), decays_(0), cpu_slabs_(NULL), slab_stride_(0), cpus_(0)
+{
+  if(batch_ == 0)
+    batch_ = 1;
+  if(batch_ > MAX_BATCH)
+    batch_ = MAX_BATCH;
+
+  {
+    std::lock_guard<std::mutex> lock(registry_lock);
+    live_allocators.push_back(std::make_pair(this, id_));
+  }
+
+#if OA_HAVE_RSEQ
+  if(!PerCpu || !ThreadRseq())
+    return;
+
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  cpus_ = cpus > 0 ? static_cast<unsigned>(cpus) : 1;
+
+    // count + blocks, rounded to a cache line so CPUs don't share one
+  slab_stride_ = ((cache_blocks_ + 1) * sizeof(void*) + 63) & ~63ul;
+
+  void* slabs;
+  if(posix_memalign(&slabs, 64, cpus_ * slab_stride_))
+  {
+    std::lock_guard<std::mutex> lock(registry_lock);
+    live_allocators.pop_back();
+    throw OAException(OAException::E_NO_MEMORY, "CachingObjectAllocator: No system memory available.");
+  }
+  cpu_slabs_ = static_cast<char*>(slabs);
+  for(unsigned i = 0; i < cpus_; ++i)
+    *reinterpret_cast<unsigned long*>(cpu_slabs_ + i * slab_stride_) = 0;
+#else
+  (void)PerCpu;
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Destructor for the CachingObjectAllocator class, no other thread
+        may be using it anymore. Cached blocks go away with the pool.
+
+*/
+/******************************************************************************/
+CachingObjectAllocator::~CachingObjectAllocator() OA_NOTHROW
+{
+  {
+    std::lock_guard<std::mutex> lock(registry_lock);
+    for(unsigned i = 0; i < live_allocators.size(); ++i)
+      if(live_allocators[i].first == this)
+      {
+        live_allocators.erase(live_allocators.begin() + i);
+        break;
+      }
+  }
+
+  for(unsigned i = 0; i < thread_caches_.size(); ++i)
+    delete thread_caches_[i];
+  std::free(cpu_slabs_);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes a block from the calling CPU's cache (or the thread's own),
+        refilling it from the pool if it is empty
+
+      \return
+        a pointer to the block of memory allocated
+
+*/
+/******************************************************************************/
+void* CachingObjectAllocator::Allocate() OA_THROW(OAException)
+{
+  if(cpu_slabs_)
+  {
+    void* block = AllocateFromCpu();
+    if(block)
+      return block;
+  }
+
+  return PopLocal();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Puts a block in the calling CPU's cache (or the thread's own),
+        sending half the cache back to the pool if it is full
+
+      \param Object
+        a pointer to the object to be freed
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::Free(void* Object) OA_THROW(OAException)
+{
+  if(cpu_slabs_)
+    FreeToCpu(Object);
+  else
+    PushLocal(Object);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the pool's statistics with cached blocks counted as free
+
+*/
+/******************************************************************************/
+OAStats CachingObjectAllocator::GetStats(void) const
+{
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  OAStats stats = pool_.GetStats();
+  unsigned cached = CachedBlocks();
+  stats.ObjectsInUse_ -= cached;
+  stats.FreeObjects_ += cached;
+  stats.CachedObjects_ = cached;
+  stats.CacheDecays_ = decays_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Drains the per CPU caches, the calling thread's cache and the
+        caches of threads that aren't in a call, asks the threads that
+        are to flush theirs on their next call, then frees the pool's
+        empty pages
+
+      \return
+        the number of pages freed
+
+*/
+/******************************************************************************/
+unsigned CachingObjectAllocator::FreeEmptyPages(void) OA_THROW(OAException)
+{
+  if(cpu_slabs_)
+    FlushCpuCaches();
+
+  OAThreadCache* own = thread_caches.Find(id_);
+  if(own)
+  {
+    OAThreadCache::Guard guard(own);
+    Flush(own);
+  }
+
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  for(unsigned i = 0; i < thread_caches_.size(); ++i)
+  {
+    OAThreadCache* cache = thread_caches_[i];
+    if(cache == own)
+      continue;
+    if(cache->TryLock())
+    {
+      Drain(cache);
+      cache->Unlock();
+    }
+    else
+      cache->flush.store(true, std::memory_order_relaxed);
+  }
+  return pool_.FreeEmptyPages();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the configuration parameters of the pool
+
+*/
+/******************************************************************************/
+OAConfig CachingObjectAllocator::GetConfig(void) const
+{
+  return pool_.GetConfig();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns true if the caches are per CPU (rseq), threads that can't
+        register rseq still fall back to their own cache
+
+*/
+/******************************************************************************/
+bool CachingObjectAllocator::UsesPerCpuCaches(void) const
+{
+  return cpu_slabs_ != NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Pops from the current CPU's slab, refilling it with a batch from
+        the pool if it is empty
+
+      \return
+        the block, or NULL if the calling thread can't use the slabs
+
+*/
+/******************************************************************************/
+void* CachingObjectAllocator::AllocateFromCpu(void) OA_THROW(OAException)
+{
+#if OA_HAVE_RSEQ
+  OARseqArea* rseq = ThreadRseq();
+  if(!rseq)
+    return NULL;
+
+  void* block;
+  int status;
+  do
+  {
+    status = RseqPop(rseq, cpu_slabs_, slab_stride_, cpus_, &block);
+  } while(status < 0 && status != -2);
+
+  if(status == 1)
+  {
+    if(decay_ops_ && ++cpu_ops >= decay_ops_)
+      DecayCpu();
+    return block;
+  }
+  if(status == -2)
+    return NULL;
+
+    // empty: keep one block of a batch, cache the rest
+  void* blocks[MAX_BATCH];
+  unsigned taken = TakeFromPool(blocks, batch_);
+  unsigned i = 1;
+  for(; i < taken; ++i)
+  {
+    do
+    {
+      status = RseqPush(rseq, cpu_slabs_, slab_stride_, cpus_, cache_blocks_, blocks[i]);
+    } while(status == -1);
+    if(status != 1)
+      break;
+  }
+  if(i < taken)
+    ReturnToPool(blocks + i, taken - i);
+  return blocks[0];
+#else
+  return NULL;
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Pushes on the current CPU's slab, sending half of it back to the
+        pool with the block if it is full
+
+      \param Object
+        a pointer to the object to be freed
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::FreeToCpu(void* Object) OA_THROW(OAException)
+{
+#if OA_HAVE_RSEQ
+  OARseqArea* rseq = ThreadRseq();
+  int status = -2;
+  if(rseq)
+  {
+    do
+    {
+      status = RseqPush(rseq, cpu_slabs_, slab_stride_, cpus_, cache_blocks_, Object);
+    } while(status == -1);
+  }
+  if(status == 1)
+  {
+    if(decay_ops_ && ++cpu_ops >= decay_ops_)
+      DecayCpu();
+    return;
+  }
+
+  if(status == 0)
+  {
+      // full: send a batch back along with the block
+    void* blocks[MAX_BATCH + 1];
+    unsigned count = 0;
+    while(count < batch_)
+    {
+      status = RseqPop(rseq, cpu_slabs_, slab_stride_, cpus_, &blocks[count]);
+      if(status == 1)
+        ++count;
+      else if(status != -1)
+        break;
+    }
+    blocks[count++] = Object;
+    ReturnToPool(blocks, count);
+    return;
+  }
+#endif
+
+    // no slab for this thread
+  PushLocal(Object);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Finds (or creates) the calling thread's own cache
+
+      \return
+        the cache owned by the calling thread
+
+*/
+/******************************************************************************/
+OAThreadCache* CachingObjectAllocator::LocalCache(void) OA_THROW(OAException)
+{
+  if(cache_slot.allocator == id_)
+    return cache_slot.cache;
+
+  OAThreadCache* cache = thread_caches.Find(id_);
+  if(!cache)
+  {
+    std::lock_guard<std::mutex> registry(registry_lock);
+
+      // forget the caches of allocators that are gone
+    std::vector<OAThreadCaches::Entry>& entries = thread_caches.entries;
+    for(unsigned i = entries.size(); i > 0; --i)
+      if(!IsLive(entries[i - 1].allocator, entries[i - 1].id))
+        entries.erase(entries.begin() + (i - 1));
+
+    cache = new (std::nothrow) OAThreadCache(this, cache_blocks_);
+    if(!cache)
+      throw OAException(OAException::E_NO_MEMORY, "LocalCache: No system memory available.");
+
+    OAThreadCaches::Entry entry = {this, id_, cache};
+    entries.push_back(entry);
+    std::lock_guard<std::mutex> lock(pool_lock_);
+    thread_caches_.push_back(cache);
+  }
+
+  cache_slot.allocator = id_;
+  cache_slot.cache = cache;
+  return cache;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes a block from the calling thread's cache, refilling it from
+        the pool if it is empty
+
+      \return
+        a pointer to the block of memory allocated
+
+*/
+/******************************************************************************/
+void* CachingObjectAllocator::PopLocal(void) OA_THROW(OAException)
+{
+  OAThreadCache* cache = LocalCache();
+  OAThreadCache::Guard guard(cache);
+  unsigned count = cache->count.load(std::memory_order_relaxed);
+  if(!count)
+    count = TakeFromPool(cache->blocks, batch_);
+
+  void* block = cache->blocks[--count];
+  cache->count.store(count, std::memory_order_relaxed);
+  if(count < cache->low)
+    cache->low = count;
+  Tick(cache);
+  return block;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Puts a block in the calling thread's cache, sending a batch back to
+        the pool if it is full
+
+      \param Object
+        a pointer to the object to be freed
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::PushLocal(void* Object) OA_THROW(OAException)
+{
+  OAThreadCache* cache = LocalCache();
+  OAThreadCache::Guard guard(cache);
+  unsigned count = cache->count.load(std::memory_order_relaxed);
+  if(count == cache_blocks_)
+  {
+      // the oldest blocks go, the newest are likely still in the CPU cache
+    ReturnToPool(cache->blocks, batch_);
+    count -= batch_;
+    std::memmove(cache->blocks, cache->blocks + batch_, count * sizeof(void*));
+    cache->low = std::min(cache->low, count);
+  }
+  cache->blocks[count] = Object;
+  cache->count.store(count + 1, std::memory_order_relaxed);
+  Tick(cache);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Counts an operation of a thread cache, decays it (and the caches
+        of idle threads) every decay_ops_ operations and flushes it if
+        FreeEmptyPages asked for it
+
+      \param cache
+        the calling thread's cache, busy
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::Tick(OAThreadCache* cache) OA_THROW(OAException)
+{
+  if(cache->flush.load(std::memory_order_relaxed))
+  {
+    cache->flush.store(false, std::memory_order_relaxed);
+    Flush(cache);
+  }
+  else if(decay_ops_ && ++cache->ops == decay_ops_)
+  {
+    Decay(cache);
+    DecayIdle(cache);
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Sends back half of the blocks that sat unused in the cache since
+        the last decay (the bottom of the stack, below the low water mark)
+
+      \param cache
+        a busy cache
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::Decay(OAThreadCache* cache) OA_THROW(OAException)
+{
+  unsigned count = cache->count.load(std::memory_order_relaxed);
+  unsigned release = (cache->low + 1) / 2;
+  if(release)
+  {
+    ReturnToPool(cache->blocks, release);
+    count -= release;
+    std::memmove(cache->blocks, cache->blocks + release, count * sizeof(void*));
+    cache->count.store(count, std::memory_order_relaxed);
+    decays_.fetch_add(release, std::memory_order_relaxed);
+  }
+  cache->ops = 0;
+  cache->low = count;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Sends every block of the calling thread's cache back to the pool
+
+      \param cache
+        the calling thread's cache, busy
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::Flush(OAThreadCache* cache) OA_THROW(OAException)
+{
+  unsigned count = cache->count.load(std::memory_order_relaxed);
+  if(count)
+  {
+    ReturnToPool(cache->blocks, count);
+    cache->count.store(0, std::memory_order_relaxed);
+    decays_.fetch_add(count, std::memory_order_relaxed);
+  }
+  cache->ops = 0;
+  cache->low = 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Decays the caches of other threads that haven't been used since
+        their last decay, so a thread that stopped allocating doesn't
+        keep its blocks. Caches whose owner is in a call are skipped.
+
+      \param own
+        the calling thread's cache
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::DecayIdle(OAThreadCache* own) OA_THROW(OAException)
+{
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  for(unsigned i = 0; i < thread_caches_.size(); ++i)
+  {
+    OAThreadCache* cache = thread_caches_[i];
+    if(cache == own || !cache->TryLock())
+      continue;
+
+    unsigned count = cache->count.load(std::memory_order_relaxed);
+    unsigned release = cache->ops ? 0 : (cache->low + 1) / 2;
+    for(unsigned j = 0; j < release; ++j)
+      pool_.Free(cache->blocks[j]);
+    if(release)
+    {
+      count -= release;
+      std::memmove(cache->blocks, cache->blocks + release, count * sizeof(void*));
+      cache->count.store(count, std::memory_order_relaxed);
+      decays_.fetch_add(release, std::memory_order_relaxed);
+    }
+    cache->ops = 0;
+    cache->low = count;
+    cache->Unlock();
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Sends half of the current CPU's cache back to the pool, every
+        decay_ops_ operations of a thread on the per CPU caches. A slab
+        can only be popped on its own CPU, so the slabs of CPUs nobody
+        runs on are left to FreeEmptyPages.
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::DecayCpu(void) OA_THROW(OAException)
+{
+#if OA_HAVE_RSEQ
+  cpu_ops = 0;
+  OARseqArea* rseq = ThreadRseq();
+  unsigned cpu = __atomic_load_n(&rseq->cpu_id, __ATOMIC_RELAXED);
+  if(cpu >= cpus_)
+    return;
+  unsigned long cached = __atomic_load_n(
+                           reinterpret_cast<unsigned long*>(cpu_slabs_ + cpu * slab_stride_), __ATOMIC_RELAXED);
+
+  void* blocks[MAX_BATCH];
+  unsigned count = 0;
+  while(count < (cached + 1) / 2 && count < MAX_BATCH)
+  {
+    int status = RseqPop(rseq, cpu_slabs_, slab_stride_, cpus_, &blocks[count]);
+    if(status == 1)
+      ++count;
+    else if(status != -1)
+      break;
+  }
+  if(count)
+  {
+    ReturnToPool(blocks, count);
+    decays_.fetch_add(count, std::memory_order_relaxed);
+  }
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees every block of a cache to the pool, pool_lock_ and the
+        cache's busy flag must be held
+
+      \param cache
+        the cache
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::Drain(OAThreadCache* cache)
+{
+  unsigned count = cache->count.load(std::memory_order_relaxed);
+  for(unsigned i = 0; i < count; ++i)
+    pool_.Free(cache->blocks[i]);
+  cache->count.store(0, std::memory_order_relaxed);
+  decays_.fetch_add(count, std::memory_order_relaxed);
+  cache->ops = 0;
+  cache->low = 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes back the cache of a thread that is exiting, registry_lock is
+        held so the allocator can't be destroyed meanwhile
+
+      \param cache
+        the exiting thread's cache
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::DropCache(OAThreadCache* cache)
+{
+    // the busy flag before pool_lock_, like the owner takes them
+  cache->Lock();
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  Drain(cache);
+  cache->Unlock();
+
+    // nobody can reach the cache without pool_lock_ now
+  thread_caches_.erase(std::find(thread_caches_.begin(), thread_caches_.end(), cache));
+  delete cache;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Empties the per CPU caches by running the caller on each CPU it
+        may run on in turn (a slab can only be popped from its own CPU).
+        CPUs outside the caller's affinity mask keep their blocks.
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::FlushCpuCaches(void) OA_THROW(OAException)
+{
+#if OA_HAVE_RSEQ
+  OARseqArea* rseq = ThreadRseq();
+  cpu_set_t saved;
+  if(!rseq || sched_getaffinity(0, sizeof(saved), &saved))
+    return;
+
+  void* blocks[MAX_BATCH];
+  for(unsigned cpu = 0; cpu < cpus_ && cpu < CPU_SETSIZE; ++cpu)
+  {
+    if(!CPU_ISSET(cpu, &saved))
+      continue;
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    if(sched_setaffinity(0, sizeof(one), &one))
+      continue;
+
+    unsigned count;
+    do
+    {
+      count = 0;
+      while(count < MAX_BATCH)
+      {
+        int status = RseqPop(rseq, cpu_slabs_, slab_stride_, cpus_, &blocks[count]);
+        if(status == 1)
+          ++count;
+        else if(status != -1)
+          break;
+      }
+      ReturnToPool(blocks, count);
+      decays_.fetch_add(count, std::memory_order_relaxed);
+    } while(count == MAX_BATCH);
+  }
+
+  sched_setaffinity(0, sizeof(saved), &saved);
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates up to count blocks from the pool under one lock. Only
+        the first block may grow a page.
+
+      \param blocks
+        where to put the blocks
+
+      \param count
+        most blocks wanted
+
+      \return
+        the number of blocks taken, at least 1 (or it throws)
+
+*/
+/******************************************************************************/
+unsigned CachingObjectAllocator::TakeFromPool(void** blocks, unsigned count) OA_THROW(OAException)
+{
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  blocks[0] = pool_.Allocate();
+  unsigned taken = 1;
+  while(taken < count && pool_.GetFreeList())
+    blocks[taken++] = pool_.Allocate();
+  return taken;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees count blocks to the pool under one lock
+
+      \param blocks
+        the blocks to free
+
+      \param count
+        how many
+
+*/
+/******************************************************************************/
+void CachingObjectAllocator::ReturnToPool(void** blocks, unsigned count) OA_THROW(OAException)
+{
+  std::lock_guard<std::mutex> lock(pool_lock_);
+  for(unsigned i = 0; i < count; ++i)
+    pool_.Free(blocks[i]);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Counts the blocks sitting in every cache, pool_lock_ must be held
+
+      \return
+        the number of cached blocks
+
+*/
+/******************************************************************************/
+unsigned CachingObjectAllocator::CachedBlocks(void) const
+{
+  unsigned cached = 0;
+#if OA_HAVE_RSEQ
+  for(unsigned i = 0; cpu_slabs_ && i < cpus_; ++i)
+    cached += static_cast<unsigned>(__atomic_load_n(
+                reinterpret_cast<unsigned long*>(cpu_slabs_ + i * slab_stride_), __ATOMIC_RELAXED));
+#endif
+  for(unsigned i = 0; i < thread_caches_.size(); ++i)
+    cached += thread_caches_[i]->count.load(std::memory_order_relaxed);
+  return cached;
+}
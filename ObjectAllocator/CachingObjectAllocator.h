@@ -0,0 +1,136 @@
+/******************************************************************************/
+/*!
+\file   CachingObjectAllocator.h
+\brief
+    Thread safe ObjectAllocator with a cache of free blocks in front of a
+    shared, locked pool. Allocate/Free only go to the pool (in batches of
+    half a cache) when a cache is empty or full.
+
+    On Linux x86-64 the caches are per CPU and the fast path runs as a
+    restartable sequence (rseq): no atomics, no locks, and memory grows
+    with the number of cores rather than threads. Threads that can't use
+    rseq (other platforms, kernels without it) get a cache of their own.
+
+    Caches decay: every DecayOps operations a thread cache sends back
+    half of the blocks it didn't touch since the last decay (its low
+    water mark), and halves the caches of threads that made no call
+    since their last decay. A thread on the per CPU caches halves its
+    current CPU's cache every DecayOps operations. A thread's caches are
+    flushed when it exits, and FreeEmptyPages drains the per CPU caches
+    (moving the caller onto each CPU in turn) and the caches of threads
+    that aren't in a call before the pool frees its empty pages; threads
+    that are flush theirs on their next Allocate/Free.
+
+    Functions include:
+    - Constructor
+    - Destructor
+    - Allocate
+    - Free
+    - GetStats
+    - GetConfig
+    - UsesPerCpuCaches
+    - FreeEmptyPages
+
+*/
+/******************************************************************************/
+
+//---------------------------------------------------------------------------
+#ifndef CACHINGOBJECTALLOCATORH
+#define CACHINGOBJECTALLOCATORH
+//---------------------------------------------------------------------------
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "ObjectAllocator.h"
+
+#if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__)
+#define OA_HAVE_RSEQ 1
+#else
+#define OA_HAVE_RSEQ 0
+#endif
+
+// If the client doesn't specify these:
+static const unsigned DEFAULT_CACHE_BLOCKS = 64;
+static const unsigned DEFAULT_DECAY_OPS = 4096;
+
+class OAThreadCache;
+
+class CachingObjectAllocator
+{
+  public:
+      // Per CPU caches of CacheBlocks blocks each, unless PerCpu is false
+      // or rseq is unavailable. The pool ignores DebugOn_, HeaderBlocks_
+      // and UseCPPMemManager_ (cached blocks would defeat them).
+      // DecayOps of 0 turns decay off.
+    CachingObjectAllocator(unsigned ObjectSize, const OAConfig& config,
+                           unsigned CacheBlocks = DEFAULT_CACHE_BLOCKS,
+                           bool PerCpu = true,
+                           unsigned DecayOps = DEFAULT_DECAY_OPS) OA_THROW(OAException);
+
+      // Destroys the pool and every cache (never throws)
+    ~CachingObjectAllocator() OA_NOTHROW;
+
+      // Takes an object from the calling CPU's (or thread's) cache
+    void* Allocate() OA_THROW(OAException);
+
+      // Returns an object to the calling CPU's (or thread's) cache
+    void Free(void* Object) OA_THROW(OAException);
+
+      // The pool's statistics with cached blocks counted as free (and in
+      // CachedObjects_). Caches are read while in use, so this is only
+      // exact when they are idle.
+    OAStats GetStats(void) const;
+
+      // Flushes the caches it can reach, then frees the pool's empty
+      // pages. Returns the number of pages freed.
+    unsigned FreeEmptyPages(void) OA_THROW(OAException);
+
+    OAConfig GetConfig(void) const;       // returns the configuration parameters
+    bool UsesPerCpuCaches(void) const;    // false if every thread has its own
+
+  private:
+    friend class OAThreadCache;   // flushes itself when its thread exits
+
+    typedef BasicObjectAllocator<DebugOffPolicy, HeadersOffPolicy,
+                                 PooledPagePolicy, NoLockPolicy> Pool;
+
+    unsigned id_;                  // tells allocators apart in the thread cache
+    Pool pool_;
+    mutable std::mutex pool_lock_; // guards pool_ and thread_caches_
+    unsigned cache_blocks_;        // capacity of each cache
+    unsigned batch_;               // blocks moved to/from the pool at once
+    unsigned decay_ops_;           // operations between decays (0 = never)
+    std::atomic<unsigned> decays_; // blocks sent back by decay or a flush
+
+    char* cpu_slabs_;              // per CPU caches, NULL if not per CPU
+    unsigned long slab_stride_;    // bytes from one CPU's slab to the next
+    unsigned cpus_;
+
+    std::vector<OAThreadCache*> thread_caches_;
+
+      // Make private to prevent copy construction and assignment
+    CachingObjectAllocator(const CachingObjectAllocator& oa);
+    CachingObjectAllocator& operator=(const CachingObjectAllocator& oa);
+
+    void* AllocateFromCpu(void) OA_THROW(OAException);
+    void FreeToCpu(void* Object) OA_THROW(OAException);
+    OAThreadCache* LocalCache(void) OA_THROW(OAException);
+    void* PopLocal(void) OA_THROW(OAException);
+    void PushLocal(void* Object) OA_THROW(OAException);
+    void Tick(OAThreadCache* cache) OA_THROW(OAException);   // decay and flush requests
+    void Decay(OAThreadCache* cache) OA_THROW(OAException);
+    void DecayIdle(OAThreadCache* own) OA_THROW(OAException); // other threads' unused caches
+    void DecayCpu(void) OA_THROW(OAException);
+    void Flush(OAThreadCache* cache) OA_THROW(OAException);
+    void Drain(OAThreadCache* cache);                      // pool_lock_ and the cache held
+    void DropCache(OAThreadCache* cache);                  // at thread exit
+    void FlushCpuCaches(void) OA_THROW(OAException);
+
+    unsigned TakeFromPool(void** blocks, unsigned count) OA_THROW(OAException);
+    void ReturnToPool(void** blocks, unsigned count) OA_THROW(OAException);
+    unsigned CachedBlocks(void) const;
+};
+
+#endif
@@ -0,0 +1,1965 @@
+/******************************************************************************/
+/*!
+\file   ConcurrentObjectAllocator.cpp
+\brief
+    Implementation of the per thread heaps and remote free queues behind
+    ConcurrentObjectAllocator.
+
+    Functions include:
+    - OARemoteFreeQueue (Push, TakeAll, Empty)
+    - OAPageDeque (Constructor, Push, Pop, Steal, Size)
+    - OAThreadHeap (Constructor, Destructor, Allocate, Free, RemoteFree,
+      HandedOff, GetStats, Owner, Node, StealPage, AllocatePage, FreePage, Enter,
+      Exit, Announced, Retire, TakeRetired, Orphaned, Orphan,
+      Adopt, Drain, ReclaimRemote, Released, Publish)
+    - OAThreadExit (Destructor, Add)
+    - ConcurrentObjectAllocator (Constructor, Destructor, Allocate, Free,
+      GetStats, GetConfig, HeapCount, NodeCount, GetNodeStats,
+      EnterCritical, ExitCritical, RetireObject, Reclaim, AllocateWait,
+      AllocateAsync, LocalHeap, CachedHeap, BlockSize, OwnerOf, Orphan,
+      CurrentNode,
+      StealPage, ReservePage, UnreservePage, BindSpan, AdvanceEpoch,
+      FreeRetired,
+      TryAllocate, Enqueue, Dequeue, HandOff)
+    - OAAllocation (Constructor, await_ready, await_resume, Queue)
+
+    NUMA placement uses the getcpu and mbind system calls directly, so
+    there is no libnuma dependency. Elsewhere there is a single node.
+
+*/
+/******************************************************************************/
+
+#include "ConcurrentObjectAllocator.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+  // Every heap is only touched by its own thread, debugging and header
+  // blocks still follow the config
+typedef BasicObjectAllocator<RuntimeDebugPolicy, RuntimeHeaderPolicy,
+                             PooledPagePolicy, NoLockPolicy> OAHeapPool;
+
+// Last bytes of every page span
+struct OASpanTag
+{
+  unsigned live;         // blocks in use on the page (owner only)
+  OAThreadHeap* owner;
+};
+
+namespace
+{
+    // Last heap each thread used, saves the registry lookup on every call
+  struct OAHeapCache
+  {
+    unsigned allocator;   // ConcurrentObjectAllocator::id_ (0 = none)
+    OAThreadHeap* heap;
+  };
+
+  thread_local OAHeapCache heap_cache = {0, NULL};
+
+    // Allocators that are still alive, so an exiting thread only
+    // orphans heaps whose allocator hasn't been destroyed
+  std::mutex live_lock;
+  std::vector<ConcurrentObjectAllocator*> live_allocators;
+
+  std::atomic<unsigned> next_allocator_id(1);
+
+    // made up NUMA node of each thread (round robin, given out the first
+    // time a thread asks), when there are more nodes than the machine has
+  std::atomic<unsigned> next_thread_node(0);
+  thread_local unsigned thread_node = ~0u;
+
+    // size aligned memory for one page span, NULL if out of memory
+  char* AllocateSpan(unsigned span)
+  {
+#ifdef _MSC_VER
+    return static_cast<char*>(_aligned_malloc(span, span));
+#else
+    void* span_memory;
+    if(posix_memalign(&span_memory, span, span))
+      return NULL;
+    return static_cast<char*>(span_memory);
+#endif
+  }
+
+  void FreeSpan(char* span_memory)
+  {
+#ifdef _MSC_VER
+    _aligned_free(span_memory);
+#else
+    std::free(span_memory);
+#endif
+  }
+
+    // MPOL_PREFERRED and MPOL_MF_MOVE from <linux/mempolicy.h>
+  const int MEMORY_POLICY_PREFERRED = 1;
+  const unsigned MEMORY_POLICY_MOVE = 1 << 1;
+
+    // nodes the machine can have, from "0" or "0-3" style sysfs lists
+  unsigned SystemNodes(void)
+  {
+    unsigned nodes = 1;
+#ifdef __linux__
+    std::FILE* possible = std::fopen("/sys/devices/system/node/possible", "r");
+    if(!possible)
+      return nodes;
+    unsigned node;
+    while(std::fscanf(possible, "%u", &node) == 1)
+    {
+      if(node + 1 > nodes)
+        nodes = node + 1;
+      if(std::fgetc(possible) == EOF)
+        break;
+    }
+    std::fclose(possible);
+#endif
+    return nodes;
+  }
+
+    // CPU and node the calling thread is running on
+  void CurrentCpu(unsigned& cpu, unsigned& node)
+  {
+    cpu = node = 0;
+#if defined(__linux__) && defined(SYS_getcpu)
+    syscall(SYS_getcpu, &cpu, &node, NULL);
+#endif
+  }
+
+    // adds a heap's statistics to a total
+  void AddStats(OAStats& total, const OAStats& stats)
+  {
+    total.FreeObjects_ += stats.FreeObjects_;
+    total.ObjectsInUse_ += stats.ObjectsInUse_;
+    total.PagesInUse_ += stats.PagesInUse_;
+    total.MostObjects_ += stats.MostObjects_;
+    total.Allocations_ += stats.Allocations_;
+    total.Deallocations_ += stats.Deallocations_;
+    total.RemoteFrees_ += stats.RemoteFrees_;
+    total.StolenPages_ += stats.StolenPages_;
+    total.NodeRemoteFrees_ += stats.NodeRemoteFrees_;
+    total.RetiredObjects_ += stats.RetiredObjects_;
+  }
+
+    // the hidden word after an object that links it on a retired list
+  void*& RetireLink(void* block, unsigned offset)
+  {
+    return *reinterpret_cast<void**>(static_cast<char*>(block) + offset);
+  }
+
+    // the tag of the span a block (or page) is in
+  OASpanTag* TagOf(const void* block, unsigned span)
+  {
+    std::size_t page = reinterpret_cast<std::size_t>(block) & ~static_cast<std::size_t>(span - 1);
+    return reinterpret_cast<OASpanTag*>(page + span - sizeof(OASpanTag));
+  }
+}
+
+// Blocks freed by threads that don't own them. Any number of threads
+// push, only the owner takes, and it always takes the whole list, so
+// there is no ABA problem with a plain compare and swap.
+class OARemoteFreeQueue
+{
+  public:
+    OARemoteFreeQueue(void) : head_(NULL) {}
+
+    void Push(GenericObject* block);
+    GenericObject* TakeAll(void);
+    bool Empty(void) const;
+
+  private:
+    std::atomic<GenericObject*> head_;
+};
+
+// Empty pages a heap gave up (Chase-Lev work stealing deque of fixed
+// size). The owner pushes and pops at the bottom, any thread steals from
+// the top.
+class OAPageDeque
+{
+  public:
+    OAPageDeque(void);
+
+    bool Push(char* page);   // owner only, false if full
+    char* Pop(void);         // owner only, NULL if empty
+    char* Steal(void);       // any thread, NULL if empty or lost a race
+    unsigned Size(void) const;
+
+  private:
+    static const long CAPACITY = 32;
+
+    std::atomic<long> top_;
+    std::atomic<long> bottom_;
+    std::atomic<char*> pages_[CAPACITY];
+};
+
+// One thread's pages. The heap is also the page source of its pool so it
+// can tag each page span with its owner, and recycle empty spans.
+class OAThreadHeap : public OAPageSource
+{
+  public:
+    OAThreadHeap(ConcurrentObjectAllocator* allocator, unsigned ObjectSize,
+                 const OAConfig& config, unsigned span, unsigned node) OA_THROW(OAException);
+    ~OAThreadHeap() OA_NOTHROW;
+
+    void* Allocate(void) OA_THROW(OAException);   // owner only
+    void Free(void* Object) OA_THROW(OAException); // owner only
+    void RemoteFree(void* Object, bool OtherNode); // any thread
+    void HandedOff(void);                          // any thread
+
+    OAStats GetStats(void) const;
+    std::thread::id Owner(void) const;
+    unsigned Node(void) const;
+    char* StealPage(void);                      // any thread
+
+    char* AllocatePage(unsigned PageSize);
+    void FreePage(char* Page, unsigned PageSize);
+
+    void Enter(const std::atomic<unsigned long>& epoch); // owner only
+    void Exit(void);                                     // owner only
+    unsigned long Announced(void) const;  // epoch << 1 | 1 inside, 0 outside
+    bool Retire(void* Object, unsigned long epoch);      // owner only, true: batch due
+    unsigned TakeRetired(unsigned long epoch, void*& chain); // any thread
+
+      // owner changes, heaps_lock_ held
+    bool Orphaned(void) const;
+    bool RemoteFreed(void) const;         // blocks wait on the remote queue
+    void Orphan(void);
+    void Adopt(void);
+    void Drain(void) OA_THROW(OAException); // owner, or any thread for an orphan
+
+  private:
+    ConcurrentObjectAllocator* allocator_;
+    unsigned span_;
+    unsigned objects_per_page_;
+    std::thread::id owner_;
+    unsigned node_;
+    OARemoteFreeQueue remote_;
+    std::atomic<unsigned> remote_frees_;
+    std::atomic<unsigned> node_remote_frees_;
+    std::atomic<unsigned> handed_off_;    // blocks a Free gave straight to a waiter
+    OAPageDeque empty_pages_;
+    std::atomic<unsigned> stolen_pages_;
+    unsigned emptied_;                    // pages that emptied since the pool was trimmed
+    OAHeapPool* pool_;
+
+      // the pool's statistics as of the owner's last call, for GetStats
+      // on other threads (the pool's own aren't atomic)
+    enum { FREE, IN_USE, PAGES, MOST, ALLOCATIONS, DEALLOCATIONS, COUNTS };
+    std::atomic<unsigned> counts_[COUNTS];
+
+    std::atomic<unsigned long> reading_;  // see Announced
+    unsigned depth_;                      // nesting of critical sections
+    static const unsigned SAFE = 3;       // retired list of blocks from older epochs
+    unsigned link_;                       // offset of the retired link in a block
+    std::mutex retired_lock_;             // the owner retires, any thread takes
+    void* retired_[SAFE + 1];             // blocks retired in the last 3 epochs,
+    void* retired_last_[SAFE + 1];        // and older ones, linked through link_
+    unsigned retired_blocks_[SAFE + 1];
+    unsigned long retired_epoch_[SAFE];   // the epoch of each
+    std::atomic<unsigned> retired_count_;
+
+      // Make private to prevent copy construction and assignment
+    OAThreadHeap(const OAThreadHeap& heap);
+    OAThreadHeap& operator=(const OAThreadHeap& heap);
+
+    void ReclaimRemote(void);
+    void Publish(void);                                  // pool stats to counts_
+    void Released(void* Object) OA_THROW(OAException);   // a block came back
+    void Splice(unsigned from, unsigned to);             // retired lists, locked
+};
+
+// The heaps of one thread, orphaned when the thread exits
+class OAThreadExit
+{
+  public:
+    OAThreadExit(void) {}
+    ~OAThreadExit();
+
+    void Add(unsigned allocator, OAThreadHeap* heap) OA_THROW(OAException);
+
+  private:
+    std::vector<OAHeapCache> heaps_;
+
+      // Make private to prevent copy construction and assignment
+    OAThreadExit(const OAThreadExit& exit);
+    OAThreadExit& operator=(const OAThreadExit& exit);
+};
+
+namespace
+{
+  thread_local OAThreadExit thread_exit;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Pushes a block on the queue, callable from any thread
+
+      \param block
+        the block being freed
+
+*/
+/******************************************************************************/
+void OARemoteFreeQueue::Push(GenericObject* block)
+{
+  GenericObject* head = head_.load(std::memory_order_relaxed);
+  do
+  {
+    block->Next = head;
+  } while(!head_.compare_exchange_weak(head, block, std::memory_order_release,
+                                                     std::memory_order_relaxed));
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Empties the queue in one exchange, owner only
+
+      \return
+        the blocks that were on the queue, linked through Next
+
+*/
+/******************************************************************************/
+GenericObject* OARemoteFreeQueue::TakeAll(void)
+{
+  return head_.exchange(NULL, std::memory_order_acquire);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Cheap check before TakeAll
+
+      \return
+        true if nothing has been pushed since the last TakeAll
+
+*/
+/******************************************************************************/
+bool OARemoteFreeQueue::Empty(void) const
+{
+  return head_.load(std::memory_order_relaxed) == NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the OAPageDeque class, empty
+
+*/
+/******************************************************************************/
+OAPageDeque::OAPageDeque(void) : top_(0), bottom_(0)
+{
+  for(long i = 0; i < CAPACITY; ++i)
+    pages_[i].store(NULL, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Pushes a page at the bottom, owner only
+
+      \param page
+        the page to push
+
+      \return
+        false if the deque is full
+
+*/
+/******************************************************************************/
+bool OAPageDeque::Push(char* page)
+{
+  long bottom = bottom_.load(std::memory_order_relaxed);
+  long top = top_.load(std::memory_order_acquire);
+  if(bottom - top >= CAPACITY)
+    return false;
+
+  pages_[bottom % CAPACITY].store(page, std::memory_order_relaxed);
+  bottom_.store(bottom + 1, std::memory_order_release);
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Pops the page at the bottom (the last pushed), owner only
+
+      \return
+        the page, NULL if the deque is empty
+
+*/
+/******************************************************************************/
+char* OAPageDeque::Pop(void)
+{
+    //claim the bottom slot before looking at top, thieves see the claim
+  long bottom = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(bottom, std::memory_order_seq_cst);
+  long top = top_.load(std::memory_order_seq_cst);
+
+  char* page = NULL;
+  if(top <= bottom)
+  {
+    page = pages_[bottom % CAPACITY].load(std::memory_order_relaxed);
+    if(top == bottom)
+    {
+        //last page: race the thieves for it
+      if(!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                      std::memory_order_relaxed))
+        page = NULL;
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+  }
+  else
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  return page;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Steals the page at the top (the first pushed), any thread
+
+      \return
+        the page, NULL if the deque is empty or another thread got it
+
+*/
+/******************************************************************************/
+char* OAPageDeque::Steal(void)
+{
+  long top = top_.load(std::memory_order_seq_cst);
+  long bottom = bottom_.load(std::memory_order_seq_cst);
+  if(top >= bottom)
+    return NULL;
+
+  char* page = pages_[top % CAPACITY].load(std::memory_order_relaxed);
+  if(!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed))
+    return NULL;
+  return page;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Number of pages on the deque, only exact if nobody is using it
+
+*/
+/******************************************************************************/
+unsigned OAPageDeque::Size(void) const
+{
+  long size = bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed);
+  return size > 0 ? static_cast<unsigned>(size) : 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the OAThreadHeap class, builds the pool (and its
+        first page) for the calling thread
+
+      \param allocator
+        the allocator the heap belongs to
+
+      \param ObjectSize
+        Size of each object on a page
+
+      \param config
+        the allocator's configuration
+
+      \param span
+        power of 2 every page is aligned to
+
+      \param node
+        NUMA node of the heap's pages
+
+*/
+/******************************************************************************/
+OAThreadHeap::OAThreadHeap(ConcurrentObjectAllocator* allocator, unsigned ObjectSize,
+                           const OAConfig& config, unsigned span, unsigned node) OA_THROW(OAException)
+  : allocator_(allocator), span_(span), objects_per_page_(config.ObjectsPerPage_),
+    owner_(std::this_thread::get_id()), node_(node), remote_frees_(0),
+    node_remote_frees_(0), handed_off_(0), stolen_pages_(0), emptied_(0), pool_(NULL), reading_(0), depth_(0),
+    link_(ObjectSize - sizeof(void*)), retired_count_(0)
+{
+  for(unsigned i = 0; i <= SAFE; ++i)
+  {
+    retired_[i] = retired_last_[i] = NULL;
+    retired_blocks_[i] = 0;
+  }
+  for(unsigned i = 0; i < SAFE; ++i)
+    retired_epoch_[i] = 0;
+  for(unsigned i = 0; i < COUNTS; ++i)
+    counts_[i].store(0, std::memory_order_relaxed);
+
+    //the page budget is the allocator's, see AllocatePage
+  OAConfig heap_config = config;
+  heap_config.PageSource_ = this;
+  heap_config.MaxPages_ = 0;
+  heap_config.ReclaimHandlers_ = NULL;   // run by the allocator, not every heap
+  pool_ = new (std::nothrow) OAHeapPool(ObjectSize, heap_config);
+  if(!pool_)
+    throw OAException(OAException::E_NO_MEMORY, "OAThreadHeap: No system memory available.");
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Destructor for the OAThreadHeap class, frees every page
+
+*/
+/******************************************************************************/
+OAThreadHeap::~OAThreadHeap() OA_NOTHROW
+{
+  delete pool_;
+
+  char* page;
+  while((page = empty_pages_.Pop()) != NULL)
+  {
+    FreeSpan(page);
+    allocator_->UnreservePage();
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates from this heap, taking back the remote frees first if
+        the free list is empty (instead of growing a page)
+
+      \return
+        a pointer to the block of memory allocated
+
+*/
+/******************************************************************************/
+void* OAThreadHeap::Allocate(void) OA_THROW(OAException)
+{
+  if(!pool_->GetFreeList() && !remote_.Empty())
+    ReclaimRemote();
+
+  void* block = pool_->Allocate();
+  ++TagOf(block, span_)->live;
+  Publish();
+  return block;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees a block this heap owns, from the owning thread
+
+      \param Object
+        a pointer to the object to be freed
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Free(void* Object) OA_THROW(OAException)
+{
+  pool_->Free(Object);
+  Released(Object);
+  Publish();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees a block this heap owns, from another thread
+
+      \param Object
+        a pointer to the object to be freed
+
+      \param OtherNode
+        true if the freeing thread is on another NUMA node
+
+*/
+/******************************************************************************/
+void OAThreadHeap::RemoteFree(void* Object, bool OtherNode)
+{
+  remote_frees_.fetch_add(1, std::memory_order_relaxed);
+  if(OtherNode)
+    node_remote_frees_.fetch_add(1, std::memory_order_relaxed);
+  remote_.Push(reinterpret_cast<GenericObject*>(Object));
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Counts a block of this heap that a Free handed to a waiter: a
+        free and an allocation the pool never saw
+
+*/
+/******************************************************************************/
+void OAThreadHeap::HandedOff(void)
+{
+  handed_off_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the statistics of this heap, from any thread: the pool's
+        as the owner last published them. Remote frees that haven't been
+        taken back yet still count as in use.
+
+*/
+/******************************************************************************/
+OAStats OAThreadHeap::GetStats(void) const
+{
+  OAStats stats;
+  stats.FreeObjects_ = counts_[FREE].load(std::memory_order_relaxed);
+  stats.ObjectsInUse_ = counts_[IN_USE].load(std::memory_order_relaxed);
+  stats.PagesInUse_ = counts_[PAGES].load(std::memory_order_relaxed);
+  stats.MostObjects_ = counts_[MOST].load(std::memory_order_relaxed);
+  stats.Allocations_ = counts_[ALLOCATIONS].load(std::memory_order_relaxed);
+  stats.Deallocations_ = counts_[DEALLOCATIONS].load(std::memory_order_relaxed);
+  unsigned handed_off = handed_off_.load(std::memory_order_relaxed);
+  stats.Allocations_ += handed_off;
+  stats.Deallocations_ += handed_off;
+  stats.RemoteFrees_ = remote_frees_.load(std::memory_order_relaxed);
+  stats.StolenPages_ = stolen_pages_.load(std::memory_order_relaxed);
+  stats.NodeRemoteFrees_ = node_remote_frees_.load(std::memory_order_relaxed);
+  stats.RetiredObjects_ = retired_count_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the thread this heap belongs to
+
+*/
+/******************************************************************************/
+std::thread::id OAThreadHeap::Owner(void) const
+{
+  return owner_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the NUMA node of this heap's pages
+
+*/
+/******************************************************************************/
+unsigned OAThreadHeap::Node(void) const
+{
+  return node_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes the oldest page this heap gave up, for another heap
+
+      \return
+        the page, NULL if there is none (or another thread got it)
+
+*/
+/******************************************************************************/
+char* OAThreadHeap::StealPage(void)
+{
+  return empty_pages_.Steal();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Page source for the pool: a span aligned to its own size, tagged
+        with this heap. Pages this heap gave up come first, then pages
+        stolen from other heaps, then new ones out of the page budget.
+
+      \param PageSize
+        bytes the pool needs for the page
+
+      \return
+        the page, NULL if out of memory
+
+*/
+/******************************************************************************/
+char* OAThreadHeap::AllocatePage(unsigned PageSize)
+{
+  if(PageSize + sizeof(OASpanTag) > span_)
+    return NULL;
+
+  char* page = empty_pages_.Pop();
+  if(!page)
+  {
+    page = allocator_->StealPage(this);
+    if(page)
+      stolen_pages_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if(!page)
+  {
+    if(!allocator_->ReservePage())
+      throw OAException(OAException::E_NO_PAGES, "AllocatePage: The allocator's page budget is used up.");
+    page = AllocateSpan(span_);
+    if(!page)
+    {
+      allocator_->UnreservePage();
+      return NULL;
+    }
+    allocator_->BindSpan(page, node_);
+  }
+
+  OASpanTag* tag = TagOf(page, span_);
+  tag->live = 0;
+  tag->owner = this;
+  return page;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes back an empty span from the pool, onto the deque for other
+        heaps to steal, or back to the system if the deque is full
+
+      \param Page
+        the page to free
+
+*/
+/******************************************************************************/
+void OAThreadHeap::FreePage(char* Page, unsigned)
+{
+  if(!empty_pages_.Push(Page))
+  {
+    FreeSpan(Page);
+    allocator_->UnreservePage();
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Starts a read side critical section, announcing the epoch the
+        thread reads in (outermost section only)
+
+      \param epoch
+        the allocator's global epoch
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Enter(const std::atomic<unsigned long>& epoch)
+{
+  if(depth_++)
+    return;
+
+    //the announcement must be visible before the reads it protects
+  reading_.store(epoch.load(std::memory_order_seq_cst) << 1 | 1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Ends a read side critical section
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Exit(void)
+{
+  if(depth_ && !--depth_)
+    reading_.store(0, std::memory_order_release);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the epoch the owner reads in, shifted left with the low
+        bit set, or 0 if it isn't in a critical section
+
+*/
+/******************************************************************************/
+unsigned long OAThreadHeap::Announced(void) const
+{
+  return reading_.load(std::memory_order_seq_cst);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Holds on to a block retired in epoch, linked through the hidden
+        word after the object (readers may still read the object). The
+        list of that epoch may still hold blocks from 3 epochs ago, which
+        are safe by now and move to the SAFE list.
+
+      \param Object
+        the unlinked block
+
+      \param epoch
+        the global epoch, read after the block was unlinked
+
+      \return
+        true each time another batch (a page's worth) is waiting
+
+*/
+/******************************************************************************/
+bool OAThreadHeap::Retire(void* Object, unsigned long epoch)
+{
+  std::lock_guard<std::mutex> lock(retired_lock_);
+  unsigned slot = epoch % SAFE;
+  if(retired_epoch_[slot] != epoch)
+  {
+    Splice(slot, SAFE);
+    retired_epoch_[slot] = epoch;
+  }
+
+  RetireLink(Object, link_) = retired_[slot];
+  if(!retired_[slot])
+    retired_last_[slot] = Object;
+  retired_[slot] = Object;
+  ++retired_blocks_[slot];
+  return (retired_count_.fetch_add(1, std::memory_order_relaxed) + 1) % objects_per_page_ == 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes the blocks retired at least 2 epochs before epoch: every
+        reader that could have seen them has left its critical section.
+        Any thread may take them, so the blocks of a thread that stopped
+        retiring are freed too.
+
+      \param epoch
+        the global epoch
+
+      \param chain
+        the blocks are put in front of it, linked through the same word
+
+      \return
+        the number of blocks taken
+
+*/
+/******************************************************************************/
+unsigned OAThreadHeap::TakeRetired(unsigned long epoch, void*& chain)
+{
+  std::lock_guard<std::mutex> lock(retired_lock_);
+  unsigned taken = 0;
+  for(unsigned slot = 0; slot <= SAFE; ++slot)
+  {
+    if(!retired_[slot] || (slot != SAFE && retired_epoch_[slot] + 2 > epoch))
+      continue;
+
+    RetireLink(retired_last_[slot], link_) = chain;
+    chain = retired_[slot];
+    taken += retired_blocks_[slot];
+    retired_[slot] = retired_last_[slot] = NULL;
+    retired_blocks_[slot] = 0;
+  }
+  retired_count_.fetch_sub(taken, std::memory_order_relaxed);
+  return taken;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns true if the heap's thread exited and nobody adopted it
+
+*/
+/******************************************************************************/
+bool OAThreadHeap::Orphaned(void) const
+{
+  return owner_ == std::thread::id();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns true if other threads freed blocks the heap hasn't taken
+        back yet
+
+*/
+/******************************************************************************/
+bool OAThreadHeap::RemoteFreed(void) const
+{
+  return !remote_.Empty();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Leaves the heap without an owner, its thread is exiting. A thread
+        that dies inside a critical section doesn't hold the epoch back.
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Orphan(void)
+{
+  owner_ = std::thread::id();
+  depth_ = 0;
+  reading_.store(0, std::memory_order_release);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Makes the calling thread the owner of an orphaned heap
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Adopt(void)
+{
+  owner_ = std::this_thread::get_id();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes the remote frees back and gives up every empty page, for
+        other heaps to steal
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Drain(void) OA_THROW(OAException)
+{
+  ReclaimRemote();
+  emptied_ = 0;
+  pool_->FreeEmptyPages();
+  Publish();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Moves every block on the remote free queue to the free list
+
+*/
+/******************************************************************************/
+void OAThreadHeap::ReclaimRemote(void)
+{
+  GenericObject* block = remote_.TakeAll();
+  while(block)
+  {
+    GenericObject* next = block->Next;
+    pool_->Free(block);
+    Released(block);
+    block = next;
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Copies the pool's statistics where other threads can read them,
+        after every call of the owner that changes them (relaxed stores,
+        no fence: a reader may see a mix of the last two calls)
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Publish(void)
+{
+  OAStats stats = pool_->GetStats();
+  counts_[FREE].store(stats.FreeObjects_, std::memory_order_relaxed);
+  counts_[IN_USE].store(stats.ObjectsInUse_, std::memory_order_relaxed);
+  counts_[PAGES].store(stats.PagesInUse_, std::memory_order_relaxed);
+  counts_[MOST].store(stats.MostObjects_, std::memory_order_relaxed);
+  counts_[ALLOCATIONS].store(stats.Allocations_, std::memory_order_relaxed);
+  counts_[DEALLOCATIONS].store(stats.Deallocations_, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Moves one retired list in front of another, retired_lock_ held
+
+      \param from
+        the list emptied
+
+      \param to
+        the list that gets its blocks
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Splice(unsigned from, unsigned to)
+{
+  if(!retired_[from])
+    return;
+
+  RetireLink(retired_last_[from], link_) = retired_[to];
+  if(!retired_[to])
+    retired_last_[to] = retired_last_[from];
+  retired_[to] = retired_[from];
+  retired_blocks_[to] += retired_blocks_[from];
+  retired_[from] = retired_last_[from] = NULL;
+  retired_blocks_[from] = 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Counts a block back on its page. Empty pages are given up in
+        batches, once a quarter of the heap's pages emptied, so a pass
+        over the free list pays for several pages. As before nothing is
+        given up unless the heap has a page's worth of free blocks
+        besides the page that emptied.
+
+      \param Object
+        the block that was just put on the free list
+
+*/
+/******************************************************************************/
+void OAThreadHeap::Released(void* Object) OA_THROW(OAException)
+{
+  OASpanTag* tag = TagOf(Object, span_);
+  if(--tag->live)
+    return;
+
+  OAStats stats = pool_->GetStats();
+  if(++emptied_ * 4 < stats.PagesInUse_ || stats.FreeObjects_ < 2 * objects_per_page_)
+    return;
+  emptied_ = 0;
+  pool_->FreeEmptyPages();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Destructor for the OAThreadExit class, runs as the thread exits:
+        orphans its heaps in the allocators that are still alive. The
+        allocators are picked under live_lock but orphaned after it is
+        released, since an orphan can hand blocks off and resume a
+        coroutine inline; exiting_ keeps each one from being destroyed
+        meanwhile.
+
+*/
+/******************************************************************************/
+OAThreadExit::~OAThreadExit()
+{
+  std::vector<ConcurrentObjectAllocator*> owners(heaps_.size(), NULL);
+  {
+    std::lock_guard<std::mutex> lock(live_lock);
+    for(unsigned i = 0; i < heaps_.size(); ++i)
+      for(unsigned j = 0; j < live_allocators.size(); ++j)
+        if(live_allocators[j]->id_ == heaps_[i].allocator)
+        {
+          owners[i] = live_allocators[j];
+          owners[i]->exiting_.fetch_add(1, std::memory_order_relaxed);
+        }
+  }
+
+  for(unsigned i = 0; i < heaps_.size(); ++i)
+    if(owners[i])
+    {
+      owners[i]->Orphan(heaps_[i].heap);
+      owners[i]->exiting_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Remembers a heap the calling thread got
+
+      \param allocator
+        id of the heap's allocator
+
+      \param heap
+        the heap
+
+*/
+/******************************************************************************/
+void OAThreadExit::Add(unsigned allocator, OAThreadHeap* heap) OA_THROW(OAException)
+{
+  OAHeapCache entry = { allocator, heap };
+  try
+  {
+    heaps_.push_back(entry);
+  }
+  catch(const std::bad_alloc&)
+  {
+    throw OAException(OAException::E_NO_MEMORY, "LocalHeap: No system memory available.");
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the ConcurrentObjectAllocator class
+
+      \param ObjectSize
+        Size of each object on a page
+
+      \param config
+        the specifications of the config struct, used by every heap
+
+      \param NumaAware
+        true for heaps and pages per NUMA node
+
+      \param Nodes
+        number of nodes, 0 for the machine's
+
+*/
+/******************************************************************************/
+ConcurrentObjectAllocator::ConcurrentObjectAllocator(unsigned ObjectSize, const OAConfig& config,
+                                                     bool NumaAware, unsigned Nodes) OA_THROW(OAException)
+  : id_(next_allocator_id.fetch_add(1)), object_size_(ObjectSize),
+    link_offset_((ObjectSize + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*)),
+    config_(config), span_(1),
+    pages_(0), numa_(NumaAware), nodes_(1), system_nodes_(1), epoch_(1), exiting_(0),
+    first_waiter_(NULL), last_waiter_(NULL), waiting_(0)
+{
+  if(numa_)
+  {
+    system_nodes_ = SystemNodes();
+    nodes_ = Nodes ? Nodes : system_nodes_;
+  }
+
+    //the link would land in the middle of a constructed object
+  if(config.Constructor_ && config.ScratchOffset_)
+    throw OAException(OAException::E_BAD_CONFIG, "ConcurrentObjectAllocator: Remote frees link blocks at offset 0.");
+
+  config_.UseCPPMemManager_ = false;
+  config_.PageSource_ = NULL;
+  config_.ScratchOffset_ = 0;   // remote frees link blocks at offset 0
+  config_.Ring_ = false;        // and push them on free lists
+  config_.AddressOrdered_ = false;
+
+  //smallest power of 2 that holds a page and the span tag
+  unsigned needed = ObjectAllocatorCore::PageSizeFor(BlockSize(), config_) + sizeof(OASpanTag);
+  while(span_ < needed)
+    span_ <<= 1;
+
+  std::lock_guard<std::mutex> lock(live_lock);
+  try
+  {
+    live_allocators.push_back(this);
+  }
+  catch(const std::bad_alloc&)
+  {
+    throw OAException(OAException::E_NO_MEMORY, "ConcurrentObjectAllocator: No system memory available.");
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Destructor for the ConcurrentObjectAllocator class, no other
+        thread may be using it anymore. Waits for exiting threads that
+        are still orphaning their heaps here.
+
+*/
+/******************************************************************************/
+ConcurrentObjectAllocator::~ConcurrentObjectAllocator() OA_NOTHROW
+{
+  {
+    std::lock_guard<std::mutex> lock(live_lock);
+    live_allocators.erase(std::remove(live_allocators.begin(), live_allocators.end(), this),
+                          live_allocators.end());
+  }
+  while(exiting_.load(std::memory_order_acquire))
+    std::this_thread::yield();
+
+  for(unsigned i = 0; i < heaps_.size(); ++i)
+    delete heaps_[i];
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates a block from the calling thread's heap. Out of pages
+        or memory, the reclaim handlers get to free some first (once).
+
+      \return
+        a pointer to the block of memory allocated
+
+*/
+/******************************************************************************/
+void* ConcurrentObjectAllocator::Allocate() OA_THROW(OAException)
+{
+  for(bool reclaimed = false;; reclaimed = true)
+  {
+    try
+    {
+      return LocalHeap()->Allocate();
+    }
+    catch(const OAException& e)
+    {
+      if(reclaimed || !config_.ReclaimHandlers_ ||
+          (e.code() != OAException::E_NO_PAGES && e.code() != OAException::E_NO_MEMORY) ||
+          !config_.ReclaimHandlers_->Run())
+        throw;
+    }
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees a block: straight onto the free list if the calling thread
+        owns it, onto the owner's remote free queue otherwise
+
+      \param Object
+        a pointer to the object to be freed
+
+*/
+/******************************************************************************/
+void ConcurrentObjectAllocator::Free(void* Object) OA_THROW(OAException)
+{
+  if(waiting_.load(std::memory_order_seq_cst) && HandOff(Object))
+    return;
+
+  OAThreadHeap* owner = OwnerOf(Object);
+  OAThreadHeap* self = CachedHeap();
+  if(owner == self)
+    owner->Free(Object);
+  else if(!numa_)
+    owner->RemoteFree(Object, false);
+  else
+    owner->RemoteFree(Object, (self ? self->Node() : CurrentNode()) != owner->Node());
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the statistics summed over every heap
+
+*/
+/******************************************************************************/
+OAStats ConcurrentObjectAllocator::GetStats(void) const
+{
+  std::lock_guard<std::mutex> lock(heaps_lock_);
+  OAStats total;
+  total.ObjectSize_ = object_size_;
+  total.PageSize_ = ObjectAllocatorCore::PageSizeFor(BlockSize(), config_);
+  for(unsigned i = 0; i < heaps_.size(); ++i)
+    AddStats(total, heaps_[i]->GetStats());
+  total.PagesInUse_ = pages_.load(std::memory_order_relaxed);
+  return total;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the statistics summed over the heaps of one node,
+        PagesInUse_ doesn't count pages waiting on a deque
+
+      \param Node
+        the node, below NodeCount()
+
+*/
+/******************************************************************************/
+OAStats ConcurrentObjectAllocator::GetNodeStats(unsigned Node) const
+{
+  std::lock_guard<std::mutex> lock(heaps_lock_);
+  OAStats total;
+  total.ObjectSize_ = object_size_;
+  total.PageSize_ = ObjectAllocatorCore::PageSizeFor(BlockSize(), config_);
+  for(unsigned i = 0; i < heaps_.size(); ++i)
+    if(heaps_[i]->Node() == Node)
+      AddStats(total, heaps_[i]->GetStats());
+  return total;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Enters a read side critical section: blocks retired from now on
+        aren't freed until the calling thread leaves it
+
+*/
+/******************************************************************************/
+void ConcurrentObjectAllocator::EnterCritical(void) OA_THROW(OAException)
+{
+  LocalHeap()->Enter(epoch_);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Leaves the calling thread's read side critical section
+
+*/
+/******************************************************************************/
+void ConcurrentObjectAllocator::ExitCritical(void)
+{
+  OAThreadHeap* heap = CachedHeap();
+  if(heap)
+    heap->Exit();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees a block once no reader can still be using it. The block
+        must already be unreachable for new readers, and the allocator
+        made with RetireBlocks_.
+
+      \param Object
+        a block handed out by this allocator
+
+*/
+/******************************************************************************/
+void ConcurrentObjectAllocator::RetireObject(void* Object) OA_THROW(OAException)
+{
+  if(!config_.RetireBlocks_)
+    throw OAException(OAException::E_BAD_CONFIG, "RetireObject: The blocks have no retired link (RetireBlocks_).");
+
+  if(LocalHeap()->Retire(Object, epoch_.load(std::memory_order_seq_cst)))
+  {
+    AdvanceEpoch();
+    FreeRetired();
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees as many retired blocks (of every thread) as the readers
+        allow, advancing the epoch up to twice
+
+      \return
+        the number of blocks freed
+
+*/
+/******************************************************************************/
+unsigned ConcurrentObjectAllocator::Reclaim(void) OA_THROW(OAException)
+{
+  unsigned freed = FreeRetired();
+  for(unsigned i = 0; i < 2 && AdvanceEpoch(); ++i)
+    freed += FreeRetired();
+  return freed;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates a block, waiting for another thread's Free if the
+        allocator is out of pages
+
+      \param Milliseconds
+        longest wait
+
+      \return
+        a pointer to the block of memory allocated
+
+*/
+/******************************************************************************/
+void* ConcurrentObjectAllocator::AllocateWait(unsigned Milliseconds) OA_THROW(OAException)
+{
+  void* block = TryAllocate();
+  if(block)
+    return block;
+
+  std::condition_variable wake;
+  OAWaiter waiter = { NULL, NULL, NULL, NULL, &wake };
+  if(!Enqueue(&waiter))
+    return waiter.Block;
+
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(Milliseconds);
+  {
+    std::unique_lock<std::mutex> lock(waiters_lock_);
+    while(!waiter.Block && wake.wait_until(lock, deadline) != std::cv_status::timeout)
+    {
+    }
+  }
+  if(waiter.Block || !Dequeue(&waiter))
+    return waiter.Block;
+
+  throw OAException(OAException::E_NO_PAGES, "AllocateWait: No block was freed in time.");
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates a block for a coroutine, co_await the result
+
+      \return
+        the awaitable
+
+*/
+/******************************************************************************/
+OAAllocation ConcurrentObjectAllocator::AllocateAsync(void)
+{
+  return OAAllocation(this);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the number of NUMA nodes heaps are spread over
+
+*/
+/******************************************************************************/
+unsigned ConcurrentObjectAllocator::NodeCount(void) const
+{
+  return nodes_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the configuration parameters
+
+*/
+/******************************************************************************/
+OAConfig ConcurrentObjectAllocator::GetConfig(void) const
+{
+  return config_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the number of thread heaps created so far
+
+*/
+/******************************************************************************/
+unsigned ConcurrentObjectAllocator::HeapCount(void) const
+{
+  std::lock_guard<std::mutex> lock(heaps_lock_);
+  return static_cast<unsigned>(heaps_.size());
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Finds (or creates) the calling thread's heap
+
+      \return
+        the heap owned by the calling thread
+
+*/
+/******************************************************************************/
+OAThreadHeap* ConcurrentObjectAllocator::LocalHeap(void) OA_THROW(OAException)
+{
+  if(heap_cache.allocator == id_)
+    return heap_cache.heap;
+
+  std::thread::id self = std::this_thread::get_id();
+  unsigned node = numa_ ? CurrentNode() : 0;
+  OAThreadHeap* heap = NULL;
+  bool adopted = false;
+  {
+    std::lock_guard<std::mutex> lock(heaps_lock_);
+    for(unsigned i = 0; i < heaps_.size() && !heap; ++i)
+      if(heaps_[i]->Owner() == self)
+        heap = heaps_[i];
+
+      //the heap of a thread that exited, on this thread's node
+    for(unsigned i = 0; i < heaps_.size() && !heap; ++i)
+      if(heaps_[i]->Orphaned() && heaps_[i]->Node() == node)
+      {
+        heap = heaps_[i];
+        heap->Adopt();
+        adopted = true;
+      }
+  }
+
+    //built unlocked, its first page may be stolen (StealPage locks)
+  if(!heap)
+  {
+    heap = new (std::nothrow) OAThreadHeap(this, BlockSize(), config_, span_, node);
+    if(!heap)
+      throw OAException(OAException::E_NO_MEMORY, "LocalHeap: No system memory available.");
+    std::lock_guard<std::mutex> lock(heaps_lock_);
+    try
+    {
+      heaps_.push_back(heap);
+    }
+    catch(const std::bad_alloc&)
+    {
+      delete heap;
+      throw OAException(OAException::E_NO_MEMORY, "LocalHeap: No system memory available.");
+    }
+    adopted = true;
+  }
+
+    //a heap the thread can't orphan on exit is left orphaned now
+  if(adopted)
+  {
+    try
+    {
+      thread_exit.Add(id_, heap);
+    }
+    catch(const OAException&)
+    {
+      std::lock_guard<std::mutex> lock(heaps_lock_);
+      heap->Orphan();
+      throw;
+    }
+  }
+
+  heap_cache.allocator = id_;
+  heap_cache.heap = heap;
+  return heap;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        The calling thread's heap if the thread cache has it
+
+      \return
+        the heap or NULL
+
+*/
+/******************************************************************************/
+OAThreadHeap* ConcurrentObjectAllocator::CachedHeap(void) const
+{
+  return heap_cache.allocator == id_ ? heap_cache.heap : NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the size of a block in the heaps: the object (rounded up
+        to a pointer, remote frees link through it), then the word a
+        retired block is linked through if blocks can be retired
+
+*/
+/******************************************************************************/
+unsigned ConcurrentObjectAllocator::BlockSize(void) const
+{
+  return config_.RetireBlocks_ ? link_offset_ + sizeof(void*) : link_offset_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Reads the owner tag at the end of the block's page span
+
+      \param Object
+        a block handed out by this allocator
+
+      \return
+        the heap that owns the block
+
+*/
+/******************************************************************************/
+OAThreadHeap* ConcurrentObjectAllocator::OwnerOf(const void* Object) const
+{
+  return TagOf(Object, span_)->owner;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Called as the heap's thread exits: frees its retired blocks that
+        are safe, drains it, and leaves it for another thread to adopt
+
+      \param heap
+        a heap of the calling thread
+
+*/
+/******************************************************************************/
+void ConcurrentObjectAllocator::Orphan(OAThreadHeap* heap)
+{
+  try
+  {
+    FreeRetired();
+    heap->Drain();
+  }
+  catch(const OAException&)
+  {
+    //what wasn't given up stays with the heap, its adopter gets it
+  }
+
+  std::lock_guard<std::mutex> lock(heaps_lock_);
+  heap->Orphan();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Steals an empty page from the first peer that has one. Orphaned
+        peers take their remote frees back first (nobody else would), so
+        the pages those emptied can be stolen too.
+
+      \param thief
+        the heap asking, skipped
+
+      \return
+        the page, NULL if no peer had one
+
+*/
+/******************************************************************************/
+char* ConcurrentObjectAllocator::StealPage(const OAThreadHeap* thief)
+{
+  std::lock_guard<std::mutex> lock(heaps_lock_);
+
+    //same node first, any node only if none of those has a page
+  for(int pass = numa_ ? 0 : 1; pass < 2; ++pass)
+    for(unsigned i = 0; i < heaps_.size(); ++i)
+    {
+      if(heaps_[i] == thief || (!pass && heaps_[i]->Node() != thief->Node()))
+        continue;
+      if(heaps_[i]->Orphaned() && heaps_[i]->RemoteFreed())
+      {
+        try
+        {
+          heaps_[i]->Drain();
+        }
+        catch(const OAException&)
+        {
+          //the orphan keeps the pages it couldn't give up
+        }
+      }
+      char* page = heaps_[i]->StealPage();
+      if(page)
+        return page;
+    }
+  return NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Counts a new span against MaxPages_ (shared by every heap)
+
+      \return
+        false if the budget is used up
+
+*/
+/******************************************************************************/
+bool ConcurrentObjectAllocator::ReservePage(void)
+{
+  unsigned pages = pages_.load(std::memory_order_relaxed);
+  do
+  {
+    if(config_.MaxPages_ && pages >= config_.MaxPages_)
+      return false;
+  } while(!pages_.compare_exchange_weak(pages, pages + 1, std::memory_order_relaxed));
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Gives a span's place in the budget back when it is freed
+
+*/
+/******************************************************************************/
+void ConcurrentObjectAllocator::UnreservePage(void)
+{
+  pages_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Moves the global epoch on if every thread in a critical section
+        announced the current one
+
+      \return
+        true if the epoch moved (here or in another thread)
+
+*/
+/******************************************************************************/
+bool ConcurrentObjectAllocator::AdvanceEpoch(void)
+{
+  unsigned long epoch = epoch_.load(std::memory_order_seq_cst);
+  {
+    std::lock_guard<std::mutex> lock(heaps_lock_);
+    for(unsigned i = 0; i < heaps_.size(); ++i)
+    {
+      unsigned long announced = heaps_[i]->Announced();
+      if(announced && announced >> 1 != epoch)
+        return false;
+    }
+  }
+  epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees the retired blocks of every heap that the epoch allows.
+        They are taken under the locks and freed with none held (a Free
+        may resume a waiting coroutine).
+
+      \return
+        the number of blocks freed
+
+*/
+/******************************************************************************/
+unsigned ConcurrentObjectAllocator::FreeRetired(void) OA_THROW(OAException)
+{
+  unsigned long epoch = epoch_.load(std::memory_order_seq_cst);
+  void* chain = NULL;
+  unsigned freed = 0;
+  {
+    std::lock_guard<std::mutex> lock(heaps_lock_);
+    for(unsigned i = 0; i < heaps_.size(); ++i)
+      freed += heaps_[i]->TakeRetired(epoch, chain);
+  }
+
+  while(chain)
+  {
+    void* next = RetireLink(chain, link_offset_);
+    Free(chain);
+    chain = next;
+  }
+  return freed;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocate that reports running out of pages instead of throwing
+
+      \return
+        the block, NULL if out of pages
+
+*/
+/******************************************************************************/
+void* ConcurrentObjectAllocator::TryAllocate(void) OA_THROW(OAException)
+{
+  try
+  {
+    return Allocate();
+  }
+  catch(const OAException& e)
+  {
+    if(e.code() != OAException::E_NO_PAGES)
+      throw;
+  }
+  return NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Queues a waiter, then tries once more: a block may have been
+        freed between the failed Allocate and the queuing
+
+      \param waiter
+        the waiter, stays queued if this returns true
+
+      \return
+        false if the waiter already has its Block (not queued anymore)
+
+*/
+/******************************************************************************/
+bool ConcurrentObjectAllocator::Enqueue(OAWaiter* waiter) OA_THROW(OAException)
+{
+  {
+    std::lock_guard<std::mutex> lock(waiters_lock_);
+    waiter->Next = NULL;
+    if(last_waiter_)
+      last_waiter_->Next = waiter;
+    else
+      first_waiter_ = waiter;
+    last_waiter_ = waiter;
+    waiting_.fetch_add(1, std::memory_order_seq_cst);
+  }
+
+  void* block = TryAllocate();
+  if(!block)
+    return true;
+
+    //a Free may have handed the waiter a block meanwhile, the waiter
+    //must not be touched then (a coroutine may be running again)
+  if(!Dequeue(waiter))
+  {
+    Free(block);
+    return true;
+  }
+  waiter->Block = block;
+  return false;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes a waiter off the queue (timed out, or got a block itself)
+
+      \param waiter
+        the waiter
+
+      \return
+        false if it wasn't queued anymore: a Free handed it a block
+
+*/
+/******************************************************************************/
+bool ConcurrentObjectAllocator::Dequeue(OAWaiter* waiter)
+{
+  std::lock_guard<std::mutex> lock(waiters_lock_);
+  OAWaiter* previous = NULL;
+  for(OAWaiter* queued = first_waiter_; queued; previous = queued, queued = queued->Next)
+  {
+    if(queued != waiter)
+      continue;
+
+    if(previous)
+      previous->Next = queued->Next;
+    else
+      first_waiter_ = queued->Next;
+    if(last_waiter_ == queued)
+      last_waiter_ = previous;
+    waiting_.fetch_sub(1, std::memory_order_seq_cst);
+    return true;
+  }
+  return false;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Gives a block being freed to the longest waiting thread or
+        coroutine, and wakes only that one. A coroutine is resumed right
+        here, on the freeing thread and inside its Free, with no lock
+        held: it runs until its next suspension before Free returns.
+
+      \param Object
+        the block being freed
+
+      \return
+        false if nobody was waiting after all
+
+*/
+/******************************************************************************/
+bool ConcurrentObjectAllocator::HandOff(void* Object)
+{
+  void (*resume)(void*) = NULL;
+  void* context = NULL;
+  {
+    std::lock_guard<std::mutex> lock(waiters_lock_);
+    OAWaiter* waiter = first_waiter_;
+    if(!waiter)
+      return false;
+
+    first_waiter_ = waiter->Next;
+    if(!first_waiter_)
+      last_waiter_ = NULL;
+    waiting_.fetch_sub(1, std::memory_order_seq_cst);
+    OwnerOf(Object)->HandedOff();
+
+    resume = waiter->Resume;
+    context = waiter->Context;
+    waiter->Block = Object;
+    if(!resume)
+      waiter->Wake->notify_one();   // under the lock: the waiter's stack is still there
+  }
+
+  if(resume)
+    resume(context);
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        The NUMA node of the calling thread. When there are more nodes
+        than the machine has, each thread keeps the node it was given
+        first, so its heap and its frees agree on where it is.
+
+*/
+/******************************************************************************/
+unsigned ConcurrentObjectAllocator::CurrentNode(void) const
+{
+  if(nodes_ > system_nodes_)
+  {
+    if(thread_node == ~0u)
+      thread_node = next_thread_node.fetch_add(1, std::memory_order_relaxed);
+    return thread_node % nodes_;
+  }
+
+  unsigned cpu, node;
+  CurrentCpu(cpu, node);
+  return node % nodes_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Asks the kernel to put a new span's memory on a node (before it is
+        first touched, or moved if it was). Only a hint: failures, spans
+        smaller than a system page and made up nodes are left alone.
+
+      \param span
+        the span from AllocateSpan
+
+      \param node
+        the node of the heap it is for
+
+*/
+/******************************************************************************/
+void ConcurrentObjectAllocator::BindSpan(char* span, unsigned node) const
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  static const unsigned MASK_WORDS = 16;   // 1024 nodes
+  const unsigned long word_bits = sizeof(unsigned long) * 8;
+  if(!numa_ || node >= system_nodes_ || node >= MASK_WORDS * word_bits ||
+      span_ < static_cast<unsigned>(sysconf(_SC_PAGESIZE)))
+    return;
+
+  unsigned long mask[MASK_WORDS] = {0};
+  mask[node / word_bits] = 1ul << (node % word_bits);
+  syscall(SYS_mbind, span, static_cast<unsigned long>(span_), MEMORY_POLICY_PREFERRED,
+          mask, MASK_WORDS * word_bits + 1, MEMORY_POLICY_MOVE);
+#else
+  (void)span;
+  (void)node;
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the OAAllocation class, the awaitable of
+        AllocateAsync
+
+      \param allocator
+        the allocator to take the block from
+
+*/
+/******************************************************************************/
+OAAllocation::OAAllocation(ConcurrentObjectAllocator* allocator) : allocator_(allocator)
+{
+  OAWaiter waiter = { NULL, NULL, NULL, NULL, NULL };
+  waiter_ = waiter;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Tries to allocate without suspending
+
+      \return
+        true if there was a block (the coroutine goes on)
+
+*/
+/******************************************************************************/
+bool OAAllocation::await_ready(void)
+{
+  waiter_.Block = allocator_->TryAllocate();
+  return waiter_.Block != NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the block, once the coroutine goes on
+
+*/
+/******************************************************************************/
+void* OAAllocation::await_resume(void) const
+{
+  return waiter_.Block;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Queues the suspended coroutine on the allocator
+
+      \return
+        true if it stays suspended, false if it got a block right away
+
+*/
+/******************************************************************************/
+bool OAAllocation::Queue(void)
+{
+  return allocator_->Enqueue(&waiter_);
+}
@@ -0,0 +1,249 @@
+/******************************************************************************/
+/*!
+\file   ConcurrentObjectAllocator.h
+\brief
+    Thread safe front end for the ObjectAllocator. Every thread that
+    allocates gets its own heap of pages, so Allocate and a Free of a
+    block the thread owns never touch an atomic or a lock. A Free from
+    any other thread is pushed on the owning heap's remote free queue
+    (multiple producers, one consumer) and the owner takes the whole
+    queue back in one exchange the next time its free list runs dry.
+
+    Each page sits at the start of a power of 2 sized, aligned span that
+    ends with a tag: the owning heap and the number of blocks in use on
+    the page, so the owner of any block is found by masking its address.
+    Pick ObjectsPerPage_ so pages come in just under a power of 2 or the
+    rest of the span is wasted.
+
+    When a page empties on a heap that has more than a page's worth of
+    other free blocks, the heap gives the page up onto its own lock-free
+    (Chase-Lev) deque. A heap that needs a page pops its own deque, then
+    steals from its peers' deques, and only then takes a new span out of
+    the MaxPages_ budget shared by every heap. Pages with blocks in use
+    never move: frees of those blocks are routed by the span tag.
+
+    NUMA aware (Linux): each heap belongs to the node its thread was on
+    when the heap was created, its new spans are bound to that node with
+    mbind, and it steals pages from heaps of its own node first. Spans
+    smaller than a system page share pages, so they can't be bound.
+    Nodes can be set higher than the machine has (a single node box
+    then behaves like a multi node one, without the binding): threads
+    are then given nodes round robin and keep them.
+
+    Deferred reclamation for lock-free structures (epoch based): readers
+    bracket their accesses with EnterCritical/ExitCritical, and a block
+    that was unlinked while readers may still hold it is passed to
+    RetireObject instead of Free. Its contents are left alone until every
+    thread in a critical section has moved two epochs past the one it
+    was retired in, then it goes back to the free list with the rest of
+    its batch. Retired blocks are linked per epoch through a hidden word
+    after the object, so retiring never allocates; blocks only carry it
+    when the config asks for RetireBlocks_. The epoch advances when a thread has retired a page's
+    worth of blocks (or calls Reclaim) and no reader lags behind, and
+    that thread then frees the safe blocks of every heap, so the blocks
+    of a thread that stopped retiring don't wait for it.
+
+    When a thread exits, its heap takes back its remote frees, gives up
+    its empty pages and is orphaned. Frees from other threads still go
+    to its queue: a heap looking for a page takes those back for the
+    orphan before stealing from it, and the next new thread adopts the
+    orphan instead of building a heap of its own.
+
+    Back pressure: instead of failing with E_NO_PAGES once MaxPages_ is
+    reached, AllocateWait blocks and AllocateAsync returns an awaitable
+    (co_await it in a C++20 coroutine). Waiters queue in FIFO order, and
+    while any are queued every Free hands its block straight to the
+    first one, so a Free wakes exactly one waiter. A waiter is woken by
+    the first Free after it queued; blocks freed just before that stay
+    with their heaps. A handed over block counts as a free and an
+    allocation of the heap that owns it.
+
+    Reclaim handlers in the config run (with no lock held) before
+    Allocate gives up on E_NO_PAGES. PageSource_ is ignored, spans
+    come from the system, so an OAMemoryBudget can't cap them.
+
+    Functions include:
+    - Constructor
+    - Destructor
+    - Allocate
+    - Free
+    - GetStats
+    - GetConfig
+    - HeapCount
+    - NodeCount
+    - GetNodeStats
+    - EnterCritical
+    - ExitCritical
+    - RetireObject
+    - Reclaim
+    - AllocateWait
+    - AllocateAsync
+
+*/
+/******************************************************************************/
+
+//---------------------------------------------------------------------------
+#ifndef CONCURRENTOBJECTALLOCATORH
+#define CONCURRENTOBJECTALLOCATORH
+//---------------------------------------------------------------------------
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "ObjectAllocator.h"
+
+class OAThreadHeap;
+class OAThreadExit;
+class ConcurrentObjectAllocator;
+
+// A thread or coroutine queued for a block by AllocateWait/AllocateAsync
+struct OAWaiter
+{
+  OAWaiter* Next;
+  void* Block;                    // handed over by a Free
+  void (*Resume)(void* Context);  // wakes a coroutine, NULL for a thread
+  void* Context;                  // the coroutine's frame
+  std::condition_variable* Wake;  // wakes a thread
+};
+
+// What AllocateAsync returns: co_await it for a block. Suspends only
+// if the allocator is out of pages, and is resumed on the thread whose
+// Free handed it the block, inline: that Free only returns once the
+// coroutine suspends again or finishes, so don't call Free while
+// holding a lock the coroutine may take.
+class OAAllocation
+{
+  public:
+    explicit OAAllocation(ConcurrentObjectAllocator* allocator);
+
+    bool await_ready(void);           // true if a block was free right away
+    void* await_resume(void) const;   // the block
+
+      // Queues the coroutine, false if a block came while queuing
+    template <typename Handle>
+    bool await_suspend(Handle handle)
+    {
+      waiter_.Resume = &ResumeHandle<Handle>;
+      waiter_.Context = handle.address();
+      return Queue();
+    }
+
+  private:
+    ConcurrentObjectAllocator* allocator_;
+    OAWaiter waiter_;
+
+    bool Queue(void);
+
+    template <typename Handle>
+    static void ResumeHandle(void* Context)
+    {
+      Handle::from_address(Context).resume();
+    }
+};
+
+class ConcurrentObjectAllocator
+{
+  public:
+      // Creates the allocator, heaps are created by the first Allocate of
+      // each thread. MaxPages_ is shared by all the heaps (pages waiting
+      // on a deque count against it too). UseCPPMemManager_ is ignored
+      // (the page tags need real pages). NumaAware gives every node its
+      // own heaps and pages, Nodes (0 = the machine's) is how many.
+    ConcurrentObjectAllocator(unsigned ObjectSize, const OAConfig& config,
+                              bool NumaAware = false, unsigned Nodes = 0) OA_THROW(OAException);
+
+      // Destroys every heap and its pages (never throws)
+    ~ConcurrentObjectAllocator() OA_NOTHROW;
+
+      // Takes an object from the calling thread's heap
+    void* Allocate() OA_THROW(OAException);
+
+      // Returns an object to the heap that owns it, from any thread
+    void Free(void* Object) OA_THROW(OAException);
+
+      // Sum of the statistics of every heap, PagesInUse_ also counts the
+      // pages waiting on a deque. Each heap publishes its counters after
+      // every call it makes, so this is safe to read while the threads run
+      // but is only exact when they are idle.
+    OAStats GetStats(void) const;
+
+    OAConfig GetConfig(void) const;  // returns the configuration parameters
+    unsigned HeapCount(void) const;  // number of thread heaps created so far
+    unsigned NodeCount(void) const;  // 1 unless NUMA aware
+
+      // Sum of the statistics of the heaps of one node, NodeRemoteFrees_
+      // counts the frees of that node's blocks from threads on others
+    OAStats GetNodeStats(unsigned Node) const;
+
+      // Read side critical section of the calling thread (may nest)
+    void EnterCritical(void) OA_THROW(OAException);
+    void ExitCritical(void);
+
+      // Frees the object once no reader can still be using it
+      // (E_BAD_CONFIG without RetireBlocks_)
+    void RetireObject(void* Object) OA_THROW(OAException);
+
+      // Advances the epoch as far as the readers allow and frees the
+      // retired blocks (of every thread) that became safe. Returns how
+      // many were freed.
+    unsigned Reclaim(void) OA_THROW(OAException);
+
+      // Allocate, waiting up to Milliseconds for a Free when out of
+      // pages (E_NO_PAGES after that)
+    void* AllocateWait(unsigned Milliseconds) OA_THROW(OAException);
+
+      // Allocate for a coroutine: co_await AllocateAsync() waits for a
+      // Free when out of pages
+    OAAllocation AllocateAsync(void);
+
+  private:
+    friend class OAThreadHeap;       // takes pages from its peers and the budget
+    friend class OAAllocation;       // queues its coroutine
+    friend class OAThreadExit;       // orphans the heaps of an exiting thread
+
+    unsigned id_;                    // tells allocators apart in the thread cache
+    unsigned object_size_;
+    unsigned link_offset_;           // of the hidden link of retired blocks
+    OAConfig config_;
+    unsigned span_;                  // power of 2 each page is aligned to
+    std::atomic<unsigned> pages_;    // spans taken from the system
+    bool numa_;
+    unsigned nodes_;                 // nodes heaps are spread over
+    unsigned system_nodes_;          // nodes the machine has (spans bind to these)
+    std::atomic<unsigned long> epoch_; // global reclamation epoch
+    std::atomic<unsigned> exiting_;  // threads orphaning heaps here, outside live_lock
+
+    std::mutex waiters_lock_;        // guards the waiter queue
+    OAWaiter* first_waiter_;         // FIFO of threads/coroutines out of pages
+    OAWaiter* last_waiter_;
+    std::atomic<unsigned> waiting_;  // queue length, read by every Free
+
+    mutable std::mutex heaps_lock_;  // guards heaps_ (not the heaps themselves)
+    std::vector<OAThreadHeap*> heaps_;
+
+      // Make private to prevent copy construction and assignment
+    ConcurrentObjectAllocator(const ConcurrentObjectAllocator& oa);
+    ConcurrentObjectAllocator& operator=(const ConcurrentObjectAllocator& oa);
+
+    OAThreadHeap* LocalHeap(void) OA_THROW(OAException); // creates it if needed
+    OAThreadHeap* CachedHeap(void) const;             // NULL if none yet
+    unsigned BlockSize(void) const;                   // object (and retired link)
+    OAThreadHeap* OwnerOf(const void* Object) const;  // from the span tag
+    void Orphan(OAThreadHeap* heap);                  // its thread exited
+
+    unsigned CurrentNode(void) const;                 // of the calling thread
+    char* StealPage(const OAThreadHeap* thief);       // from a peer's deque
+    bool ReservePage(void);                           // against MaxPages_
+    void UnreservePage(void);
+    void BindSpan(char* span, unsigned node) const;   // mbind to a node
+    bool AdvanceEpoch(void);                          // false if a reader lags
+    unsigned FreeRetired(void) OA_THROW(OAException); // what the epoch allows
+    void* TryAllocate(void) OA_THROW(OAException);    // NULL if out of pages
+    bool Enqueue(OAWaiter* waiter) OA_THROW(OAException); // false: got a block already
+    bool Dequeue(OAWaiter* waiter);                   // false if it was handed one
+    bool HandOff(void* Object);                       // to the first waiter
+};
+
+#endif
@@ -0,0 +1,197 @@
+/******************************************************************************/
+/*!
+\file   CoroutineFramePool.cpp
+\brief
+    Implementation of the coroutine frame pools and their thread caches.
+
+    A bucket holds frames of a power of 2 size. The frames' alignment
+    is left to the allocator (Alignment_ = 16, what operator new
+    guarantees), so it holds whatever the allocator puts around its
+    blocks (page link, hidden words).
+
+    Functions include:
+    - OAFramePool (Allocate, Free, GetStats, BucketSize)
+
+*/
+/******************************************************************************/
+
+#include "CoroutineFramePool.h"
+#include "ConcurrentObjectAllocator.h"
+
+#include <new>
+
+namespace
+{
+  const unsigned SMALLEST_FRAME = 64;
+  const unsigned PAGE_BYTES = 64 * 1024;    // about, every bucket's pages
+  const unsigned FRAME_ALIGNMENT = 16;      // __STDCPP_DEFAULT_NEW_ALIGNMENT__
+
+  ConcurrentObjectAllocator** CreatePools(void)
+  {
+    ConcurrentObjectAllocator** pools = new ConcurrentObjectAllocator *[OAFramePool::BUCKETS];
+    for(unsigned i = 0; i < OAFramePool::BUCKETS; ++i)
+    {
+      unsigned frame = SMALLEST_FRAME << i;
+      OAConfig config(false, PAGE_BYTES / frame - 1, 0, false, 0, 0, FRAME_ALIGNMENT);
+      pools[i] = new ConcurrentObjectAllocator(frame, config);
+    }
+    return pools;
+  }
+
+    // created on first use and never destroyed: frames may still be
+    // freed while other statics (or threads) are shutting down
+  ConcurrentObjectAllocator** Pools(void)
+  {
+    static ConcurrentObjectAllocator** pools = CreatePools();
+    return pools;
+  }
+
+    // bucket for a frame size, BUCKETS if it is too big
+  unsigned BucketOf(std::size_t size)
+  {
+    unsigned bucket = 0;
+    while(bucket < OAFramePool::BUCKETS &&
+           size > SMALLEST_FRAME << bucket)
+      ++bucket;
+    return bucket;
+  }
+
+    // One thread's free frames. Plain data, so it stays usable while the
+    // thread exits; dead is set once the flusher has run.
+  struct OAFrameCache
+  {
+    bool dead;
+    unsigned count[OAFramePool::BUCKETS];
+    void* frames[OAFramePool::BUCKETS][OAFramePool::CACHE_FRAMES];
+  };
+
+  thread_local OAFrameCache frame_cache;
+
+    // Gives a thread's cached frames back to the pools when it exits
+  struct OAFrameCacheFlusher
+  {
+    ~OAFrameCacheFlusher()
+    {
+      ConcurrentObjectAllocator** pools = Pools();
+      for(unsigned bucket = 0; bucket < OAFramePool::BUCKETS; ++bucket)
+        while(frame_cache.count[bucket])
+          pools[bucket]->Free(frame_cache.frames[bucket][--frame_cache.count[bucket]]);
+      frame_cache.dead = true;
+    }
+  };
+
+  thread_local OAFrameCacheFlusher frame_cache_flusher;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates a coroutine frame: the calling thread's cache first,
+        then half a cache's worth from the bucket's pool
+
+      \param Size
+        bytes the compiler asked for
+
+      \return
+        the frame
+
+*/
+/******************************************************************************/
+void* OAFramePool::Allocate(std::size_t Size)
+{
+  unsigned bucket = BucketOf(Size);
+  if(bucket == BUCKETS)
+    return ::operator new(Size);
+
+  OAFrameCache& cache = frame_cache;
+  if(cache.count[bucket])
+    return cache.frames[bucket][--cache.count[bucket]];
+
+  try
+  {
+    ConcurrentObjectAllocator* pool = Pools()[bucket];
+    if(cache.dead)
+      return pool->Allocate();
+
+      //the flusher must exist before anything is cached (Free too)
+    (void)&frame_cache_flusher;
+    while(cache.count[bucket] < CACHE_FRAMES / 2 - 1)
+      cache.frames[bucket][cache.count[bucket]++] = pool->Allocate();
+    return pool->Allocate();
+  }
+  catch(const OAException&)
+  {
+    if(cache.count[bucket])
+      return cache.frames[bucket][--cache.count[bucket]];
+    throw std::bad_alloc();
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees a coroutine frame into the calling thread's cache, sending
+        half of the cache back to the pool when it is full
+
+      \param Frame
+        from Allocate
+
+      \param Size
+        bytes it was allocated with
+
+*/
+/******************************************************************************/
+void OAFramePool::Free(void* Frame, std::size_t Size) OA_NOTHROW
+{
+  unsigned bucket = BucketOf(Size);
+  if(bucket == BUCKETS)
+  {
+    ::operator delete(Frame);
+    return;
+  }
+
+  OAFrameCache& cache = frame_cache;
+  ConcurrentObjectAllocator* pool = Pools()[bucket];
+  if(cache.dead)
+  {
+    pool->Free(Frame);
+    return;
+  }
+
+  (void)&frame_cache_flusher;
+  if(cache.count[bucket] == CACHE_FRAMES)
+    while(cache.count[bucket] > CACHE_FRAMES / 2)
+      pool->Free(cache.frames[bucket][--cache.count[bucket]]);
+  cache.frames[bucket][cache.count[bucket]++] = Frame;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the statistics of a bucket's pool
+
+      \param Bucket
+        below BUCKETS
+
+*/
+/******************************************************************************/
+OAStats OAFramePool::GetStats(unsigned Bucket)
+{
+  return Pools()[Bucket]->GetStats();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the largest frame a bucket holds, 0 if there is no such
+        bucket
+
+      \param Bucket
+        the bucket
+
+*/
+/******************************************************************************/
+unsigned OAFramePool::BucketSize(unsigned Bucket)
+{
+  return Bucket < BUCKETS ? SMALLEST_FRAME << Bucket : 0;
+}
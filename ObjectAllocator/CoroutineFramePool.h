@@ -0,0 +1,74 @@
+/******************************************************************************/
+/*!
+\file   CoroutineFramePool.h
+\brief
+    Pools for C++20 coroutine frames. A promise type that derives from
+    OAPooledPromise gets class operator new/delete, which the compiler
+    uses for the coroutine's frame, so frames come from size bucketed
+    pools instead of the global heap.
+
+    Buckets hold 64 to 4096 byte frames (16 byte aligned), each one a
+    ConcurrentObjectAllocator, so a frame may be destroyed on another
+    thread than the one that created it. In front of the pools every
+    thread keeps a small stack of free frames per bucket: creating and
+    destroying a frame on the same thread is a push or a pop. Frames
+    larger than the biggest bucket go to the global operator new.
+
+    Nothing in here needs C++20, only the coroutines using it do.
+
+    Functions include:
+    - OAFramePool::Allocate
+    - OAFramePool::Free
+    - OAFramePool::GetStats
+    - OAFramePool::BucketSize
+    - OAPooledPromise::operator new
+    - OAPooledPromise::operator delete
+
+*/
+/******************************************************************************/
+
+//---------------------------------------------------------------------------
+#ifndef COROUTINEFRAMEPOOLH
+#define COROUTINEFRAMEPOOLH
+//---------------------------------------------------------------------------
+
+#include <cstddef>
+
+#include "ObjectAllocator.h"
+
+class OAFramePool
+{
+  public:
+    static const unsigned BUCKETS = 7;          // 64, 128, ... 4096 byte blocks
+    static const unsigned CACHE_FRAMES = 32;    // free frames per bucket per thread
+
+      // A frame of at least Size bytes, throws std::bad_alloc
+    static void* Allocate(std::size_t Size);
+
+      // Gives back a frame, Size must be the one it was allocated with
+    static void Free(void* Frame, std::size_t Size) OA_NOTHROW;
+
+      // Statistics of one bucket's pool, frames held by thread caches
+      // count as in use
+    static OAStats GetStats(unsigned Bucket);
+
+      // Largest frame a bucket holds (0 past the last bucket)
+    static unsigned BucketSize(unsigned Bucket);
+};
+
+// Mixin for a coroutine's promise_type:
+//   struct promise_type : OAPooledPromise { ... };
+struct OAPooledPromise
+{
+  static void* operator new(std::size_t Size)
+  {
+    return OAFramePool::Allocate(Size);
+  }
+
+  static void operator delete(void* Frame, std::size_t Size) OA_NOTHROW
+  {
+    OAFramePool::Free(Frame, Size);
+  }
+};
+
+#endif
@@ -10,34 +10,248 @@
     
     Functions include:
     - Constructor          
-    - Allocate
-    - Free
-    - ImplementedExtraCredit *NOT IMPLEMENTED*
-    - DumpMemoryInUse
-    - ValidatePages
-    - FreeEmptyPages *NOT IMPLEMENTED*
-    - SetDebugState
+    - ObjectAllocator Constructor/Destructor
+    - AllocateSlow
+    - FreeSlow
+    - SetDebugFlag
+    - UpdateSlowPath
+    - AllocateCPP
+    - FreeCPP
+    - AllocateBlock
+    - GrowPages
+    - Reclaim
+    - SetAllocatedSignature
+    - SetFreedSignature
+    - SetHeaderFlag
+    - HeaderFlag
+    - TenantTag
+    - AllocateTenant
+    - DumpTenantBlocks
+    - SetQuota
+    - TenantStats
+    - AllocateRun
+    - FreeRun
+    - FindFreeRun
+    - TakeRun
+    - RingAllocate
+    - RingAdvance
+    - RingFree
+    - RingInsert
+    - RingRemove
+    - RingPageEmpty
+    - OrderedAllocate
+    - OrderedFree
+    - OrderedInsert
+    - OrderedRemove
+    - OrderedPageEmpty
+    - ImplementedExtraCredit
+    - DumpBlocksInUse
+    - ValidateAllPages
+    - ReleaseEmptyPages
+    - ReleaseEmptyPage
     - GetFreeList
     - GetPageList
     - GetConfig
-    - GetStats
     - DeAllocatePages
+    - ReleasePage
+    - UnlinkPage
+    - PageSizeFor
     - AllocatePage
     - ValidateObject
     - ValidateBlock
     - SetSignatures
+    - OALiveSet (Insert, Remove, Size, Capacity, Slot, Rehash, Find, Hash)
+    - OAMemoryBudget (AllocatePage, FreePage, SetLimit, Limit, Used)
+    - OAReclaimHandlers (Add, Remove, Run)
 
-
+    Allocate, Free and the other public calls are templates in
+    ObjectAllocator.h (BasicObjectAllocator), they call into these.
 
 */
 /******************************************************************************/
 
 #include "ObjectAllocator.h"
+#include <new>
+#include <cstddef>
+#include <algorithm>
+
+namespace
+{
+    // bytes to add to offset to make it a multiple of alignment (0 or 1
+    // is no alignment)
+  unsigned AlignmentBytes(unsigned offset, unsigned alignment)
+  {
+    if(alignment <= 1)
+      return 0;
+    return (alignment - offset % alignment) % alignment;
+  }
+  
+    // index of the page (sorted by address) a block is on
+  unsigned PageIndex(const std::vector<char*>& pages, const char* block)
+  {
+    return static_cast<unsigned>(std::upper_bound(pages.begin(), pages.end(), block) - pages.begin() - 1);
+  }
+  
+    // index of the lowest set bit, word can't be 0
+  unsigned LowestBit(unsigned long long word)
+  {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#else
+    unsigned bit = 0;
+    while(!(word & 1))
+    {
+      word >>= 1;
+      ++bit;
+    }
+    return bit;
+#endif
+  }
+  
+    // first bit at or after pos that is set (or clear), count if none
+  unsigned NextBit(const unsigned long long* bits, unsigned pos, unsigned count, bool set)
+  {
+    while(pos < count)
+    {
+      unsigned long long word = bits[pos / 64];
+      if(!set)
+        word = ~word;
+      word >>= pos % 64;
+      if(word)
+        return std::min(pos + LowestBit(word), count);
+      pos = (pos / 64 + 1) * 64;
+    }
+    return count;
+  }
+  
+    // start of the first run of length set bits, count if none: jumps
+    // from run to run a word at a time instead of bit by bit
+  unsigned FindRun(const unsigned long long* bits, unsigned count, unsigned length)
+  {
+    unsigned pos = 0;
+    while(pos < count)
+    {
+      unsigned start = NextBit(bits, pos, count, true);
+      if(start == count)
+        break;
+      unsigned end = NextBit(bits, start, count, false);
+      if(end - start >= length)
+        return start;
+      pos = end;
+    }
+    return count;
+  }
+}
+
+// A page of the FIFO ring and which of its blocks are live
+struct OARingPage
+{
+  char* Page;
+  char* First;                            // its first block
+  unsigned Live;                          // blocks handed out, not freed yet
+  std::vector<unsigned long long> Bits;   // 1 = live
+};
+
+// The pages of FIFO ring mode, in ring order and by address
+struct OARing
+{
+  OARing(void) : Head(0), Slot(0) {}
+  
+  ~OARing(void)
+  {
+    for(unsigned i = 0; i < Pages.size(); ++i)
+      delete Pages[i];
+  }
+  
+  std::vector<OARingPage*> Pages;
+  std::vector<OARingPage*> ByAddress;
+  unsigned Head;                          // page being handed out
+  unsigned Slot;                          // its next block
+};
+
+// A page of address ordered mode and which of its blocks are free
+struct OAOrderedPage
+{
+  char* Page;
+  char* First;                            // its first block
+  unsigned Free;                          // blocks not handed out
+  std::vector<unsigned long long> Bits;   // 1 = free
+};
+
+// The pages of address ordered mode, by address, and which have a free block
+struct OAOrdered
+{
+  ~OAOrdered(void)
+  {
+    for(unsigned i = 0; i < ByAddress.size(); ++i)
+      delete ByAddress[i];
+  }
+  
+  std::vector<OAOrderedPage*> ByAddress;
+  std::vector<unsigned long long> HasFree; // bit i = ByAddress[i] has a free block
+};
+
+namespace
+{
+    // the page (of a list sorted by address) at or before address, NULL if none
+  template <typename Entry>
+  Entry* FindPage(const std::vector<Entry*>& by_address, const char* address)
+  {
+    unsigned low = 0, high = static_cast<unsigned>(by_address.size());
+    while(low < high)
+    {
+      unsigned middle = (low + high) / 2;
+      if(by_address[middle]->Page <= address)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+    return low ? by_address[low - 1] : NULL;
+  }
+  
+    // address order of the pages of address ordered mode
+  bool PageBefore(const OAOrderedPage* a, const OAOrderedPage* b)
+  {
+    return a->Page < b->Page;
+  }
+  
+    // HasFree after a page with free blocks went in at index of ByAddress:
+    // the bits from index on move up one, the way ByAddress moved
+    // (words must be reserved, it can't throw then)
+  void InsertHasFree(OAOrdered& ordered, unsigned index)
+  {
+    std::vector<unsigned long long>& bits = ordered.HasFree;
+    bits.resize((ordered.ByAddress.size() + 63) / 64, 0);
+    for(unsigned word = static_cast<unsigned>(bits.size()) - 1; word > index / 64; --word)
+      bits[word] = (bits[word] << 1) | (bits[word - 1] >> 63);
+    
+    unsigned long long& word = bits[index / 64];
+    unsigned long long low = (1ULL << (index % 64)) - 1;
+    word = (word & low) | ((word & ~low) << 1) | (low + 1);
+  }
+  
+    // HasFree after the page at index of ByAddress was taken out: the
+    // bits above index move down one
+  void RemoveHasFree(OAOrdered& ordered, unsigned index)
+  {
+    std::vector<unsigned long long>& bits = ordered.HasFree;
+    unsigned long long low = (1ULL << (index % 64)) - 1;
+    for(unsigned word = index / 64; word < bits.size(); ++word)
+    {
+      unsigned long long above = word + 1 < bits.size() ? bits[word + 1] << 63 : 0;
+      if(word == index / 64)
+        bits[word] = (bits[word] & low) | ((bits[word] >> 1) & ~low) | above;
+      else
+        bits[word] = (bits[word] >> 1) | above;
+    }
+    bits.resize((ordered.ByAddress.size() + 63) / 64);
+  }
+}
 
 /******************************************************************************/
 /*!
       \brief
-       Constructor for the ObjectAllocator class
+       Constructor for the ObjectAllocatorCore class
       
       \param ObjectSize
         Size of each object on a page
@@ -47,7 +261,7 @@
 
 */
 /******************************************************************************/
-ObjectAllocator::ObjectAllocator(unsigned ObjectSize, const OAConfig& config)throw(OAException)
+ObjectAllocatorCore::ObjectAllocatorCore(unsigned ObjectSize, const OAConfig& config)OA_THROW(OAException)
 { 
    //Initialize each objects size and the config struct
    OAStats_.ObjectSize_ = ObjectSize;
@@ -58,100 +272,253 @@ ObjectAllocator::ObjectAllocator(unsigned ObjectSize, const OAConfig& config)thr
    Config_.PadBytes_ = config.PadBytes_;
    Config_.HeaderBlocks_ = config.HeaderBlocks_;
    Config_.Alignment_ = config.Alignment_;
+   Config_.PageSource_ = config.PageSource_;
+   Config_.ReclaimHandlers_ = config.ReclaimHandlers_;
+   Config_.Constructor_ = config.Constructor_;
+   Config_.Destructor_ = config.Destructor_;
+   
+   //the scratch region holds at least the free list link, on the object
+   //(objects smaller than a pointer only have room for it at offset 0)
+   Config_.ScratchSize_ = config.ScratchSize_ < sizeof(void*) ? sizeof(void*) : config.ScratchSize_;
+   Config_.ScratchOffset_ = config.ScratchOffset_;
+   if(config.ScratchSize_ > ObjectSize || Config_.ScratchOffset_ % sizeof(void*) ||
+      (Config_.ScratchOffset_ && (Config_.ScratchSize_ > ObjectSize ||
+                                  Config_.ScratchOffset_ > ObjectSize - Config_.ScratchSize_)))
+     throw OAException(OAException::E_BAD_CONFIG, 
+                       "ObjectAllocator: The scratch region isn't a pointer aligned part of the object.");
+   if(Config_.ScratchSize_ > ObjectSize)
+     Config_.ScratchSize_ = ObjectSize;
+   
+   //alignment bytes put the first object and every one after it on a
+   //multiple of Alignment_ (from the start of the page)
+   Config_.LeftAlignSize_ = AlignmentBytes(sizeof(void*) + Config_.HeaderBlocks_ + Config_.PadBytes_,
+                                           Config_.Alignment_);
+   Config_.InterAlignSize_ = AlignmentBytes(OAStats_.ObjectSize_ + (Config_.PadBytes_ * 2) + Config_.HeaderBlocks_,
+                                            Config_.Alignment_);
    
-   chunk_size_ = (Config_.PadBytes_ * 2) + Config_.HeaderBlocks_ + Config_.Alignment_;   
+   chunk_size_ = (Config_.PadBytes_ * 2) + Config_.HeaderBlocks_ + Config_.InterAlignSize_;   
    block_size_ = OAStats_.ObjectSize_ + chunk_size_;   
+   first_block_ = sizeof(void*) + Config_.LeftAlignSize_ + Config_.HeaderBlocks_ + Config_.PadBytes_;
    
    //set page and free list to null
    page_list_ = NULL;
    free_list_ = NULL;
    
+   //the live set costs a hash insert per Allocate, the client may turn
+   //it off for a plain new/delete
+   Config_.TrackLiveObjects_ = config.TrackLiveObjects_;
+   track_live_ = Config_.UseCPPMemManager_ && Config_.TrackLiveObjects_;
+   
+   //a second header byte holds the tenant tag
+   Config_.TenantTags_ = config.TenantTags_ && !Config_.UseCPPMemManager_;
+   if(Config_.TenantTags_ && Config_.HeaderBlocks_ < 2)
+     throw OAException(OAException::E_BAD_CONFIG, 
+                       "ObjectAllocator: Tenant tags need at least 2 header blocks.");
+   tenants_ = NULL;
+   if(Config_.TenantTags_)
+   {
+     tenants_ = new (std::nothrow) OATenantStats[TENANTS];
+     if(!tenants_)
+       throw OAException(OAException::E_NO_MEMORY, "ObjectAllocator: No system memory available.");
+   }
+   
+   //FIFO ring mode keeps its pages in a ring instead of a free list
+   Config_.Ring_ = config.Ring_ && !Config_.UseCPPMemManager_;
+   ring_ = NULL;
+   if(Config_.Ring_)
+   {
+     ring_ = new (std::nothrow) OARing;
+     if(!ring_)
+     {
+       delete [] tenants_;
+       throw OAException(OAException::E_NO_MEMORY, "ObjectAllocator: No system memory available.");
+     }
+   }
+   
+   //address ordered mode trades the free list for bitmaps
+   Config_.AddressOrdered_ = config.AddressOrdered_ && !Config_.UseCPPMemManager_ && !Config_.Ring_;
+   ordered_ = NULL;
+   if(Config_.AddressOrdered_)
+   {
+     ordered_ = new (std::nothrow) OAOrdered;
+     if(!ordered_)
+     {
+       delete [] tenants_;
+       delete ring_;
+       throw OAException(OAException::E_NO_MEMORY, "ObjectAllocator: No system memory available.");
+     }
+   }
+   
+   UpdateSlowPath();
    
    //allocate first page of memory for client
    if(!Config_.UseCPPMemManager_)
-     AllocatePage();
-   
-   Config_.LeftAlignSize_ = Config_.Alignment_;  // number of alignment bytes required to align first block
-   Config_.InterAlignSize_ = Config_.Alignment_; // number of alignment bytes required between remaining blocks
-
+   {
+     try
+     {
+       GrowPages();
+     }
+     catch(...)
+     {
+       delete [] tenants_;
+       delete ring_;
+       delete ordered_;
+       throw;
+     }
+   }
 }
 
 /******************************************************************************/
 /*!
       \brief
-       Destructor for the ObjectAllocator class
+       Destructor for the ObjectAllocatorCore class
        deletes all memory allocated
 
 */
 /******************************************************************************/
-ObjectAllocator::~ObjectAllocator() throw()
+ObjectAllocatorCore::~ObjectAllocatorCore() OA_NOTHROW
 {
+  delete [] tenants_;
   if(!Config_.UseCPPMemManager_)
+  {
     DeAllocatePages(); // delete all memory allocated
+    delete ring_;
+    delete ordered_;
+  }
+  else
+  {
+    // delete whatever the client leaked
+    for(unsigned i = 0; i < live_objects_.Capacity(); ++i)
+    {
+      const char* object = reinterpret_cast<const char*>(live_objects_.Slot(i));
+      if(object && Config_.Destructor_)
+        Config_.Destructor_(const_cast<char*>(object));
+      delete [] object;
+    }
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Constructor for the ObjectAllocator class, every feature is
+       taken from config at runtime
+      
+      \param ObjectSize
+        Size of each object on a page
+      
+      \param config
+        the specifications of the config struct Objects per page, max pages, etc..
+
+*/
+/******************************************************************************/
+ObjectAllocator::ObjectAllocator(unsigned ObjectSize, const OAConfig& config)OA_THROW(OAException)
+  : BasicObjectAllocator<RuntimeDebugPolicy, RuntimeHeaderPolicy, 
+                         RuntimePagePolicy, NoLockPolicy>(ObjectSize, config)
+{
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Destructor for the ObjectAllocator class
+       deletes all memory allocated
+
+*/
+/******************************************************************************/
+ObjectAllocator::~ObjectAllocator() OA_NOTHROW
+{
 }
 
 /******************************************************************************/
 /*!
       \brief
-       Allocates a block of memory for the client and
-       returns to them a pointer to the block 
+       Out of line part of Allocate, used when the free list is empty or
+       when any of new/delete, debugging or header blocks is enabled
       
       \return
         a pointer to the block of memory allocated
       
 */
 /******************************************************************************/
-void* ObjectAllocator::Allocate() throw(OAException)
+void* ObjectAllocatorCore::AllocateSlow() OA_THROW(OAException)
 {
-   
    //allocator disabled
    //allocate using new
-    if(Config_.UseCPPMemManager_)
-    {
-      char* new_mem = new char[OAStats_.ObjectSize_];
-      --OAStats_.FreeObjects_;
-      ++OAStats_.ObjectsInUse_;
-      ++OAStats_.Allocations_;
+   if(Config_.UseCPPMemManager_)
+   {
+     for(bool reclaimed = false;; reclaimed = true)
+     {
+       try
+       {
+         return AllocateCPP();
+       }
+       catch(const OAException& e)
+       {
+         if(reclaimed || !Reclaim(e))
+           throw;
+       }
+     }
+   }
 
-      if(OAStats_.MostObjects_ < OAStats_.ObjectsInUse_)
-        ++OAStats_.MostObjects_;
+   return AllocateBlock(0);
+}
 
-      return new_mem;
-    }
-   //if there are no more free objects
-   //need to allocate new page
-   if(OAStats_.FreeObjects_ == 0 )
+/******************************************************************************/
+/*!
+      \brief
+       AllocateSlow off the pages, charged to a tenant if the allocator
+       has tenant tags. A tenant at its quota fails before anything else.
+      
+      \param Tenant
+        the tenant's tag (0 for Allocate)
+      
+      \return
+        a pointer to the block of memory allocated
+      
+*/
+/******************************************************************************/
+void* ObjectAllocatorCore::AllocateBlock(unsigned char Tenant)
+{
+   OATenantStats* tenant = tenants_ ? &tenants_[Tenant] : NULL;
+   if(tenant && tenant->Quota_ && tenant->ObjectsInUse_ >= tenant->Quota_)
    {
-     //if we have reached our max amount of pages throw exception
-     if(OAStats_.PagesInUse_ == Config_.MaxPages_)
-       throw OAException(OAException::E_NO_PAGES, 
-                         "allocate_new_page: The maximum number of pages has been allocated.");
-     AllocatePage();
+     ++tenant->Rejections_;
+     throw OAException(OAException::E_QUOTA_EXCEEDED, 
+                       "AllocateFor: The tenant's quota is used up.");
    }
-    
-    //set temp = freelist in order to swap pointers
-   GenericObject* temp = free_list_;
    
-   free_list_ = temp->Next;
+   GenericObject* temp;
+   if(ring_)
+     temp = RingAllocate();
+   else if(ordered_)
+     temp = OrderedAllocate();
+   else
+   {
+     //if there are no more free objects
+     //need to allocate new page
+     if(OAStats_.FreeObjects_ == 0)
+       GrowPages();
+      
+      //set temp = freelist in order to swap pointers
+     temp = free_list_;
+     free_list_ = NextOf(temp);
+   }
    
    //set allocated signature if debugging
    if(Config_.DebugOn_)
-   {
-     char * set_sig = reinterpret_cast<char*>(temp);
-     unsigned object = OAStats_.ObjectSize_;
-     while(object--)
-     {
-       *set_sig = ALLOCATED_PATTERN;
-       ++set_sig;
-     }
-   }
+     SetAllocatedSignature(temp);
    
    //set header block to in use
    if(Config_.HeaderBlocks_)
+     SetHeaderFlag(temp, 1);
+   
+   //tag it with its tenant
+   if(tenant)
    {
-     char* temp_free = reinterpret_cast<char*>(temp);
-     temp_free -= (Config_.PadBytes_ + 1);
-     *temp_free = 1;    
+     *TenantTag(temp) = Tenant;
+     if(++tenant->ObjectsInUse_ > tenant->MostObjects_)
+       tenant->MostObjects_ = tenant->ObjectsInUse_;
    }
    
    //update stats
@@ -168,68 +535,52 @@ void* ObjectAllocator::Allocate() throw(OAException)
 /******************************************************************************/
 /*!
       \brief
-       frees a block of memory
+       Out of line part of Free, used when any of new/delete, debugging
+       or header blocks is enabled
       
       \param Object
          a pointer to the object to be freed
               
 */
 /******************************************************************************/
-void ObjectAllocator::Free(void *Object) throw(OAException)
+void ObjectAllocatorCore::FreeSlow(void *Object) OA_THROW(OAException)
 {
-
     //allocator disabled
-    if(Config_.UseCPPMemManager_)
-    {
-      delete [] reinterpret_cast<char*>(Object);
-      //update stats
-      ++OAStats_.FreeObjects_;
-      ++OAStats_.Deallocations_;
-      --OAStats_.ObjectsInUse_;
-
-      return;
-    }
+   if(Config_.UseCPPMemManager_)
+   {
+     FreeCPP(Object);
+     return;
+   }
    //used to re-assign pointers
    GenericObject* temp = reinterpret_cast<GenericObject*> (Object);
    
    //make sure is on a page, good boundary, etc...
-    if(Config_.DebugOn_)
-    {
-      ValidateObject(Object);
-    }
+   if(Config_.DebugOn_)
+     ValidateObject(Object);
    
-   //set free signature if debugging
+   //the ring and the page bitmaps check the block themselves
+   //(double frees too)
+   if(ring_)
+     RingFree(temp);
+   else if(ordered_)
+     OrderedFree(temp);
+   
+   //then set free signature
    if(Config_.DebugOn_)
-   {
-     char * set_sig = reinterpret_cast<char*>(temp);
-     //skip next pointer
-     set_sig += sizeof(void*);
-     unsigned object = OAStats_.ObjectSize_ - sizeof(void*);
-     while(object--)
-     {
-       *set_sig = FREED_PATTERN;
-       ++set_sig;
-     }
-   }
+     SetFreedSignature(temp);
+   
+   //charge the tenant back (once, even for a double free)
+   if(tenants_ && *HeaderFlag(temp) == 1)
+     --tenants_[*TenantTag(temp)].ObjectsInUse_;
    
    //set header block to not in use
    if(Config_.HeaderBlocks_)
-   {
-     char* temp_free = reinterpret_cast<char*>(temp);
-     temp_free -= (Config_.PadBytes_ + 1);
-     *temp_free = 0;    
-   }
+     SetHeaderFlag(temp, 0);
    
    //perform free and re-assign pointers
-   //check if free list is empty
-   if(!free_list_)
-   {
-     free_list_ = temp;
-     free_list_->Next = NULL;
-   }
-   else
+   if(!ring_ && !ordered_)
    {
-     temp->Next = free_list_;
+     NextOf(temp) = free_list_;
      free_list_ = temp;
    }
    
@@ -242,676 +593,2387 @@ void ObjectAllocator::Free(void *Object) throw(OAException)
 /******************************************************************************/
 /*!
       \brief
-        Calls the callback fn for each block still in use
-        
-      \param fn
-        the callback function for each block in use
+        Turns the debugging code on or off
       
-      \return
-        the number of blocks in use by client
+      \param State
+        If in debug mode or not
       
 */
 /******************************************************************************/
-unsigned ObjectAllocator::DumpMemoryInUse(DUMPCALLBACK fn) const
+void ObjectAllocatorCore::SetDebugFlag(bool State)
 {
-    //how many objects are still in use
-    unsigned int in_use = 0;
-    bool being_used = true;
-    //walk through each page and if the block
-    //is not on the free_list its in use
-    GenericObject* temp_page_list = page_list_;
-    while(temp_page_list)
-    {
-    
-      if(Config_.HeaderBlocks_)
-      {
-         //get temp to current page
-         char* temp_block = reinterpret_cast<char*>(temp_page_list);
-
-         
-         for(unsigned i = 0; i < Config_.ObjectsPerPage_;++i)
-         {
-           //first block
-           if(i == 0)
-             temp_block += (sizeof(void*) + chunk_size_ - Config_.PadBytes_);
-           else
-             temp_block += block_size_;
-            //check header block, if 1 then in use
-            if(*(temp_block - Config_.PadBytes_ - 1) == 1)
-            {
-              ++in_use;
-              fn(temp_block + Config_.PadBytes_, OAStats_.ObjectSize_);
-            }
-         }
-      }
-      else 
-      {
-        //get to first block on page
-        char* temp_block = reinterpret_cast<char*>(temp_page_list);
-
-        //walk to each block in pagelist and see if
-        //its on the free list
-        for(unsigned i = 0; i < Config_.ObjectsPerPage_;++i)
-        {
-          //first block
-          if(i == 0)
-            temp_block += (sizeof(void*) + chunk_size_ - Config_.PadBytes_);
-          else
-            temp_block += block_size_;
-
-          GenericObject* t_block = reinterpret_cast<GenericObject*>(temp_block);
-          //walk the free list to see if the pointer
-          //matches one of those if not it is in use
-          GenericObject* temp_free = free_list_;
-          while(temp_free)
-          {
-            //its on the free list break and do nothing
-            if(temp_free == t_block)
-              being_used = false;
-       
-             temp_free = temp_free->Next;
-         
-          }
-          if(being_used)
-          {
-            ++in_use;
-            unsigned char* temp_send = reinterpret_cast<unsigned char*>(t_block);
-            fn(temp_send, OAStats_.ObjectSize_);
-          }
-		  
-		    being_used = true;
-         }
-       }
-
-      temp_page_list = temp_page_list->Next;
-    }
-	
-   return in_use;
+  Config_.DebugOn_ = State;
+  UpdateSlowPath();
 }
+
 /******************************************************************************/
 /*!
       \brief
-        Calls the callback fn for each block that is potentially corrupted
-        
-      \param fn
-        the callback function for each block that might be corrupted
-      
-      \return
-        the number of blocks that are corrupted
+        Decides whether Allocate/Free can stay on the inline fast path,
+        which only pops/pushes the free list
       
 */
 /******************************************************************************/
-unsigned ObjectAllocator::ValidatePages(VALIDATECALLBACK fn) const
+void ObjectAllocatorCore::UpdateSlowPath()
 {
-    unsigned corruptions = 0;
-   //go through each page and check each blocks pad bytes
-   //to see if they are overwritten if so pass back the * to the block
-   //that is corrupted and the size of the object
-   unsigned char * block;
-   GenericObject* temp_page_list = page_list_;
-   while(temp_page_list)
-   {
-     block = reinterpret_cast<unsigned char*>(temp_page_list);
-     //go to first block
-     block += (Config_.LeftAlignSize_ + Config_.HeaderBlocks_ + Config_.PadBytes_ + sizeof(void*));
-     if(!ValidateBlock(block))
-     {
-       corruptions++;
-       fn(block, OAStats_.ObjectSize_);
-     }
-   
-     //do the rest of the blocks on the page
-     for(unsigned i = 0; i < Config_.ObjectsPerPage_ - 1; ++i)
-     {
-       block += block_size_;
-       if(!ValidateBlock(block))
-       {
-         corruptions++;
-         fn(block, OAStats_.ObjectSize_);
-       }
-     }
-   
-     //go to the next page
-     temp_page_list = temp_page_list->Next;
-   }
-   
-   return corruptions;
+  slow_path_ = Config_.UseCPPMemManager_ || Config_.DebugOn_ || Config_.HeaderBlocks_ ||
+               Config_.ScratchOffset_ || Config_.Ring_ || Config_.AddressOrdered_;
 }
+
 /******************************************************************************/
 /*!
       \brief
-        Frees all empty pages *NOT IMPLEMENTED*
+        The free list link of a free block, at the start of its scratch
+        region (the start of the block unless object caching moved it)
+      
+      \param block
+        a block on (or going onto) the free list
       
       \return
-        the number of freed pages
+        the link
       
 */
 /******************************************************************************/
-unsigned ObjectAllocator::FreeEmptyPages(void)
+GenericObject*& ObjectAllocatorCore::NextOf(GenericObject* block) const
 {
-  return 1;
+  return reinterpret_cast<GenericObject*>(reinterpret_cast<char*>(block) + 
+                                          Config_.ScratchOffset_)->Next;
 }
+
 /******************************************************************************/
 /*!
       \brief
-        FReturns true if FreeEmptyPages and alignments 
-                           are implemented *NOT IMPLEMENTED*
+       Allocate when the allocator is disabled, uses new and (unless
+       TrackLiveObjects_ is off) remembers the object so leaks can still
+       be dumped
       
       \return
-        If extra credit was done or not
+        a pointer to the block of memory allocated
       
 */
 /******************************************************************************/
-bool ObjectAllocator::ImplementedExtraCredit(void)
+void* ObjectAllocatorCore::AllocateCPP()
 {
-   return false;
+  char* new_mem = new (std::nothrow) char[OAStats_.ObjectSize_];
+  if(!new_mem || (track_live_ && !live_objects_.Insert(new_mem)))
+  {
+    delete [] new_mem;
+    throw OAException(OAException::E_NO_MEMORY, "AllocateCPP: No system memory available.");
+  }
+  
+  //nothing is cached, every object is built when handed out
+  if(Config_.Constructor_)
+    Config_.Constructor_(new_mem);
+
+  //there is no free list, FreeObjects_ stays 0
+  ++OAStats_.ObjectsInUse_;
+  ++OAStats_.Allocations_;
+
+  if(OAStats_.MostObjects_ < OAStats_.ObjectsInUse_)
+    ++OAStats_.MostObjects_;
+
+  return new_mem;
 }
+
 /******************************************************************************/
 /*!
       \brief
-        Testing/Debugging/Statistic methods
-      
-      \param State
-        If in debug mode or not
+       Free when the allocator is disabled, uses delete. Tracking live
+       objects, the object must be one handed out by AllocateCPP that
+       hasn't been freed yet.
       
+      \param Object
+         a pointer to the object to be freed
+              
 */
 /******************************************************************************/
-void ObjectAllocator::SetDebugState(bool State) 
+void ObjectAllocatorCore::FreeCPP(void* Object)
 {
-  Config_.DebugOn_ = State;
+  //not live means freed already (or never allocated by us)
+  if(track_live_ && !live_objects_.Remove(Object))
+    throw OAException(OAException::E_MULTIPLE_FREE,
+                      "FreeCPP: Object has already been freed.");
+
+  if(Config_.Destructor_)
+    Config_.Destructor_(Object);
+  delete [] reinterpret_cast<char*>(Object);
+  //update stats
+  ++OAStats_.Deallocations_;
+  --OAStats_.ObjectsInUse_;
 }
+
 /******************************************************************************/
 /*!
       \brief
-        returns a pointer to the internal free list
+       Called by Allocate when the free list is empty, adds a page
+       unless the maximum number of pages has been reached. Out of
+       pages or memory, the reclaim handlers get to free some first
+       (once).
+              
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::GrowPages()
+{
+  for(bool reclaimed = false;; reclaimed = true)
+  {
+    try
+    {
+      //if we have reached our max amount of pages throw exception
+      if(Config_.MaxPages_ && OAStats_.PagesInUse_ == Config_.MaxPages_)
+        throw OAException(OAException::E_NO_PAGES, 
+                          "allocate_new_page: The maximum number of pages has been allocated.");
+      AllocatePage();
+      return;
+    }
+    catch(const OAException& e)
+    {
+      if(reclaimed || !Reclaim(e))
+        throw;
+    }
+    
+    //a handler may have freed blocks of ours (in ring mode only a
+    //page freed whole can be handed out again)
+    if(ring_ ? RingAdvance() : OAStats_.FreeObjects_ != 0)
+      return;
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Runs the reclaim handlers for an allocation that failed
+      
+      \param e
+         why it failed
       
       \return
-        pointer to the free list
+        true if a handler freed something and the allocation should
+        be tried again (callers try only once more)
+              
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::Reclaim(const OAException& e)
+{
+  if(!Config_.ReclaimHandlers_)
+    return false;
+  if(e.code() != OAException::E_NO_PAGES && e.code() != OAException::E_NO_MEMORY)
+    return false;
+  return Config_.ReclaimHandlers_->Run();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Sets the allocated signature over an entire block (only over its
+       scratch region if it holds a constructed object)
       
+      \param block
+         the block handed to the client
+              
 */
 /******************************************************************************/
-const void* ObjectAllocator::GetFreeList(void) const
+void ObjectAllocatorCore::SetAllocatedSignature(GenericObject* block)
 {
-  return free_list_;
+  char * set_sig = reinterpret_cast<char*>(block);
+  unsigned object = OAStats_.ObjectSize_;
+  if(Config_.Constructor_)
+  {
+    set_sig += Config_.ScratchOffset_;
+    object = Config_.ScratchSize_;
+  }
+  while(object--)
+  {
+    *set_sig = ALLOCATED_PATTERN;
+    ++set_sig;
+  }
 }
+
 /******************************************************************************/
 /*!
       \brief
-        returns a pointer to the internal page list
+       Sets the freed signature over a block (only over its scratch
+       region if it holds a constructed object), leaving the next pointer
       
-      \return
-        pointer to the page list
+      \param block
+         the block returned by the client
+              
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::SetFreedSignature(GenericObject* block)
+{
+  char * set_sig = reinterpret_cast<char*>(block);
+  char * end = set_sig + OAStats_.ObjectSize_;
+  if(Config_.Constructor_)
+  {
+    set_sig += Config_.ScratchOffset_;
+    end = set_sig + Config_.ScratchSize_;
+  }
+  //skip next pointer
+  char * link = reinterpret_cast<char*>(&NextOf(block));
+  for(; set_sig < end; ++set_sig)
+    if(set_sig < link || set_sig >= link + sizeof(void*))
+      *set_sig = FREED_PATTERN;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Marks the header block of a block as in use or not in use
       
+      \param block
+         the block whose header is set
+
+      \param flag
+         1 = in use, 0 = not in use
+              
 */
 /******************************************************************************/
-const void* ObjectAllocator::GetPageList(void) const
+void ObjectAllocatorCore::SetHeaderFlag(GenericObject* block, unsigned char flag)
 {
-  return page_list_;
-} 
+  *HeaderFlag(block) = flag;
+}
+
 /******************************************************************************/
 /*!
       \brief
-        returns the configuration parameters
+       Finds the in use flag of a block, the last byte of its header
+       (just in front of the left pad bytes)
       
+      \param block
+         the block whose header is wanted
+
       \return
-        config parameters
-      
+         pointer to the in use byte
+              
 */
-/******************************************************************************/ 
-OAConfig ObjectAllocator::GetConfig(void) const
+/******************************************************************************/
+unsigned char* ObjectAllocatorCore::HeaderFlag(const void* block) const
 {
-  return Config_;
+  const unsigned char* flag = reinterpret_cast<const unsigned char*>(block);
+  flag -= (Config_.PadBytes_ + 1);
+  return const_cast<unsigned char*>(flag);
 }
+
 /******************************************************************************/
 /*!
       \brief
-        returns the statistics for the allocator
+       Finds the tenant tag of a block, the header byte in front of its
+       in use flag
       
+      \param block
+         the block whose tag is wanted
+
       \return
-        Allocator stats
+         pointer to the tenant byte
+              
+*/
+/******************************************************************************/
+unsigned char* ObjectAllocatorCore::TenantTag(const void* block) const
+{
+  return HeaderFlag(block) - 1;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Allocates a block for a tenant
       
+      \param Tenant
+         the tenant's tag
+
+      \return
+         a pointer to the block of memory allocated
+              
 */
-/******************************************************************************/     
-OAStats ObjectAllocator::GetStats(void) const
+/******************************************************************************/
+void* ObjectAllocatorCore::AllocateTenant(unsigned char Tenant) OA_THROW(OAException)
 {
-  return OAStats_;
+  if(!tenants_)
+    throw OAException(OAException::E_BAD_CONFIG, 
+                      "AllocateFor: The allocator has no tenant tags (OAConfig::TenantTags_).");
+  return AllocateBlock(Tenant);
 }
+
 /******************************************************************************/
 /*!
       \brief
-        Allocates and sets up the freelist for an entire page
+        Calls the callback fn for each block of one tenant still in use,
+        found by the in use flag and tag in their headers
+        
+      \param fn
+        the callback function for each block in use
+      
+      \param Tenant
+        the tenant's tag
+      
+      \return
+        the number of the tenant's blocks in use
       
 */
-/******************************************************************************/          
-void ObjectAllocator::AllocatePage()
+/******************************************************************************/
+unsigned ObjectAllocatorCore::DumpTenantBlocks(DUMPCALLBACK fn, unsigned char Tenant) const
 {
-  // size of a page: ObjectsPerPage_ * ObjectSize_ + sizeof(void*)
-  OAStats_.PageSize_ = Config_.ObjectsPerPage_ * OAStats_.ObjectSize_ + sizeof(void*) 
-                                                    + Config_.ObjectsPerPage_ * chunk_size_;
+  if(!tenants_)
+    return 0;
   
-  ++OAStats_.PagesInUse_;
-  //retrieve the chunk of memory from os aka allocate page
-  //if new fails throw an exception
-  char* NewPage = new (std::nothrow) char[OAStats_.PageSize_];
-  if(!NewPage)
-    throw OAException(OAException::E_NO_MEMORY, "allocate_new_page: No system memory available."); 
-   
-  //set the initial signatures for the page
-  char* set_signatures = NewPage;
-  SetSignatures(set_signatures);
-   
-   
-  //cast page to generic object
-  GenericObject* Page = reinterpret_cast<GenericObject*>(NewPage);
-   
-  //set the next pointer of page to previous page or NULL if first page
-  if(OAStats_.PagesInUse_ == 1)
-    Page->Next = NULL;
-  else
-    Page->Next = page_list_;
-   
-   //point pagelist to the beginning of the page
-  page_list_ = Page; 
-   
-  char* temp_page_list = reinterpret_cast<char*>(page_list_);
-  //use to walk through memory and set up page  
-  //the start of the free_list_ begins after
-  //the page_list_ pointer, alignment, header, padding 
-  char* temp_free_list = reinterpret_cast<char*>(temp_page_list)
-                         + sizeof(void*) + (chunk_size_ - Config_.PadBytes_);
-                        //^^^^^^^^^^^^^^^^^^^^^^^^^^^^^need to think about alignment
-   
-  free_list_ = reinterpret_cast<GenericObject*>(temp_free_list);
-   
-  GenericObject* Block = free_list_;
-   
-  Block->Next = NULL;
-   
-  //size of bytes in use blocks created
-  unsigned commited_bytes = 0;
-
-  //loop through page and set up free_list_
-  for(unsigned i = 0; i < Config_.ObjectsPerPage_
-               || commited_bytes >= OAStats_.PageSize_; ++i)
+  unsigned in_use = 0;
+  for(GenericObject* page = page_list_; page; page = page->Next)
   {
-    //avoid access overrun
-    if(i < Config_.ObjectsPerPage_ - 1)
+    char* block = reinterpret_cast<char*>(page) + first_block_;
+    for(unsigned i = 0; i < Config_.ObjectsPerPage_; ++i, block += block_size_)
     {
-      temp_free_list = reinterpret_cast<char*>(temp_free_list);
-        
-      temp_free_list += (OAStats_.ObjectSize_ + chunk_size_);
-         
-      GenericObject* block_temp = reinterpret_cast<GenericObject*>(temp_free_list);
-      block_temp->Next = free_list_;
-      free_list_ = reinterpret_cast<GenericObject*>(temp_free_list);
+      if(*HeaderFlag(block) == 1 && *TenantTag(block) == Tenant)
+      {
+        ++in_use;
+        fn(block, OAStats_.ObjectSize_);
+      }
     }
-	
-     commited_bytes += OAStats_.ObjectSize_;
-     ++OAStats_.FreeObjects_;
   }
-   
-
+  return in_use;
+}
 
-   
+/******************************************************************************/
+/*!
+      \brief
+        Sets the most objects a tenant may have in use, ignored without
+        tenant tags
+        
+      \param Tenant
+        the tenant's tag
+      
+      \param Objects
+        the quota, 0 for none
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::SetQuota(unsigned char Tenant, unsigned Objects)
+{
+  if(tenants_)
+    tenants_[Tenant].Quota_ = Objects;
 }
 
 /******************************************************************************/
 /*!
       \brief
-        frees all memory in use
+        returns the counters of one tenant
+        
+      \param Tenant
+        the tenant's tag
       
 */
-/******************************************************************************/ 
-void ObjectAllocator::DeAllocatePages()
+/******************************************************************************/
+OATenantStats ObjectAllocatorCore::TenantStats(unsigned char Tenant) const
 {
-  char* temp;
-  while(page_list_)
-  {
-    temp = reinterpret_cast<char *>(page_list_->Next);
-    delete [] page_list_;
-    page_list_ = reinterpret_cast<GenericObject*>(temp);
-  }
+  return tenants_ ? tenants_[Tenant] : OATenantStats();
 }
+
 /******************************************************************************/
 /*!
       \brief
-        Helper Function for Free.
-        Validates a free requests from the client, makes sure they are
-        not trying to double free, free on bad boundary etc.
+        Calls the callback fn for each block still in use
+        
+      \param fn
+        the callback function for each block in use
       
-      \param Object
-        the requested object to be freed
+      \return
+        the number of blocks in use by client
       
 */
-/******************************************************************************/ 
-void ObjectAllocator::ValidateObject(void* Object)
+/******************************************************************************/
+unsigned ObjectAllocatorCore::DumpBlocksInUse(DUMPCALLBACK fn) const
 {
-   //used to re-assign pointers
-   GenericObject* temp = reinterpret_cast<GenericObject*> (Object);
-   GenericObject* temp_walk;
-   //check multiple free via header block
-   if(Config_.HeaderBlocks_)
-   {
-     unsigned char* header_check = reinterpret_cast<unsigned char*>(temp);
-     if(*(header_check - Config_.PadBytes_) == 0)
-       throw OAException(OAException::E_MULTIPLE_FREE,
-                               "FreeObject: Object has already been freed.");
-   }
-   else
-   {
-     //perform check to see if the object has already
-     //been freed by walking the free list
-     temp_walk = free_list_;
-   
-     while(temp_walk != NULL)
-     {
-       //object on free_list_
-       if(temp_walk == temp)
-         throw OAException(OAException::E_MULTIPLE_FREE,
-                               "FreeObject: Object has already been freed.");
+    //how many objects are still in use
+    unsigned int in_use = 0;
+    bool being_used = true;
+
+    //by-passed, there are no pages, only the live set (empty
+    //without TrackLiveObjects_)
+    if(Config_.UseCPPMemManager_)
+    {
+      for(unsigned i = 0; i < live_objects_.Capacity(); ++i)
+      {
+        const void* object = live_objects_.Slot(i);
+        if(object)
+        {
+          ++in_use;
+          fn(object, OAStats_.ObjectSize_);
+        }
+      }
+      return in_use;
+    }
+    
+    //the ring knows which blocks are live
+    if(ring_)
+    {
+      for(unsigned i = 0; i < ring_->Pages.size(); ++i)
+      {
+        const OARingPage* page = ring_->Pages[i];
+        for(unsigned slot = 0; slot < Config_.ObjectsPerPage_; ++slot)
+          if(page->Bits[slot / 64] & (1ULL << (slot % 64)))
+          {
+            ++in_use;
+            fn(page->First + slot * block_size_, OAStats_.ObjectSize_);
+          }
+      }
+      return in_use;
+    }
+    
+    //so do the page bitmaps, in address order
+    if(ordered_)
+    {
+      for(unsigned i = 0; i < ordered_->ByAddress.size(); ++i)
+      {
+        const OAOrderedPage* page = ordered_->ByAddress[i];
+        for(unsigned slot = 0; slot < Config_.ObjectsPerPage_; ++slot)
+          if(!(page->Bits[slot / 64] & (1ULL << (slot % 64))))
+          {
+            ++in_use;
+            fn(page->First + slot * block_size_, OAStats_.ObjectSize_);
+          }
+      }
+      return in_use;
+    }
+
+    //walk through each page and if the block
+    //is not on the free_list its in use
+    GenericObject* temp_page_list = page_list_;
+    while(temp_page_list)
+    {
+    
+      if(Config_.HeaderBlocks_)
+      {
+         //get temp to current page
+         char* temp_block = reinterpret_cast<char*>(temp_page_list);
+
+         
+         for(unsigned i = 0; i < Config_.ObjectsPerPage_;++i)
+         {
+           //first block
+           if(i == 0)
+             temp_block += first_block_;
+           else
+             temp_block += block_size_;
+            //check header block, if 1 then in use
+            if(*HeaderFlag(temp_block) == 1)
+            {
+              ++in_use;
+              fn(temp_block, OAStats_.ObjectSize_);
+            }
+         }
+      }
+      else 
+      {
+        //get to first block on page
+        char* temp_block = reinterpret_cast<char*>(temp_page_list);
+
+        //walk to each block in pagelist and see if
+        //its on the free list
+        for(unsigned i = 0; i < Config_.ObjectsPerPage_;++i)
+        {
+          //first block
+          if(i == 0)
+            temp_block += first_block_;
+          else
+            temp_block += block_size_;
+
+          GenericObject* t_block = reinterpret_cast<GenericObject*>(temp_block);
+          //walk the free list to see if the pointer
+          //matches one of those if not it is in use
+          GenericObject* temp_free = free_list_;
+          while(temp_free)
+          {
+            //its on the free list break and do nothing
+            if(temp_free == t_block)
+              being_used = false;
+       
+             temp_free = NextOf(temp_free);
+         
+          }
+          if(being_used)
+          {
+            ++in_use;
+            unsigned char* temp_send = reinterpret_cast<unsigned char*>(t_block);
+            fn(temp_send, OAStats_.ObjectSize_);
+          }
+		  
+		    being_used = true;
+         }
+       }
+
+      temp_page_list = temp_page_list->Next;
+    }
+	
+   return in_use;
+}
+/******************************************************************************/
+/*!
+      \brief
+        Calls the callback fn for each block that is potentially corrupted
         
-       temp_walk = temp_walk->Next;
-     }
-   }
-  
-   
-   //perform check to make sure the object trying to 
-   //to be freed is on one of the pages
-   
-   temp_walk = page_list_;
-   //if there are no pages then no memory can
-   //be freed
-   if(!page_list_)
-     throw OAException(OAException::E_BAD_ADDRESS, "validate_object: Object not on a page.");
-     
-   //check address boundaries of each page
-   //if not in boundaries cannot be freed
-   unsigned page = 1;
-   while(temp_walk)
+      \param fn
+        the callback function for each block that might be corrupted
+      
+      \return
+        the number of blocks that are corrupted
+      
+*/
+/******************************************************************************/
+unsigned ObjectAllocatorCore::ValidateAllPages(VALIDATECALLBACK fn) const
+{
+    unsigned corruptions = 0;
+   //go through each page and check each blocks pad bytes
+   //to see if they are overwritten if so pass back the * to the block
+   //that is corrupted and the size of the object
+   unsigned char * block;
+   GenericObject* temp_page_list = page_list_;
+   while(temp_page_list)
    {
-     char* temp_end = reinterpret_cast<char*>(temp_walk);
-     temp_end += OAStats_.PageSize_;
-     GenericObject* end_of_page = reinterpret_cast<GenericObject*>(temp_end);
-     if(temp > temp_walk && temp < end_of_page)
-       break;
-     else if (page == OAStats_.PagesInUse_)
-       throw OAException(OAException::E_BAD_ADDRESS, "validate_object: Object not on a page.");
-     
-     temp_walk = temp_walk->Next;
-     ++page;
-   }   
-   
-   //check to see if on a bad boundary
-   //get to first block on the page
-   unsigned char* block = reinterpret_cast<unsigned char*>(temp_walk);
-   block += (sizeof(void*) + chunk_size_ - Config_.PadBytes_);
-   
-   unsigned char* free_block = reinterpret_cast<unsigned char*>(Object);
+     block = reinterpret_cast<unsigned char*>(temp_page_list);
+     //go to first block
+     block += first_block_;
+     if(!ValidateBlock(block))
+     {
+       corruptions++;
+       fn(block, OAStats_.ObjectSize_);
+     }
    
-   //get the distance between two pointers
-   unsigned distance = free_block - block;
+     //do the rest of the blocks on the page
+     for(unsigned i = 0; i < Config_.ObjectsPerPage_ - 1; ++i)
+     {
+       block += block_size_;
+       if(!ValidateBlock(block))
+       {
+         corruptions++;
+         fn(block, OAStats_.ObjectSize_);
+       }
+     }
    
-   //remainder means bad boundary
-   if(distance % (OAStats_.ObjectSize_ + chunk_size_))
-     throw OAException(OAException::E_BAD_BOUNDARY,"validate_object: Object on bad boundary in page.");
-     
-   //test corruption
-   //check left padding
-   unsigned char* temp_free = free_block;
-
-   //check padbytes to the left
-   for(unsigned i = 0; i < Config_.PadBytes_; ++i)
-   {
-     //go back to pad byte closest to block
-     --temp_free;
-     //if pad pattern not in pad bytes
-     //then block is corrupted
-     if(*temp_free != PAD_PATTERN)
-       throw OAException(OAException::E_CORRUPTED_BLOCK,"check_padbytes: Memory corrupted before block.");
-        
+     //go to the next page
+     temp_page_list = temp_page_list->Next;
    }
    
-   //check pad bytes on the right
-   temp_free = free_block;
-   temp_free += OAStats_.ObjectSize_;
-   
-   for(unsigned i = 0; i < Config_.PadBytes_; ++i)
-   {
-     //if pad pattern not in pad bytes
-     //then block is corrupted
-     if(*temp_free != PAD_PATTERN)
-      throw OAException(OAException::E_CORRUPTED_BLOCK,"check_padbytes: Memory corrupted after block.");
+   return corruptions;
+}
+/******************************************************************************/
+/*!
+      \brief
+        Frees all empty pages, those with every block on the free list.
+        The free blocks are counted per page in one pass over the free
+        list and the empty pages' blocks are taken off in a second one.
+      
+      \return
+        the number of freed pages
+      
+*/
+/******************************************************************************/
+unsigned ObjectAllocatorCore::ReleaseEmptyPages(void)
+{
+  //nothing is pooled when by-passed
+  if(Config_.UseCPPMemManager_)
+    return 0;
+  
+  //the ring and the page bitmaps know their empty pages
+  if(ring_ || ordered_)
+  {
+    unsigned freed = 0;
+    GenericObject** page_link = &page_list_;
+    while(*page_link)
+    {
+      char* page = reinterpret_cast<char*>(*page_link);
+      if(ring_ ? RingPageEmpty(page) : OrderedPageEmpty(page))
+      {
+        UnlinkPage(page_link);
+        ++freed;
+      }
+      else
+        page_link = &(*page_link)->Next;
+    }
+    return freed;
+  }
+  
+  //pages sorted by address, to find the page of a block
+  std::vector<char*> pages;
+  std::vector<unsigned> free_blocks;
+  try
+  {
+    for(GenericObject* page = page_list_; page; page = page->Next)
+      pages.push_back(reinterpret_cast<char*>(page));
+    free_blocks.assign(pages.size(), 0);
+  }
+  catch(const std::bad_alloc&)
+  {
+    throw OAException(OAException::E_NO_MEMORY, "FreeEmptyPages: No system memory available.");
+  }
+  std::sort(pages.begin(), pages.end());
+  
+  for(GenericObject* block = free_list_; block; block = NextOf(block))
+    ++free_blocks[PageIndex(pages, reinterpret_cast<char*>(block))];
+  
+  unsigned empty = 0;
+  for(unsigned i = 0; i < pages.size(); ++i)
+    if(free_blocks[i] == Config_.ObjectsPerPage_)
+      ++empty;
+  if(!empty)
+    return 0;
+  
+  GenericObject** block_link = &free_list_;
+  while(*block_link)
+  {
+    unsigned page = PageIndex(pages, reinterpret_cast<char*>(*block_link));
+    if(free_blocks[page] == Config_.ObjectsPerPage_)
+      *block_link = NextOf(*block_link);
+    else
+      block_link = &NextOf(*block_link);
+  }
+  
+  GenericObject** page_link = &page_list_;
+  while(*page_link)
+  {
+    char* page = reinterpret_cast<char*>(*page_link);
+    if(free_blocks[PageIndex(pages, page)] == Config_.ObjectsPerPage_)
+      UnlinkPage(page_link);
+    else
+      page_link = &(*page_link)->Next;
+  }
+  
+  return empty;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees one page if it is empty. Its blocks are moved off the free
+        list while they are counted, and put back in front if the page
+        turns out to have blocks in use.
+      
+      \param Page
+        start of the page
+      
+      \return
+        true if the page was freed, false if it isn't one of ours or has
+        blocks in use
+      
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::ReleaseEmptyPage(const void* Page)
+{
+  if(Config_.UseCPPMemManager_)
+    return false;
+  
+  GenericObject** page_link = &page_list_;
+  while(*page_link && *page_link != Page)
+    page_link = &(*page_link)->Next;
+  if(!*page_link)
+    return false;
+  
+  const char* begin = reinterpret_cast<const char*>(Page);
+  if(ring_ || ordered_)
+  {
+    if(ring_ ? !RingPageEmpty(begin) : !OrderedPageEmpty(begin))
+      return false;
+    UnlinkPage(page_link);
+    return true;
+  }
+  
+  const char* end = begin + OAStats_.PageSize_;
+  GenericObject* taken = NULL;
+  GenericObject* last_taken = NULL;
+  unsigned free_blocks = 0;
+  GenericObject** block_link = &free_list_;
+  while(*block_link)
+  {
+    GenericObject* block = *block_link;
+    if(reinterpret_cast<char*>(block) >= begin && reinterpret_cast<char*>(block) < end)
+    {
+      *block_link = NextOf(block);
+      NextOf(block) = taken;
+      taken = block;
+      if(!last_taken)
+        last_taken = block;
+      ++free_blocks;
+    }
+    else
+      block_link = &NextOf(block);
+  }
+  
+  if(free_blocks != Config_.ObjectsPerPage_)
+  {
+    if(taken)
+    {
+      NextOf(last_taken) = free_list_;
+      free_list_ = taken;
+    }
+    return false;
+  }
+  
+  UnlinkPage(page_link);
+  return true;
+}
+/******************************************************************************/
+/*!
+      \brief
+        Returns true if FreeEmptyPages and alignments 
+                           are implemented
+      
+      \return
+        If extra credit was done or not
+      
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::ImplementedExtraCredit(void)
+{
+   return true;
+}
+/******************************************************************************/
+/*!
+      \brief
+        returns a pointer to the internal free list
+      
+      \return
+        pointer to the free list
+      
+*/
+/******************************************************************************/
+const void* ObjectAllocatorCore::GetFreeList(void) const
+{
+  return free_list_;
+}
+/******************************************************************************/
+/*!
+      \brief
+        returns a pointer to the internal page list
+      
+      \return
+        pointer to the page list
+      
+*/
+/******************************************************************************/
+const void* ObjectAllocatorCore::GetPageList(void) const
+{
+  return page_list_;
+} 
+/******************************************************************************/
+/*!
+      \brief
+        returns the configuration parameters
+      
+      \return
+        config parameters
+      
+*/
+/******************************************************************************/ 
+OAConfig ObjectAllocatorCore::GetConfig(void) const
+{
+  return Config_;
+}
+/******************************************************************************/
+/*!
+      \brief
+        Allocates and sets up the freelist for an entire page
+      
+*/
+/******************************************************************************/          
+void ObjectAllocatorCore::AllocatePage()
+{
+  // size of a page: ObjectsPerPage_ * ObjectSize_ + sizeof(void*)
+  OAStats_.PageSize_ = PageSizeFor(OAStats_.ObjectSize_, Config_);
+  
+  //retrieve the chunk of memory from os aka allocate page
+  //(or the client's page source), if that fails throw an exception
+  char* NewPage;
+  if(Config_.PageSource_)
+    NewPage = Config_.PageSource_->AllocatePage(OAStats_.PageSize_);
+  else
+    NewPage = new (std::nothrow) char[OAStats_.PageSize_];
+  if(!NewPage)
+    throw OAException(OAException::E_NO_MEMORY, "allocate_new_page: No system memory available."); 
+  if((ring_ && !RingInsert(NewPage)) || (ordered_ && !OrderedInsert(NewPage)))
+  {
+    if(Config_.PageSource_)
+      Config_.PageSource_->FreePage(NewPage, OAStats_.PageSize_);
+    else
+      delete [] NewPage;
+    throw OAException(OAException::E_NO_MEMORY, "allocate_new_page: No system memory available."); 
+  }
+  ++OAStats_.PagesInUse_;
+   
+  //set the initial signatures for the page
+  char* set_signatures = NewPage;
+  SetSignatures(set_signatures);
+  
+  //build the objects once, they are handed out constructed
+  if(Config_.Constructor_)
+    ConstructPage(NewPage);
+   
+   
+  //cast page to generic object
+  GenericObject* Page = reinterpret_cast<GenericObject*>(NewPage);
+   
+  //set the next pointer of page to previous page or NULL if first page
+  if(OAStats_.PagesInUse_ == 1)
+    Page->Next = NULL;
+  else
+    Page->Next = page_list_;
+   
+   //point pagelist to the beginning of the page
+  page_list_ = Page; 
+  
+  //the ring and the page bitmaps hand the blocks out in order, no free list
+  if(ring_ || ordered_)
+  {
+    OAStats_.FreeObjects_ += Config_.ObjectsPerPage_;
+    return;
+  }
+   
+  char* temp_page_list = reinterpret_cast<char*>(page_list_);
+  //use to walk through memory and set up page  
+  //the start of the free_list_ begins after
+  //the page_list_ pointer, alignment, header, padding 
+  char* temp_free_list = reinterpret_cast<char*>(temp_page_list)
+                         + first_block_;
+   
+  //the page's blocks go in front of any blocks already free
+  //(AllocateContiguous grows pages while there are)
+  GenericObject* Block = reinterpret_cast<GenericObject*>(temp_free_list);
+   
+  NextOf(Block) = free_list_;
+   
+  free_list_ = Block;
+   
+  //size of bytes in use blocks created
+  unsigned commited_bytes = 0;
+
+  //loop through page and set up free_list_
+  for(unsigned i = 0; i < Config_.ObjectsPerPage_
+               || commited_bytes >= OAStats_.PageSize_; ++i)
+  {
+    //avoid access overrun
+    if(i < Config_.ObjectsPerPage_ - 1)
+    {
+      temp_free_list = reinterpret_cast<char*>(temp_free_list);
+        
+      temp_free_list += block_size_;
+         
+      GenericObject* block_temp = reinterpret_cast<GenericObject*>(temp_free_list);
+      NextOf(block_temp) = free_list_;
+      free_list_ = reinterpret_cast<GenericObject*>(temp_free_list);
+    }
+	
+     commited_bytes += OAStats_.ObjectSize_;
+     ++OAStats_.FreeObjects_;
+  }
+   
+
+
+   
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        frees all memory in use
+      
+*/
+/******************************************************************************/ 
+void ObjectAllocatorCore::DeAllocatePages()
+{
+  char* temp;
+  while(page_list_)
+  {
+    temp = reinterpret_cast<char *>(page_list_->Next);
+    ReleasePage(page_list_);
+    page_list_ = reinterpret_cast<GenericObject*>(temp);
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes an empty page off the page list and frees it, the caller
+        has already taken its blocks off the free list
+      
+      \param PageLink
+        the link (page_list_ or a Next) that points at the page
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::UnlinkPage(GenericObject** PageLink)
+{
+  GenericObject* page = *PageLink;
+  *PageLink = page->Next;
+  if(ring_)
+    RingRemove(reinterpret_cast<char*>(page));
+  else if(ordered_)
+    OrderedRemove(reinterpret_cast<char*>(page));
+  ReleasePage(page);
+  
+  OAStats_.FreeObjects_ -= Config_.ObjectsPerPage_;
+  --OAStats_.PagesInUse_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Gives one page back to the page source (or delete[]), the caller
+        has already taken it off the page list
+      
+      \param Page
+        the page to free
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::ReleasePage(GenericObject* Page)
+{
+  if(Config_.Destructor_)
+    DestructPage(Page);
+  
+  if(Config_.PageSource_)
+    Config_.PageSource_->FreePage(reinterpret_cast<char *>(Page), OAStats_.PageSize_);
+  else
+    delete [] reinterpret_cast<char *>(Page);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Runs the client's constructor on every block of a new page
+      
+      \param Page
+        the page, before its free list is built
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::ConstructPage(char* Page)
+{
+  char* block = Page + first_block_;
+  for(unsigned i = 0; i < Config_.ObjectsPerPage_; ++i, block += block_size_)
+    Config_.Constructor_(block);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Runs the client's destructor on every block of a page that is
+        given back, including blocks the client never freed
+      
+      \param Page
+        the page
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::DestructPage(GenericObject* Page)
+{
+  char* block = reinterpret_cast<char*>(Page) + first_block_;
+  for(unsigned i = 0; i < Config_.ObjectsPerPage_; ++i, block += block_size_)
+    Config_.Destructor_(block);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Size of one page for an object size and a configuration, the
+        page's next pointer plus every block with its padding, header
+        and alignment bytes
+      
+      \param ObjectSize
+        Size of each object on a page
+      
+      \param config
+        the configuration of the allocator
+        
+      \return
+        the page size in bytes
+      
+*/
+/******************************************************************************/ 
+unsigned ObjectAllocatorCore::PageSizeFor(unsigned ObjectSize, const OAConfig& config)
+{
+  unsigned block = ObjectSize + (config.PadBytes_ * 2) + config.HeaderBlocks_;
+  unsigned left_align = AlignmentBytes(sizeof(void*) + config.HeaderBlocks_ + config.PadBytes_, config.Alignment_);
+  unsigned inter_align = AlignmentBytes(block, config.Alignment_);
+  if(!config.ObjectsPerPage_)
+    return sizeof(void*) + left_align;
+  return sizeof(void*) + left_align + config.ObjectsPerPage_ * block
+         + (config.ObjectsPerPage_ - 1) * inter_align;
+}
+/******************************************************************************/
+/*!
+      \brief
+        Helper Function for Free.
+        Validates a free requests from the client, makes sure they are
+        not trying to double free, free on bad boundary etc.
+      
+      \param Object
+        the requested object to be freed
+      
+*/
+/******************************************************************************/ 
+void ObjectAllocatorCore::ValidateObject(void* Object)
+{
+   //used to re-assign pointers
+   GenericObject* temp = reinterpret_cast<GenericObject*> (Object);
+   GenericObject* temp_walk;
+   //check multiple free via header block
+   if(Config_.HeaderBlocks_)
+   {
+     if(*HeaderFlag(temp) == 0)
+       throw OAException(OAException::E_MULTIPLE_FREE,
+                               "FreeObject: Object has already been freed.");
+   }
+   else
+   {
+     //perform check to see if the object has already
+     //been freed by walking the free list
+     temp_walk = free_list_;
+   
+     while(temp_walk != NULL)
+     {
+       //object on free_list_
+       if(temp_walk == temp)
+         throw OAException(OAException::E_MULTIPLE_FREE,
+                               "FreeObject: Object has already been freed.");
+        
+       temp_walk = NextOf(temp_walk);
+     }
+   }
+  
+   
+   //perform check to make sure the object trying to 
+   //to be freed is on one of the pages
+   
+   temp_walk = page_list_;
+   //if there are no pages then no memory can
+   //be freed
+   if(!page_list_)
+     throw OAException(OAException::E_BAD_ADDRESS, "validate_object: Object not on a page.");
+     
+   //check address boundaries of each page
+   //if not in boundaries cannot be freed
+   unsigned page = 1;
+   while(temp_walk)
+   {
+     char* temp_end = reinterpret_cast<char*>(temp_walk);
+     temp_end += OAStats_.PageSize_;
+     GenericObject* end_of_page = reinterpret_cast<GenericObject*>(temp_end);
+     if(temp > temp_walk && temp < end_of_page)
+       break;
+     else if (page == OAStats_.PagesInUse_)
+       throw OAException(OAException::E_BAD_ADDRESS, "validate_object: Object not on a page.");
+     
+     temp_walk = temp_walk->Next;
+     ++page;
+   }   
+   
+   //check to see if on a bad boundary
+   //get to first block on the page
+   unsigned char* block = reinterpret_cast<unsigned char*>(temp_walk);
+   block += first_block_;
+   
+   unsigned char* free_block = reinterpret_cast<unsigned char*>(Object);
+   
+   //get the distance between two pointers
+   unsigned distance = free_block - block;
+   
+   //remainder means bad boundary
+   if(distance % (OAStats_.ObjectSize_ + chunk_size_))
+     throw OAException(OAException::E_BAD_BOUNDARY,"validate_object: Object on bad boundary in page.");
+     
+   //test corruption
+   //check left padding
+   unsigned char* temp_free = free_block;
+
+   //check padbytes to the left
+   for(unsigned i = 0; i < Config_.PadBytes_; ++i)
+   {
+     //go back to pad byte closest to block
+     --temp_free;
+     //if pad pattern not in pad bytes
+     //then block is corrupted
+     if(*temp_free != PAD_PATTERN)
+       throw OAException(OAException::E_CORRUPTED_BLOCK,"check_padbytes: Memory corrupted before block.");
+        
+   }
+   
+   //check pad bytes on the right
+   temp_free = free_block;
+   temp_free += OAStats_.ObjectSize_;
+   
+   for(unsigned i = 0; i < Config_.PadBytes_; ++i)
+   {
+     //if pad pattern not in pad bytes
+     //then block is corrupted
+     if(*temp_free != PAD_PATTERN)
+      throw OAException(OAException::E_CORRUPTED_BLOCK,"check_padbytes: Memory corrupted after block.");
+
+     temp_free++;
+   }
+   
+}
+/******************************************************************************/
+/*!
+      \brief
+        Sets all Debug Signatures for an initial page and Header Blocks
+        regardless of debug or not
+      
+      \param set_signatures
+        the beginnig of where to put signatures
+      
+*/
+/******************************************************************************/ 
+void ObjectAllocatorCore::SetSignatures(char * set_signatures)
+{
+  //set initial signatures
+  //get past page list next pointer
+  set_signatures += sizeof(void*);
+  
+  //set alignment if any
+  if(Config_.DebugOn_)
+  {
+    if(Config_.LeftAlignSize_)
+    {
+      unsigned temp_align = Config_.LeftAlignSize_;
+      while(temp_align--)
+      {
+        *set_signatures = ALIGN_PATTERN;
+        ++set_signatures;
+      }
+     
+    }
+    //set header blocks if any
+    if(Config_.HeaderBlocks_)
+    {
+      unsigned temp_header = Config_.HeaderBlocks_;
+      while(temp_header--)
+      {
+        *set_signatures = 00;
+        ++set_signatures;
+      }
+    }
+  }
+  else
+  {
+    set_signatures += Config_.LeftAlignSize_;
+    //set header blocks if any
+    if(Config_.HeaderBlocks_)
+    {
+      unsigned temp_header = Config_.HeaderBlocks_;
+      while(temp_header--)
+      {
+        *set_signatures = 00;
+        ++set_signatures;
+      }
+    }
+    //no pad signatures, just get to the first block
+    set_signatures += Config_.PadBytes_;
+  }
+  if(Config_.DebugOn_)
+  {
+    //set pad bytes if any
+    if(Config_.PadBytes_)
+    {
+      unsigned temp_pads = Config_.PadBytes_;
+      while(temp_pads--)
+      {
+        *set_signatures = PAD_PATTERN;
+        ++set_signatures;
+      }
+    }
+  }
+   
+  //set each blocks signatures excluding
+  //the last block, it only Unallocated and pad signatures
+  //every block except for the last last
+  for(unsigned i = 0; i < Config_.ObjectsPerPage_; ++i)
+  {   
+    if(Config_.DebugOn_)
+    { 
+      //skip next pointer at beginning of block
+      set_signatures += sizeof(void*);
+      //last block only do unallocated and padding at the end
+       if(i == Config_.ObjectsPerPage_ - 1)
+       {  
+         unsigned temp_size = OAStats_.ObjectSize_ - sizeof(void*);
+         while(temp_size--)
+         {
+           *set_signatures = UNALLOCATED_PATTERN;
+           ++set_signatures;
+         }
+         //set pad bytes if any
+         if(Config_.PadBytes_)
+         {
+           unsigned temp_pads = Config_.PadBytes_;
+           while(temp_pads--)
+           {
+             *set_signatures = PAD_PATTERN;
+             ++set_signatures;
+           }
+         }
+       }
+       else
+       {
+         unsigned temp_size = OAStats_.ObjectSize_ - sizeof(void*);
+         while(temp_size--)
+         {
+           *set_signatures = UNALLOCATED_PATTERN;
+           ++set_signatures;
+         }
+     
+         //set pad bytes if any
+         if(Config_.PadBytes_)
+         {
+           unsigned temp_pads = Config_.PadBytes_;
+           while(temp_pads--)
+           {
+             *set_signatures = PAD_PATTERN;
+             ++set_signatures;
+           }
+         }
+     
+        //set alignment if any
+        if(Config_.InterAlignSize_)
+        {
+          unsigned temp_align = Config_.InterAlignSize_;
+          while(temp_align--)
+          {
+            *set_signatures = ALIGN_PATTERN;
+            ++set_signatures;
+          }
+     
+        }
+        //set header blocks if any
+        if(Config_.HeaderBlocks_)
+        {
+          unsigned temp_header = Config_.HeaderBlocks_;
+          while(temp_header--)
+          {
+            *set_signatures = 0;
+            ++set_signatures;
+          }
+        }
+        //set pad bytes if any
+        if(Config_.PadBytes_)
+        {
+          unsigned temp_pads = Config_.PadBytes_;
+          while(temp_pads--)
+          {
+            *set_signatures = PAD_PATTERN;
+            ++set_signatures;
+          }
+        }
+     
+       }
+     }
+     else//just do headerblocks unless last block
+     {
+       //last block only do unallocated and padding at the end
+       if(i == Config_.ObjectsPerPage_ - 1)
+         break;
+
+       set_signatures += (OAStats_.ObjectSize_ + Config_.PadBytes_ + Config_.InterAlignSize_);
+       //set header blocks if any
+       if(Config_.HeaderBlocks_)
+       {
+         unsigned temp_header = Config_.HeaderBlocks_;
+         while(temp_header--)
+         {
+           *set_signatures = 0;
+           ++set_signatures;
+         }
+       }
+     }
+     
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+         Helper Function for Validate Pages.
+         Make sure a pad byte has not been overwitten on
+         a given block
+      
+      \param block
+        the block to check for corruption
+        
+      \return 
+        false = block corrupted
+        true = block valid
+      
+*/
+/******************************************************************************/ 
+bool ObjectAllocatorCore::ValidateBlock(unsigned char* block) const
+{
+  unsigned char* temp_block = block;
+   
+  //check padbytes to the left
+  for(unsigned i = 0; i < Config_.PadBytes_; ++i)
+  {
+    //go back to pad byte closest to block
+    --temp_block;
+    //if pad pattern not in pad bytes
+    //then block is corrupted
+    if(*temp_block != PAD_PATTERN)
+    {
+      return false;
+    }
+      
+  }
+   
+  //check pad bytes on the right
+  temp_block = block;
+  temp_block += OAStats_.ObjectSize_;
+   
+   
+  for(unsigned i = 0; i < Config_.PadBytes_; ++i)
+  {
+    //++temp_block;
+    //if pad pattern not in pad bytes
+    //then block is corrupted
+    if(*temp_block++ != PAD_PATTERN)
+    {
+      return false;
+    }
+      
+  }
+   
+   //no errors block validated
+   return true;
+   
+} 
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the OALiveSet class, the table is allocated
+        on the first Insert
+      
+*/
+/******************************************************************************/
+OALiveSet::OALiveSet(void) : slots_(NULL), capacity_(0), size_(0), used_(0)
+{
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Destructor for the OALiveSet class, only frees the table
+      
+*/
+/******************************************************************************/
+OALiveSet::~OALiveSet(void)
+{
+  delete [] slots_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Adds an object to the set, growing the table past 3/4 full
+        (live objects and tombstones)
+      
+      \param Object
+        the object to add, must not already be in the set
+        
+      \return 
+        false if the table could not grow
+      
+*/
+/******************************************************************************/
+bool OALiveSet::Insert(const void* Object)
+{
+  if((used_ + 1) * 4 > capacity_ * 3)
+  {
+    //mostly tombstones: rebuild at the same size, else double
+    unsigned capacity = capacity_ ? capacity_ : 16;
+    if((size_ + 1) * 2 > capacity)
+      capacity *= 2;
+    if(!Rehash(capacity))
+      return false;
+  }
+
+  unsigned mask = capacity_ - 1;
+  unsigned i = Hash(Object) & mask;
+  //reuse the first tombstone or empty slot
+  while(slots_[i] && slots_[i] != Tombstone())
+    i = (i + 1) & mask;
+
+  if(!slots_[i])
+    ++used_;
+  slots_[i] = Object;
+  ++size_;
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Removes an object from the set, leaving a tombstone so later
+        probes keep going
+      
+      \param Object
+        the object to remove
+        
+      \return 
+        false if Object was not in the set
+      
+*/
+/******************************************************************************/
+bool OALiveSet::Remove(const void* Object)
+{
+  unsigned i = Find(Object);
+  if(i == capacity_)
+    return false;
+
+  slots_[i] = Tombstone();
+  --size_;
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the number of objects in the set
+      
+*/
+/******************************************************************************/
+unsigned OALiveSet::Size(void) const
+{
+  return size_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the number of slots in the table
+      
+*/
+/******************************************************************************/
+unsigned OALiveSet::Capacity(void) const
+{
+  return capacity_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the object in a slot of the table
+      
+      \param i
+        the slot, less than Capacity()
+        
+      \return 
+        the object or NULL if the slot is empty/removed
+      
+*/
+/******************************************************************************/
+const void* OALiveSet::Slot(unsigned i) const
+{
+  return slots_[i] == Tombstone() ? NULL : slots_[i];
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Moves every live object into a new table, dropping tombstones
+      
+      \param capacity
+        size of the new table, a power of 2
+        
+      \return 
+        false if the table could not be allocated
+      
+*/
+/******************************************************************************/
+bool OALiveSet::Rehash(unsigned capacity)
+{
+  const void** slots = new (std::nothrow) const void*[capacity];
+  if(!slots)
+    return false;
+  for(unsigned i = 0; i < capacity; ++i)
+    slots[i] = NULL;
+
+  unsigned mask = capacity - 1;
+  for(unsigned i = 0; i < capacity_; ++i)
+  {
+    if(!slots_[i] || slots_[i] == Tombstone())
+      continue;
+    unsigned j = Hash(slots_[i]) & mask;
+    while(slots[j])
+      j = (j + 1) & mask;
+    slots[j] = slots_[i];
+  }
+
+  delete [] slots_;
+  slots_ = slots;
+  capacity_ = capacity;
+  used_ = size_;
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Probes for an object
+      
+      \param Object
+        the object to look for
+        
+      \return 
+        its slot, or Capacity() if it is not in the set
+      
+*/
+/******************************************************************************/
+unsigned OALiveSet::Find(const void* Object) const
+{
+  if(!capacity_)
+    return capacity_;
+
+  unsigned mask = capacity_ - 1;
+  unsigned i = Hash(Object) & mask;
+  while(slots_[i])
+  {
+    if(slots_[i] == Object)
+      return i;
+    i = (i + 1) & mask;
+  }
+  return capacity_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Hashes an address, the low bits are always 0 for new'd memory
+        so they are shifted out before mixing
+      
+*/
+/******************************************************************************/
+unsigned OALiveSet::Hash(const void* Object)
+{
+  std::size_t h = reinterpret_cast<std::size_t>(Object) >> 4;
+  h *= 2654435761u;
+  return static_cast<unsigned>(h ^ (h >> 16));
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Marker for removed slots, an address no client object can have
+      
+*/
+/******************************************************************************/
+const void* OALiveSet::Tombstone(void)
+{
+  static const char tombstone = 0;
+  return &tombstone;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the OAMemoryBudget class
+      
+      \param Bytes
+        the most bytes of pages handed out at once
+      
+      \param Source
+        where the pages come from, NULL for new/delete
+      
+*/
+/******************************************************************************/
+OAMemoryBudget::OAMemoryBudget(unsigned long Bytes, OAPageSource* Source)
+  : limit_(Bytes), used_(0), source_(Source)
+{
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Charges a page to the budget and gets its memory
+      
+      \param PageSize
+        bytes for the page
+      
+      \return
+        the page, NULL if out of memory
+      
+*/
+/******************************************************************************/
+char* OAMemoryBudget::AllocatePage(unsigned PageSize)
+{
+  unsigned long used = used_.load(std::memory_order_relaxed);
+  do
+  {
+    if(used + PageSize > limit_.load(std::memory_order_relaxed))
+      throw OAException(OAException::E_NO_PAGES, 
+                        "AllocatePage: The shared memory budget is used up.");
+  } while(!used_.compare_exchange_weak(used, used + PageSize, std::memory_order_relaxed));
+  
+  char* page;
+  if(source_)
+  {
+    try
+    {
+      page = source_->AllocatePage(PageSize);
+    }
+    catch(...)
+    {
+      used_.fetch_sub(PageSize, std::memory_order_relaxed);
+      throw;
+    }
+  }
+  else
+    page = new (std::nothrow) char[PageSize];
+  
+  if(!page)
+    used_.fetch_sub(PageSize, std::memory_order_relaxed);
+  return page;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Gives a page back and its bytes back to the budget
+      
+      \param Page
+        from AllocatePage
+      
+      \param PageSize
+        bytes it was allocated with
+      
+*/
+/******************************************************************************/
+void OAMemoryBudget::FreePage(char* Page, unsigned PageSize)
+{
+  if(source_)
+    source_->FreePage(Page, PageSize);
+  else
+    delete [] Page;
+  used_.fetch_sub(PageSize, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Changes the budget, pages already handed out stay (Used may be
+        over the new limit until they come back)
+      
+      \param Bytes
+        the new limit
+      
+*/
+/******************************************************************************/
+void OAMemoryBudget::SetLimit(unsigned long Bytes)
+{
+  limit_.store(Bytes, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the most bytes of pages handed out at once
+      
+*/
+/******************************************************************************/
+unsigned long OAMemoryBudget::Limit(void) const
+{
+  return limit_.load(std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the bytes of pages handed out right now
+      
+*/
+/******************************************************************************/
+unsigned long OAMemoryBudget::Used(void) const
+{
+  return used_.load(std::memory_order_relaxed);
+}
+
+namespace
+{
+    // set while this thread runs handlers, so a handler running out of
+    // memory doesn't start another round (or deadlock on the list)
+  thread_local bool running_handlers = false;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the OAReclaimHandlers class, starts out empty
+      
+*/
+/******************************************************************************/
+OAReclaimHandlers::OAReclaimHandlers(void)
+{
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Registers a handler
+      
+      \param fn
+        the handler
+      
+      \param Context
+        passed to fn
+      
+*/
+/******************************************************************************/
+void OAReclaimHandlers::Add(RECLAIMCALLBACK fn, void* Context)
+{
+  Handler handler = { fn, Context };
+  std::lock_guard<std::mutex> lock(lock_);
+  handlers_.push_back(handler);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Unregisters a handler added with the same fn and Context
+      
+      \param fn
+        the handler
+      
+      \param Context
+        its context
+      
+*/
+/******************************************************************************/
+void OAReclaimHandlers::Remove(RECLAIMCALLBACK fn, void* Context)
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  for(unsigned i = 0; i < handlers_.size(); ++i)
+    if(handlers_[i].fn == fn && handlers_[i].context == Context)
+    {
+      handlers_.erase(handlers_.begin() + i);
+      return;
+    }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Calls every handler, without holding the list's lock so they
+        may allocate and free themselves
+      
+      \return
+        true if any handler freed something
+      
+*/
+/******************************************************************************/
+bool OAReclaimHandlers::Run(void)
+{
+  if(running_handlers)
+    return false;
+  
+  std::vector<Handler> handlers;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    handlers = handlers_;
+  }
+  
+  running_handlers = true;
+  bool freed = false;
+  try
+  {
+    for(unsigned i = 0; i < handlers.size(); ++i)
+      if(handlers[i].fn(handlers[i].context))
+        freed = true;
+  }
+  catch(...)
+  {
+    running_handlers = false;
+    throw;
+  }
+  running_handlers = false;
+  return freed;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates Count adjacent blocks of one page, growing a page if no
+        page has that many free in a row. Out of pages or memory, the
+        reclaim handlers get to free some first (once). By-passed, it is
+        one new'd array (one live object).
+      
+      \param Count
+        how many blocks
+      
+      \return
+        the first block of the run
+      
+*/
+/******************************************************************************/
+void* ObjectAllocatorCore::AllocateRun(unsigned Count) OA_THROW(OAException)
+{
+  if(!Count || Count > Config_.ObjectsPerPage_)
+    throw OAException(OAException::E_BAD_RUN, 
+                      "AllocateContiguous: A run must fit on one page.");
+  
+  if(Config_.UseCPPMemManager_)
+  {
+    char* array;
+    for(bool reclaimed = false;; reclaimed = true)
+    {
+      try
+      {
+        array = new (std::nothrow) char[Count * OAStats_.ObjectSize_];
+        if(!array || (track_live_ && !live_objects_.Insert(array)))
+        {
+          delete [] array;
+          throw OAException(OAException::E_NO_MEMORY, "AllocateContiguous: No system memory available.");
+        }
+        break;
+      }
+      catch(const OAException& e)
+      {
+        if(reclaimed || !Reclaim(e))
+          throw;
+      }
+    }
+    if(Config_.Constructor_)
+      for(unsigned i = 0; i < Count; ++i)
+        Config_.Constructor_(array + i * OAStats_.ObjectSize_);
+    
+    OAStats_.ObjectsInUse_ += Count;
+    OAStats_.Allocations_ += Count;
+    if(OAStats_.MostObjects_ < OAStats_.ObjectsInUse_)
+      OAStats_.MostObjects_ = OAStats_.ObjectsInUse_;
+    return array;
+  }
+  
+  if(ring_)
+    throw OAException(OAException::E_BAD_RUN, 
+                      "AllocateContiguous: The FIFO ring has no free list to take runs from.");
+  if(ordered_)
+    throw OAException(OAException::E_BAD_RUN, 
+                      "AllocateContiguous: Address ordered mode has no free list to take runs from.");
+  
+  //pads, headers and alignment sit between the blocks of a run
+  if(chunk_size_)
+    throw OAException(OAException::E_BAD_RUN, 
+                      "AllocateContiguous: Blocks aren't back to back (pad bytes, headers or alignment).");
+  
+  //GrowPages would be happy with any free block, a run needs them in a
+  //row: a new page is one free run, else the handlers get one go
+  for(bool reclaimed = false;; reclaimed = true)
+  {
+    char* run;
+    try
+    {
+      run = FindFreeRun(Count);
+    }
+    catch(const std::bad_alloc&)
+    {
+      throw OAException(OAException::E_NO_MEMORY, "AllocateContiguous: No system memory available.");
+    }
+    
+    if(run)
+    {
+      TakeRun(run, Count);
+      return run;
+    }
+    
+    try
+    {
+      if(Config_.MaxPages_ && OAStats_.PagesInUse_ == Config_.MaxPages_)
+        throw OAException(OAException::E_NO_PAGES, 
+                          "AllocateContiguous: The maximum number of pages has been allocated.");
+      AllocatePage();
+    }
+    catch(const OAException& e)
+    {
+      if(reclaimed || !Reclaim(e))
+        throw;
+    }
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees a run, block by block as Free does
+      
+      \param Objects
+        the first block of the run
+      
+      \param Count
+        how many blocks
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::FreeRun(void* Objects, unsigned Count) OA_THROW(OAException)
+{
+  if(!Count || Count > Config_.ObjectsPerPage_)
+    throw OAException(OAException::E_BAD_RUN, 
+                      "FreeContiguous: A run must fit on one page.");
+  
+  if(Config_.UseCPPMemManager_)
+  {
+    if(track_live_ && !live_objects_.Remove(Objects))
+      throw OAException(OAException::E_MULTIPLE_FREE,
+                        "FreeContiguous: Object has already been freed.");
+    
+    char* array = reinterpret_cast<char*>(Objects);
+    if(Config_.Destructor_)
+      for(unsigned i = 0; i < Count; ++i)
+        Config_.Destructor_(array + i * OAStats_.ObjectSize_);
+    delete [] array;
+    
+    OAStats_.Deallocations_ += Count;
+    OAStats_.ObjectsInUse_ -= Count;
+    return;
+  }
+  
+  char* block = reinterpret_cast<char*>(Objects);
+  for(unsigned i = 0; i < Count; ++i, block += block_size_)
+    FreeSlow(block);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Looks for Count free blocks in a row on one page: marks every
+        block of the free list in a bitmap per page, then scans each
+        page's bitmap for a long enough run of set bits
+      
+      \param Count
+        how many blocks
+      
+      \return
+        the first block of the run, NULL if no page has one
+      
+*/
+/******************************************************************************/
+char* ObjectAllocatorCore::FindFreeRun(unsigned Count) const
+{
+  if(OAStats_.FreeObjects_ < Count)
+    return NULL;
+  
+  //pages sorted by address, to find the page of a block
+  std::vector<char*> pages;
+  for(GenericObject* page = page_list_; page; page = page->Next)
+    pages.push_back(reinterpret_cast<char*>(page));
+  std::sort(pages.begin(), pages.end());
+  
+  unsigned words = (Config_.ObjectsPerPage_ + 63) / 64;
+  std::vector<unsigned long long> bits(pages.size() * words, 0);
+  for(GenericObject* block = free_list_; block; block = NextOf(block))
+  {
+    char* address = reinterpret_cast<char*>(block);
+    unsigned page = PageIndex(pages, address);
+    unsigned index = static_cast<unsigned>((address - pages[page] - first_block_) / block_size_);
+    bits[page * words + index / 64] |= 1ULL << (index % 64);
+  }
+  
+  for(unsigned page = 0; page < pages.size(); ++page)
+  {
+    unsigned start = FindRun(&bits[page * words], Config_.ObjectsPerPage_, Count);
+    if(start < Config_.ObjectsPerPage_)
+      return pages[page] + first_block_ + start * block_size_;
+  }
+  return NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes the blocks of a run off the free list and hands them out
+        like Allocate does
+      
+      \param Run
+        the first block
+      
+      \param Count
+        how many blocks
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::TakeRun(char* Run, unsigned Count)
+{
+  char* end = Run + Count * block_size_;
+  GenericObject** link = &free_list_;
+  while(*link)
+  {
+    char* block = reinterpret_cast<char*>(*link);
+    if(block >= Run && block < end)
+      *link = NextOf(*link);
+    else
+      link = &NextOf(*link);
+  }
+  
+  if(Config_.DebugOn_)
+    for(char* block = Run; block < end; block += block_size_)
+      SetAllocatedSignature(reinterpret_cast<GenericObject*>(block));
+  
+  OAStats_.FreeObjects_ -= Count;
+  OAStats_.ObjectsInUse_ += Count;
+  OAStats_.Allocations_ += Count;
+  if(OAStats_.MostObjects_ < OAStats_.ObjectsInUse_)
+    OAStats_.MostObjects_ = OAStats_.ObjectsInUse_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        FIFO ring mode Allocate: the next block of the head page. Out of
+        blocks, a new page goes in after the head page.
+      
+      \return
+        the block
+      
+*/
+/******************************************************************************/
+GenericObject* ObjectAllocatorCore::RingAllocate()
+{
+  //RingInsert makes the new page the head (unless a reclaim handler
+  //emptied a page instead, then RingAdvance moved the head there)
+  if(!RingAdvance())
+    GrowPages();
+  
+  OARing& ring = *ring_;
+  OARingPage* page = ring.Pages[ring.Head];
+  unsigned slot = ring.Slot++;
+  page->Bits[slot / 64] |= 1ULL << (slot % 64);
+  ++page->Live;
+  return reinterpret_cast<GenericObject*>(page->First + slot * block_size_);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Makes sure the head page has a block left: a used up head page
+        moves the head on to the first empty page after it (wrapping
+        round), which is moved up behind the old head so the ring stays
+        in allocation order
+      
+      \return
+        false if no page of the ring has a block to hand out (blocks
+        freed out of order don't count until their whole page is free)
+      
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::RingAdvance()
+{
+  OARing& ring = *ring_;
+  if(ring.Pages.empty())
+    return false;
+  if(ring.Slot < Config_.ObjectsPerPage_)
+    return true;
+  
+  unsigned count = static_cast<unsigned>(ring.Pages.size());
+  for(unsigned step = 1; step < count; ++step)
+  {
+    unsigned at = (ring.Head + step) % count;
+    OARingPage* page = ring.Pages[at];
+    if(page->Live)
+      continue;
+    
+    if(step > 1)
+    {
+      //erase then insert never grows the vector, so can't throw
+      ring.Pages.erase(ring.Pages.begin() + at);
+      if(at < ring.Head)
+        --ring.Head;
+      ring.Pages.insert(ring.Pages.begin() + ring.Head + 1, page);
+    }
+    ring.Head = (ring.Head + 1) % count;
+    ring.Slot = 0;
+    return true;
+  }
+  return false;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        FIFO ring mode Free: clears the block's live bit, checking it is
+        a live block of one of the pages first
+      
+      \param block
+        the block being freed
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::RingFree(GenericObject* block)
+{
+  const char* address = reinterpret_cast<const char*>(block);
+  OARingPage* page = FindPage(ring_->ByAddress, address);
+  if(!page || address < page->First || 
+     address >= page->First + Config_.ObjectsPerPage_ * block_size_)
+    throw OAException(OAException::E_BAD_ADDRESS, "FreeObject: Object not on a page.");
+  
+  unsigned offset = static_cast<unsigned>(address - page->First);
+  if(offset % block_size_)
+    throw OAException(OAException::E_BAD_BOUNDARY, "FreeObject: Object on bad boundary.");
+  
+  unsigned slot = offset / block_size_;
+  unsigned long long bit = 1ULL << (slot % 64);
+  if(!(page->Bits[slot / 64] & bit))
+    throw OAException(OAException::E_MULTIPLE_FREE, "FreeObject: Object has already been freed.");
+  
+  page->Bits[slot / 64] &= ~bit;
+  
+  //everything on the head page came back: start it over
+  if(!--page->Live && page == ring_->Pages[ring_->Head])
+    ring_->Slot = 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Adds a new page to the ring right after the head page and makes
+        it the head, so the ring stays in allocation order
+      
+      \param Page
+        the new page
+      
+      \return
+        false if out of memory
+      
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::RingInsert(char* Page)
+{
+  OARing& ring = *ring_;
+  OARingPage* entry = new (std::nothrow) OARingPage;
+  if(!entry)
+    return false;
+  
+  try
+  {
+    entry->Page = Page;
+    entry->First = Page + first_block_;
+    entry->Live = 0;
+    entry->Bits.assign((Config_.ObjectsPerPage_ + 63) / 64, 0);
+    
+    unsigned position = ring.Pages.empty() ? 0 : ring.Head + 1;
+    ring.ByAddress.reserve(ring.ByAddress.size() + 1);
+    ring.Pages.insert(ring.Pages.begin() + position, entry);
+    
+    std::vector<OARingPage*>::iterator at = ring.ByAddress.begin();
+    while(at != ring.ByAddress.end() && (*at)->Page < Page)
+      ++at;
+    ring.ByAddress.insert(at, entry);   // can't throw, reserved
+    
+    ring.Head = position;
+    ring.Slot = 0;
+  }
+  catch(const std::bad_alloc&)
+  {
+    delete entry;
+    return false;
+  }
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Takes a page (empty, not the head) out of the ring
+      
+      \param Page
+        the page
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::RingRemove(const char* Page)
+{
+  OARing& ring = *ring_;
+  for(unsigned i = 0; i < ring.ByAddress.size(); ++i)
+    if(ring.ByAddress[i]->Page == Page)
+    {
+      ring.ByAddress.erase(ring.ByAddress.begin() + i);
+      break;
+    }
+  for(unsigned i = 0; i < ring.Pages.size(); ++i)
+    if(ring.Pages[i]->Page == Page)
+    {
+      if(i < ring.Head)
+        --ring.Head;
+      delete ring.Pages[i];
+      ring.Pages.erase(ring.Pages.begin() + i);
+      break;
+    }
+}
 
-     temp_free++;
-   }
-   
+/******************************************************************************/
+/*!
+      \brief
+        Whether FreeEmptyPages may take a page out of the ring: none of
+        its blocks are live and it isn't the head page
+      
+      \param Page
+        the page
+      
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::RingPageEmpty(const char* Page) const
+{
+  const OARingPage* page = FindPage(ring_->ByAddress, Page);
+  return page && page->Page == Page && !page->Live && page != ring_->Pages[ring_->Head];
 }
+
 /******************************************************************************/
 /*!
       \brief
-        Sets all Debug Signatures for an initial page and Header Blocks
-        regardless of debug or not
+        Address ordered mode Allocate: the lowest free block of the
+        lowest page with one, a find first set on the page bits and then
+        on the page's block bits. Out of free blocks, a new page.
       
-      \param set_signatures
-        the beginnig of where to put signatures
+      \return
+        the block
       
 */
-/******************************************************************************/ 
-void ObjectAllocator::SetSignatures(char * set_signatures)
+/******************************************************************************/
+GenericObject* ObjectAllocatorCore::OrderedAllocate()
 {
-  //set initial signatures
-  //get past page list next pointer
-  set_signatures += sizeof(void*);
-  
-  //set alignment if any
-  if(Config_.DebugOn_)
+  OAOrdered& ordered = *ordered_;
+  for(;;)
   {
-    if(Config_.LeftAlignSize_)
-    {
-      unsigned temp_align = Config_.Alignment_;
-      while(temp_align--)
-      {
-        *set_signatures = ALIGN_PATTERN;
-        ++set_signatures;
-      }
-     
-    }
-    //set header blocks if any
-    if(Config_.HeaderBlocks_)
+    for(unsigned word = 0; word < ordered.HasFree.size(); ++word)
     {
-      unsigned temp_header = Config_.HeaderBlocks_;
-      while(temp_header--)
-      {
-        *set_signatures = 00;
-        ++set_signatures;
-      }
+      if(!ordered.HasFree[word])
+        continue;
+      
+      unsigned index = word * 64 + LowestBit(ordered.HasFree[word]);
+      OAOrderedPage* page = ordered.ByAddress[index];
+      unsigned slot = NextBit(&page->Bits[0], 0, Config_.ObjectsPerPage_, true);
+      page->Bits[slot / 64] &= ~(1ULL << (slot % 64));
+      if(!--page->Free)
+        ordered.HasFree[word] &= ~(1ULL << (index % 64));
+      return reinterpret_cast<GenericObject*>(page->First + slot * block_size_);
     }
+    
+    //OrderedInsert adds the new page's blocks (unless a reclaim
+    //handler freed blocks instead, then look again)
+    GrowPages();
   }
-  else
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Address ordered mode Free: sets the block's free bit, checking it
+        is a live block of one of the pages first
+      
+      \param block
+        the block being freed
+      
+*/
+/******************************************************************************/
+void ObjectAllocatorCore::OrderedFree(GenericObject* block)
+{
+  const char* address = reinterpret_cast<const char*>(block);
+  OAOrderedPage* page = FindPage(ordered_->ByAddress, address);
+  if(!page || address < page->First || 
+     address >= page->First + Config_.ObjectsPerPage_ * block_size_)
+    throw OAException(OAException::E_BAD_ADDRESS, "FreeObject: Object not on a page.");
+  
+  unsigned offset = static_cast<unsigned>(address - page->First);
+  if(offset % block_size_)
+    throw OAException(OAException::E_BAD_BOUNDARY, "FreeObject: Object on bad boundary.");
+  
+  unsigned slot = offset / block_size_;
+  unsigned long long bit = 1ULL << (slot % 64);
+  if(page->Bits[slot / 64] & bit)
+    throw OAException(OAException::E_MULTIPLE_FREE, "FreeObject: Object has already been freed.");
+  
+  page->Bits[slot / 64] |= bit;
+  if(!page->Free++)
   {
-    set_signatures += Config_.LeftAlignSize_;
-    //set header blocks if any
-    if(Config_.HeaderBlocks_)
-    {
-      unsigned temp_header = Config_.HeaderBlocks_;
-      while(temp_header--)
-      {
-        *set_signatures = 00;
-        ++set_signatures;
-      }
-    }
+    unsigned index = static_cast<unsigned>(std::lower_bound(ordered_->ByAddress.begin(),
+                                                            ordered_->ByAddress.end(), page, PageBefore) -
+                                           ordered_->ByAddress.begin());
+    ordered_->HasFree[index / 64] |= 1ULL << (index % 64);
   }
-  if(Config_.DebugOn_)
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Adds a new page, all of its blocks free, at its place by address
+      
+      \param Page
+        the new page
+      
+      \return
+        false if out of memory
+      
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::OrderedInsert(char* Page)
+{
+  OAOrdered& ordered = *ordered_;
+  unsigned index = 0;
+  OAOrderedPage* entry = new (std::nothrow) OAOrderedPage;
+  if(!entry)
+    return false;
+  
+  try
   {
-    //set pad bytes if any
-    if(Config_.PadBytes_)
-    {
-      unsigned temp_pads = Config_.PadBytes_;
-      while(temp_pads--)
-      {
-        *set_signatures = PAD_PATTERN;
-        ++set_signatures;
-      }
-    }
+    entry->Page = Page;
+    entry->First = Page + first_block_;
+    entry->Free = Config_.ObjectsPerPage_;
+    entry->Bits.assign((Config_.ObjectsPerPage_ + 63) / 64, ~0ULL);
+    if(Config_.ObjectsPerPage_ % 64)
+      entry->Bits.back() = (1ULL << (Config_.ObjectsPerPage_ % 64)) - 1;
+    
+    ordered.HasFree.reserve((ordered.ByAddress.size() + 1 + 63) / 64);
+    std::vector<OAOrderedPage*>::iterator at = 
+      std::lower_bound(ordered.ByAddress.begin(), ordered.ByAddress.end(), entry, PageBefore);
+    index = static_cast<unsigned>(at - ordered.ByAddress.begin());
+    ordered.ByAddress.insert(at, entry);
   }
-   
-  //set each blocks signatures excluding
-  //the last block, it only Unallocated and pad signatures
-  //every block except for the last last
-  for(unsigned i = 0; i < Config_.ObjectsPerPage_; ++i)
-  {   
-    if(Config_.DebugOn_)
-    { 
-      //skip next pointer at beginning of block
-      set_signatures += sizeof(void*);
-      //last block only do unallocated and padding at the end
-       if(i == Config_.ObjectsPerPage_ - 1)
-       {  
-         unsigned temp_size = OAStats_.ObjectSize_ - sizeof(void*);
-         while(temp_size--)
-         {
-           *set_signatures = UNALLOCATED_PATTERN;
-           ++set_signatures;
-         }
-         //set pad bytes if any
-         if(Config_.PadBytes_)
-         {
-           unsigned temp_pads = Config_.PadBytes_;
-           while(temp_pads--)
-           {
-             *set_signatures = PAD_PATTERN;
-             ++set_signatures;
-           }
-         }
-       }
-       else
-       {
-         unsigned temp_size = OAStats_.ObjectSize_ - sizeof(void*);
-         while(temp_size--)
-         {
-           *set_signatures = UNALLOCATED_PATTERN;
-           ++set_signatures;
-         }
-     
-         //set pad bytes if any
-         if(Config_.PadBytes_)
-         {
-           unsigned temp_pads = Config_.PadBytes_;
-           while(temp_pads--)
-           {
-             *set_signatures = PAD_PATTERN;
-             ++set_signatures;
-           }
-         }
-     
-        //set alignment if any
-        if(Config_.InterAlignSize_)
-        {
-          unsigned temp_align = Config_.InterAlignSize_;
-          while(temp_align--)
-          {
-            *set_signatures = ALIGN_PATTERN;
-            ++set_signatures;
-          }
-     
-        }
-        //set header blocks if any
-        if(Config_.HeaderBlocks_)
-        {
-          unsigned temp_header = Config_.HeaderBlocks_;
-          while(temp_header--)
-          {
-            *set_signatures = 0;
-            ++set_signatures;
-          }
-        }
-        //set pad bytes if any
-        if(Config_.PadBytes_)
-        {
-          unsigned temp_pads = Config_.PadBytes_;
-          while(temp_pads--)
-          {
-            *set_signatures = PAD_PATTERN;
-            ++set_signatures;
-          }
-        }
-     
-       }
-     }
-     else//just do headerblocks unless last block
-     {
-       //last block only do unallocated and padding at the end
-       if(i == Config_.ObjectsPerPage_ - 1)
-         break;
-
-       set_signatures += (OAStats_.ObjectSize_ + Config_.InterAlignSize_ + Config_.PadBytes_);
-       //set header blocks if any
-       if(Config_.HeaderBlocks_)
-       {
-         unsigned temp_header = Config_.HeaderBlocks_;
-         while(temp_header--)
-         {
-           *set_signatures = 0;
-           ++set_signatures;
-         }
-       }
-     }
-     
+  catch(const std::bad_alloc&)
+  {
+    delete entry;
+    return false;
   }
+  InsertHasFree(ordered, index);   // can't throw, reserved
+  return true;
 }
 
 /******************************************************************************/
 /*!
       \brief
-         Helper Function for Validate Pages.
-         Make sure a pad byte has not been overwitten on
-         a given block
+        Takes an empty page's bits out
       
-      \param block
-        the block to check for corruption
-        
-      \return 
-        false = block corrupted
-        true = block valid
+      \param Page
+        the page
       
 */
-/******************************************************************************/ 
-bool ObjectAllocator::ValidateBlock(unsigned char* block) const
+/******************************************************************************/
+void ObjectAllocatorCore::OrderedRemove(const char* Page)
 {
-  unsigned char* temp_block = block;
-   
-  //check padbytes to the left
-  for(unsigned i = 0; i < Config_.PadBytes_; ++i)
-  {
-    //go back to pad byte closest to block
-    --temp_block;
-    //if pad pattern not in pad bytes
-    //then block is corrupted
-    if(*temp_block != PAD_PATTERN)
-    {
-      return false;
-    }
+  OAOrdered& ordered = *ordered_;
+  OAOrderedPage* page = FindPage(ordered.ByAddress, Page);
+  if(!page || page->Page != Page)
+    return;
+  
+  unsigned index = static_cast<unsigned>(std::lower_bound(ordered.ByAddress.begin(),
+                                                          ordered.ByAddress.end(), page, PageBefore) -
+                                         ordered.ByAddress.begin());
+  delete page;
+  ordered.ByAddress.erase(ordered.ByAddress.begin() + index);
+  RemoveHasFree(ordered, index);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Whether FreeEmptyPages may give a page back: all its blocks are free
       
-  }
-   
-  //check pad bytes on the right
-  temp_block = block;
-  temp_block += OAStats_.ObjectSize_;
-   
-   
-  for(unsigned i = 0; i < Config_.PadBytes_; ++i)
-  {
-    //++temp_block;
-    //if pad pattern not in pad bytes
-    //then block is corrupted
-    if(*temp_block++ != PAD_PATTERN)
-    {
-      return false;
-    }
+      \param Page
+        the page
       
-  }
-   
-   //no errors block validated
-   return true;
-   
-} 
\ No newline at end of file
+*/
+/******************************************************************************/
+bool ObjectAllocatorCore::OrderedPageEmpty(const char* Page) const
+{
+  const OAOrderedPage* page = FindPage(ordered_->ByAddress, Page);
+  return page && page->Page == Page && page->Free == Config_.ObjectsPerPage_;
+}
@@ -15,10 +15,16 @@
     - Constructor          
     - Allocate
     - Free
-    - ImplementedExtraCredit *NOT IMPLEMENTED*
+    - ImplementedExtraCredit
     - DumpMemoryInUse
+    - AllocateFor
+    - SetTenantQuota
+    - GetTenantStats
+    - AllocateContiguous
+    - FreeContiguous
     - ValidatePages
-    - FreeEmptyPages *NOT IMPLEMENTED*
+    - FreeEmptyPages
+    - FreeEmptyPage
     - SetDebugState
     - GetFreeList
     - GetPageList
@@ -29,6 +35,11 @@
     - ValidateObject
     - ValidateBlock
     - SetSignatures
+
+    BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>
+    picks the debug, header block, new/delete and locking behavior at
+    compile time; ObjectAllocator is the runtime configured version of it
+    (every policy reads OAConfig).
        
 
   Hours spent on this assignment: 14
@@ -46,7 +57,20 @@
 #pragma warning( disable : 4290 ) // suppress warning: C++ Exception Specification ignored
 #endif
 
+// Dynamic exception specifications are gone in C++17 (throw() in C++20),
+// keep them as documentation for the older standards only
+#if __cplusplus >= 201703L
+#define OA_THROW(x)
+#define OA_NOTHROW noexcept
+#else
+#define OA_THROW(x) throw(x)
+#define OA_NOTHROW throw()
+#endif
+
 #include <string>
+#include <mutex>
+#include <atomic>
+#include <vector>
 
 // If the client doesn't specify these:
 static const int DEFAULT_OBJECTS_PER_PAGE = 4;  
@@ -63,7 +87,11 @@ class OAException
       E_BAD_ADDRESS,    // block address is not on a page
       E_BAD_BOUNDARY,   // block address is on a page, but not on any block-boundary
       E_MULTIPLE_FREE,  // block has already been freed
-      E_CORRUPTED_BLOCK // block has been corrupted (pad bytes have been overwritten)
+      E_CORRUPTED_BLOCK,// block has been corrupted (pad bytes have been overwritten)
+      E_BAD_SEGMENT,    // shared or mapped segment isn't one of ours or has another layout
+      E_QUOTA_EXCEEDED, // the tenant has as many objects in use as its quota allows
+      E_BAD_RUN,        // contiguous run longer than a page, or blocks aren't back to back
+      E_BAD_CONFIG      // the config asks for something this allocator can't do
     };
 
     OAException(OA_EXCEPTION ErrCode, const std::string& Message) : error_code_(ErrCode), message_(Message) {};
@@ -83,6 +111,91 @@ class OAException
     std::string message_;
 };
 
+// Where an allocator gets the memory for its pages (default: new/delete)
+class OAPageSource
+{
+  public:
+    virtual ~OAPageSource() {}
+
+      // Returns PageSize bytes for a new page, NULL if out of memory.
+      // May throw OAException (E_NO_PAGES for a page budget).
+    virtual char *AllocatePage(unsigned PageSize) = 0;
+
+      // Gives back a page returned by AllocatePage
+    virtual void FreePage(char *Page, unsigned PageSize) = 0;
+};
+
+// Page source with a byte budget shared by every allocator that uses
+// it, so one pool can grow while another gives pages back with
+// FreeEmptyPages. The memory comes from Source (new/delete if NULL).
+// Safe to share between threads.
+class OAMemoryBudget : public OAPageSource
+{
+  public:
+    explicit OAMemoryBudget(unsigned long Bytes, OAPageSource *Source = NULL);
+
+      // Throws E_NO_PAGES if the page doesn't fit in the budget
+    char *AllocatePage(unsigned PageSize);
+    void FreePage(char *Page, unsigned PageSize);
+
+    void SetLimit(unsigned long Bytes);   // lowering it frees nothing
+    unsigned long Limit(void) const;
+    unsigned long Used(void) const;       // bytes in pages handed out
+
+  private:
+    std::atomic<unsigned long> limit_;
+    std::atomic<unsigned long> used_;
+    OAPageSource *source_;
+
+      // Make private to prevent copy construction and assignment
+    OAMemoryBudget(const OAMemoryBudget &budget);
+    OAMemoryBudget &operator=(const OAMemoryBudget &budget);
+};
+
+// Memory pressure callback: frees what it can (evicts a cache, calls
+// FreeEmptyPages on other pools...), returns true if it freed anything
+typedef bool (*RECLAIMCALLBACK)(void *Context);
+
+// Handlers an allocator runs before it throws E_NO_PAGES or E_NO_MEMORY.
+// If one of them frees something the allocation is tried once more, and
+// fails for good if that doesn't work either (a handler that keeps
+// saying it freed memory can't make it spin). One list can be
+// shared by many allocators (and threads). The allocator that ran out
+// still holds its lock while the handlers run, so they may only free
+// into it if it has none (NoLockPolicy). A handler that runs out of
+// memory itself gets no nested round of handlers.
+class OAReclaimHandlers
+{
+  public:
+    OAReclaimHandlers(void);
+
+    void Add(RECLAIMCALLBACK fn, void *Context);
+    void Remove(RECLAIMCALLBACK fn, void *Context);
+
+      // Calls every handler in the order added, true if any freed memory
+    bool Run(void);
+
+  private:
+    struct Handler
+    {
+      RECLAIMCALLBACK fn;
+      void *context;
+    };
+
+    std::mutex lock_;
+    std::vector<Handler> handlers_;
+
+      // Make private to prevent copy construction and assignment
+    OAReclaimHandlers(const OAReclaimHandlers &handlers);
+    OAReclaimHandlers &operator=(const OAReclaimHandlers &handlers);
+};
+
+struct OARing;
+struct OAOrdered;
+
+// Object caching callbacks (see OAConfig::Constructor_)
+typedef void (*OBJECTCALLBACK)(void *Object);
+
 // ObjectAllocator configuration parameters
 struct OAConfig
 {
@@ -102,6 +215,17 @@ struct OAConfig
   {
     LeftAlignSize_ = 0;
     InterAlignSize_ = 0;
+    PageSource_ = NULL;
+    ReclaimHandlers_ = NULL;
+    Ring_ = false;
+    AddressOrdered_ = false;
+    TenantTags_ = false;
+    TrackLiveObjects_ = true;
+    RetireBlocks_ = false;
+    Constructor_ = NULL;
+    Destructor_ = NULL;
+    ScratchOffset_ = 0;
+    ScratchSize_ = 0;
   }
 
   bool UseCPPMemManager_;   // by-pass the functionality of the OA and use new/delete
@@ -110,17 +234,78 @@ struct OAConfig
   bool DebugOn_;            // enable/disable debugging code (signatures, checks, etc.)
   unsigned PadBytes_;       // size of the left/right padding for each block
   unsigned HeaderBlocks_;   // size of the header for each block (0=no headers)
-  unsigned Alignment_;      // address alignment of each block
+  unsigned Alignment_;      // alignment of each object (from the start of its page)
 
   unsigned LeftAlignSize_;  // number of alignment bytes required to align first block
   unsigned InterAlignSize_; // number of alignment bytes required between remaining blocks
+
+  OAPageSource *PageSource_; // memory for the pages (NULL = new/delete)
+  OAReclaimHandlers *ReclaimHandlers_; // run when out of pages/memory (NULL = none)
+
+    // FIFO ring mode, for objects mostly freed in the order they were
+    // allocated: the pages form a ring and Allocate hands out the blocks
+    // of the head page in address order. When the head page is used up
+    // the head moves on to the next page of the ring every block of
+    // which has been freed (the tail has passed it), or else a new page
+    // is put in after the head page. Frees out of order just hold their
+    // page back; a bit per block catches double frees. There is no free
+    // list, so AllocateContiguous isn't available. Allocators that
+    // compile every feature out, and ConcurrentObjectAllocator, ignore it.
+  bool Ring_;
+
+    // Address ordered mode: Allocate always hands out the free block at
+    // the lowest address, found through a bit per block and a bit per
+    // page (has a free block), so live objects pack into the low pages,
+    // the high ones empty out for FreeEmptyPages, and the same sequence
+    // of calls gives the same layout on every run. A bit per block
+    // catches double frees. There is no free list, so
+    // AllocateContiguous isn't available. Ignored in FIFO ring mode, by
+    // allocators that compile every feature out, and by
+    // ConcurrentObjectAllocator.
+  bool AddressOrdered_;
+
+    // Tenant tags (see AllocateFor): the header byte in front of the in
+    // use flag records the tenant of each block, so HeaderBlocks_ must be
+    // 2 or more (E_BAD_CONFIG otherwise). Ignored when by-passing to
+    // new/delete.
+  bool TenantTags_;
+
+    // By-passing to new/delete, keep a hash set of the live objects so
+    // DumpMemoryInUse still reports leaks, the destructor deletes them
+    // and a double free throws E_MULTIPLE_FREE (on by default). Turned
+    // off, the by-pass is a plain new/delete for timing comparisons.
+  bool TrackLiveObjects_;
+
+    // ConcurrentObjectAllocator only: every block carries a hidden word
+    // after the object that RetireObject links it through. Off (the
+    // default), blocks are just the object and RetireObject throws
+    // E_BAD_CONFIG.
+  bool RetireBlocks_;
+
+    // Object caching: Constructor_ runs on every block of a new page and
+    // Destructor_ on every block of a page that is given back, so objects
+    // stay constructed from Free to the next Allocate. While an object is
+    // free the allocator only writes its scratch region, ScratchSize_
+    // bytes (at least a pointer) at ScratchOffset_: the free list link and,
+    // if debugging, the allocated/freed signatures. Without Constructor_
+    // the rest of the object gets the signatures too. Allocators that
+    // compile every feature out, and ConcurrentObjectAllocator, keep the
+    // link at offset 0: they throw E_BAD_CONFIG for a Constructor_ with
+    // any other ScratchOffset_. A region that isn't pointer aligned or
+    // runs past the end of the object is E_BAD_CONFIG too.
+  OBJECTCALLBACK Constructor_;
+  OBJECTCALLBACK Destructor_;
+  unsigned ScratchOffset_;  // pointer aligned
+  unsigned ScratchSize_;
 };
 
 // ObjectAllocator statistical info
 struct OAStats
 {
   OAStats(void) : ObjectSize_(0), FreeObjects_(0), ObjectsInUse_(0), PagesInUse_(0),
-                  PageSize_(0), MostObjects_(0), Allocations_(0), Deallocations_(0) {};
+                  PageSize_(0), MostObjects_(0), Allocations_(0), Deallocations_(0),
+                  RemoteFrees_(0), CachedObjects_(0), CacheDecays_(0),
+                  StolenPages_(0), NodeRemoteFrees_(0), RetiredObjects_(0) {};
 
   unsigned ObjectSize_;    // size of each object
   unsigned FreeObjects_;   // number of objects on the free list
@@ -130,6 +315,23 @@ struct OAStats
   unsigned MostObjects_;   // most objects in use by client at one time
   unsigned Allocations_;   // total requests to allocate memory
   unsigned Deallocations_; // total requests to free memory
+  unsigned RemoteFrees_;   // frees handed to another thread's heap (ConcurrentObjectAllocator)
+  unsigned CachedObjects_; // of FreeObjects_, those held in thread/CPU caches (CachingObjectAllocator)
+  unsigned CacheDecays_;   // objects sent back from a cache by decay or a flush
+  unsigned StolenPages_;   // empty pages a thread heap took from a peer (ConcurrentObjectAllocator)
+  unsigned NodeRemoteFrees_; // frees of blocks from a thread on another NUMA node
+  unsigned RetiredObjects_;  // of ObjectsInUse_, those retired but not yet reclaimed
+};
+
+// Per tenant accounting of an allocator with tenant tags
+struct OATenantStats
+{
+  OATenantStats(void) : ObjectsInUse_(0), MostObjects_(0), Quota_(0), Rejections_(0) {};
+
+  unsigned ObjectsInUse_;  // objects of the tenant in use by client
+  unsigned MostObjects_;   // most of them in use at one time
+  unsigned Quota_;         // most it may have in use (0=unlimited)
+  unsigned Rejections_;    // allocations refused with E_QUOTA_EXCEEDED
 };
 
 // This allows us to easily treat raw objects as nodes in a linked list
@@ -138,8 +340,44 @@ struct GenericObject
   GenericObject *Next;
 };
 
-// This memory manager class 
-class ObjectAllocator
+// Open addressing (linear probing) hash set of the objects handed out
+// while the allocator is by-passed, so new/delete mode can still dump
+// leaks and catch double frees (see OAConfig::TrackLiveObjects_).
+class OALiveSet
+{
+  public:
+    OALiveSet(void);
+    ~OALiveSet(void);
+
+    bool Insert(const void *Object);         // false if out of memory
+    bool Remove(const void *Object);         // false if Object is not live
+    unsigned Size(void) const;               // number of live objects
+
+      // Slot i of the table, NULL if it doesn't hold a live object
+    unsigned Capacity(void) const;
+    const void *Slot(unsigned i) const;
+
+  private:
+    const void **slots_;        // NULL = empty, Tombstone() = removed
+    unsigned capacity_;         // always a power of 2
+    unsigned size_;             // live objects
+    unsigned used_;             // live objects + tombstones
+
+      // Make private to prevent copy construction and assignment
+    OALiveSet(const OALiveSet &set);
+    OALiveSet &operator=(const OALiveSet &set);
+
+    bool Rehash(unsigned capacity);          // false if out of memory
+    unsigned Find(const void *Object) const; // slot of Object or capacity_
+    static unsigned Hash(const void *Object);
+    static const void *Tombstone(void);
+};
+
+// Page and free-list machinery shared by every BasicObjectAllocator.
+// Everything here is either cold (page growth, validation, dumping) or
+// independent of the configuration; the hot Allocate/Free paths live in
+// BasicObjectAllocator so that its policies can compile features out.
+class ObjectAllocatorCore
 {
   public:
     typedef void (*DUMPCALLBACK)(const void *, unsigned int);
@@ -152,41 +390,25 @@ class ObjectAllocator
     static const unsigned char PAD_PATTERN = 0xdd;
     static const unsigned char ALIGN_PATTERN = 0xee;
 
-      // Creates the ObjectManager per the specified values
-      // Throws an exception if the construction fails. (Memory allocation problem)
-    ObjectAllocator(unsigned ObjectSize, const OAConfig& config) throw(OAException);
-
-      // Destroys the ObjectManager (never throws)
-    ~ObjectAllocator() throw();
-
-      // Take an object from the free list and give it to the client (simulates new)
-      // Throws an exception if the object can't be allocated. (Memory allocation problem)
-    void *Allocate() throw(OAException);
-
-      // Returns an object to the free list for the client (simulates delete)
-      // Throws an exception if the the object can't be freed. (Invalid object)
-    void Free(void *Object) throw(OAException);
-
-      // Calls the callback fn for each block still in use
-    unsigned DumpMemoryInUse(DUMPCALLBACK fn) const;
-
-      // Calls the callback fn for each block that is potentially corrupted
-    unsigned ValidatePages(VALIDATECALLBACK fn) const;
-
-      // Frees all empty pages
-    unsigned FreeEmptyPages(void);
+      // Tenant tags are one byte, Allocate uses tenant 0
+    static const unsigned TENANTS = 256;
 
       // Returns true if FreeEmptyPages and alignments are implemented
     static bool ImplementedExtraCredit(void);
 
       // Testing/Debugging/Statistic methods
-    void SetDebugState(bool State);       // true=enable, false=disable
     const void *GetFreeList(void) const;  // returns a pointer to the internal free list
     const void *GetPageList(void) const;  // returns a pointer to the internal page list
     OAConfig GetConfig(void) const;       // returns the configuration parameters
-    OAStats GetStats(void) const;         // returns the statistics for the allocator
 
-  private:
+      // Size of each page for an object size and configuration
+    static unsigned PageSizeFor(unsigned ObjectSize, const OAConfig& config);
+
+  protected:
+      // Builds the first page unless the config by-passes the allocator
+    ObjectAllocatorCore(unsigned ObjectSize, const OAConfig& config) OA_THROW(OAException);
+    ~ObjectAllocatorCore() OA_NOTHROW;
+
     OAConfig Config_;            // configuration parameters
     OAStats OAStats_;            // accumulating statistics
     
@@ -196,19 +418,633 @@ class ObjectAllocator
     
     unsigned block_size_;       //size of each block
     unsigned chunk_size_;
+    unsigned first_block_;      //offset of the first block on a page
+    OALiveSet live_objects_;    //objects in use when by-passed (UseCPPMemManager_)
+    bool track_live_;           //by-passed with TrackLiveObjects_: keep live_objects_
+    
+    bool slow_path_;            //true if any feature needs AllocateSlow/FreeSlow
+    OATenantStats* tenants_;    //TENANTS counters, NULL without tenant tags
+    OARing* ring_;              //page ring in FIFO ring mode, NULL otherwise
+    OAOrdered* ordered_;        //page bitmaps in address ordered mode, NULL otherwise
+    
+      // Out of line halves of Allocate/Free: page growth, new/delete
+      // by-pass, debug signatures and checks, header blocks and errors
+    void* AllocateSlow() OA_THROW(OAException);
+    void FreeSlow(void* Object) OA_THROW(OAException);
+    void SetDebugFlag(bool State);
     
+    unsigned DumpBlocksInUse(DUMPCALLBACK fn) const;        //lock-free bodies of
+    unsigned ValidateAllPages(VALIDATECALLBACK fn) const;   //the public calls
+    unsigned ReleaseEmptyPages(void);
+    bool ReleaseEmptyPage(const void* Page);
+    
+    void* AllocateTenant(unsigned char Tenant) OA_THROW(OAException);
+    unsigned DumpTenantBlocks(DUMPCALLBACK fn, unsigned char Tenant) const;
+    void SetQuota(unsigned char Tenant, unsigned Objects);
+    OATenantStats TenantStats(unsigned char Tenant) const;
+    
+    void* AllocateRun(unsigned Count) OA_THROW(OAException);
+    void FreeRun(void* Objects, unsigned Count) OA_THROW(OAException);
+
+  private:
       // Make private to prevent copy construction and assignment
-    ObjectAllocator(const ObjectAllocator &oa);
-    ObjectAllocator &operator=(const ObjectAllocator &oa);
+    ObjectAllocatorCore(const ObjectAllocatorCore &oa);
+    ObjectAllocatorCore &operator=(const ObjectAllocatorCore &oa);
     
     void AllocatePage();   //allcoates/prepares a page for the client
     void DeAllocatePages();//frees all memory allocated
+    void ReleasePage(GenericObject* Page);//gives one page back
+    void UnlinkPage(GenericObject** PageLink);//takes an empty page out, then frees it
+    
+    void* AllocateCPP();   //new/delete by-pass for Allocate/Free
+    void FreeCPP(void* Object);
+    void* AllocateBlock(unsigned char Tenant);//AllocateSlow for a tenant
+    char* FindFreeRun(unsigned Count) const;  //Count free blocks in a row on a page
+    void TakeRun(char* Run, unsigned Count);  //off the free list, to the client
+    
+    GenericObject* RingAllocate();        //FIFO ring mode: bumps the head
+    bool RingAdvance();                   //head to an empty page if used up
+    void RingFree(GenericObject* block);  //clears the block's bit
+    bool RingInsert(char* Page);          //puts a new page after the head page
+    void RingRemove(const char* Page);    //takes an empty page out of the ring
+    bool RingPageEmpty(const char* Page) const;//no live blocks, not the head
+    
+    GenericObject* OrderedAllocate();       //address ordered mode: lowest free block
+    void OrderedFree(GenericObject* block); //sets the block's bit
+    bool OrderedInsert(char* Page);         //adds a new page's bits
+    void OrderedRemove(const char* Page);   //drops an empty page's bits
+    bool OrderedPageEmpty(const char* Page) const;//every block free
+    void GrowPages();      //allocates another page or throws E_NO_PAGES
+    bool Reclaim(const OAException& e);//runs the reclaim handlers, true: retry
+    
+    void SetAllocatedSignature(GenericObject* block);//debug signatures for
+    void SetFreedSignature(GenericObject* block);    //Allocate/Free
+    void SetHeaderFlag(GenericObject* block, unsigned char flag);//in use flag
+    void UpdateSlowPath(); //recompute slow_path_ after a config change
+    GenericObject*& NextOf(GenericObject* block) const;//free list link of a block
+    void ConstructPage(char* Page);     //object caching callbacks on
+    void DestructPage(GenericObject* Page);//every block of a page
     
     void ValidateObject(void* Object); //validate that the pointer given is valid
     bool ValidateBlock(unsigned char* block) const;  //validate a block to see if it is corrupted
     void SetSignatures(char * set_signatures);//set the initial signatures for each page
-    
+    unsigned char* HeaderFlag(const void* block) const;//in use byte of the header
+    unsigned char* TenantTag(const void* block) const; //tenant byte of the header
+};
+
+//---------------------------------------------------------------------------
+// Policies for BasicObjectAllocator. Each one answers, from the (already
+// normalized) configuration, whether its feature is active. The Off/On
+// variants answer with a constant so the compiler drops the dead branch;
+// the Runtime variants read the OAConfig like the original allocator did.
+// CanEnable is false only when the feature can never be on, which lets
+// Allocate/Free skip the slow_path_ test entirely.
+
+  // DebugOn_: signatures on Allocate/Free and validation of every Free
+struct DebugOffPolicy
+{
+  static const bool CanEnable = false;
+  static bool Enabled(const OAConfig&) { return false; }
+};
+
+struct DebugOnPolicy
+{
+  static const bool CanEnable = true;
+  static bool Enabled(const OAConfig&) { return true; }
+};
+
+struct RuntimeDebugPolicy
+{
+  static const bool CanEnable = true;
+  static bool Enabled(const OAConfig& config) { return config.DebugOn_; }
+};
+
+  // HeaderBlocks_: in use flag stored in front of each block
+struct HeadersOffPolicy
+{
+  static const bool CanEnable = false;
+  static bool Enabled(const OAConfig&) { return false; }
+  static unsigned Blocks(const OAConfig&) { return 0; }
+};
+
+struct HeadersOnPolicy
+{
+  static const bool CanEnable = true;
+  static bool Enabled(const OAConfig&) { return true; }
+  static unsigned Blocks(const OAConfig& config) 
+  { 
+    return config.HeaderBlocks_ ? config.HeaderBlocks_ : 1; 
+  }
+};
+
+struct RuntimeHeaderPolicy
+{
+  static const bool CanEnable = true;
+  static bool Enabled(const OAConfig& config) { return config.HeaderBlocks_ != 0; }
+  static unsigned Blocks(const OAConfig& config) { return config.HeaderBlocks_; }
+};
+
+  // UseCPPMemManager_: pages vs. straight new/delete
+struct PooledPagePolicy
+{
+  static const bool CanEnable = false;
+  static bool PassThrough(const OAConfig&) { return false; }
+};
+
+struct PassThroughPagePolicy
+{
+  static const bool CanEnable = true;
+  static bool PassThrough(const OAConfig&) { return true; }
+};
+
+struct RuntimePagePolicy
+{
+  static const bool CanEnable = true;
+  static bool PassThrough(const OAConfig& config) { return config.UseCPPMemManager_; }
+};
+
+  // Serializes the public calls of one allocator
+struct NoLockPolicy
+{
+  struct Guard
+  {
+    explicit Guard(NoLockPolicy&) {}
+  };
+};
 
+struct MutexLockPolicy
+{
+  class Guard
+  {
+    public:
+      explicit Guard(MutexLockPolicy& lock) : lock_(lock.Mutex_) {}
+    private:
+      std::lock_guard<std::mutex> lock_;
+  };
+
+  std::mutex Mutex_;
 };
 
+//---------------------------------------------------------------------------
+// Block allocator with its debug, header, page and locking behavior chosen
+// at compile time. Disabled features cost nothing in Allocate/Free.
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+class BasicObjectAllocator : public ObjectAllocatorCore
+{
+  public:
+      // Creates the ObjectManager per the specified values
+      // Throws an exception if the construction fails. (Memory allocation problem)
+    BasicObjectAllocator(unsigned ObjectSize, const OAConfig& config) OA_THROW(OAException);
+
+      // Take an object from the free list and give it to the client (simulates new)
+      // Throws an exception if the object can't be allocated. (Memory allocation problem)
+    void *Allocate() OA_THROW(OAException);
+
+      // Returns an object to the free list for the client (simulates delete)
+      // Throws an exception if the the object can't be freed. (Invalid object)
+    void Free(void *Object) OA_THROW(OAException);
+
+      // Calls the callback fn for each block still in use
+    unsigned DumpMemoryInUse(DUMPCALLBACK fn) const;
+
+      // Tenant tags: with TenantTags_ set, the header byte in front of
+      // the in use flag records the tenant a block was allocated for, and
+      // Free charges it back to that tenant. Throws E_QUOTA_EXCEEDED
+      // (before touching any page) if the tenant is at its quota, and
+      // E_BAD_CONFIG if the allocator has no tenant tags.
+    void *AllocateFor(unsigned char Tenant) OA_THROW(OAException);
+
+      // Most objects Tenant may have in use, 0 = unlimited. Lowering it
+      // below what is in use only refuses new allocations.
+    void SetTenantQuota(unsigned char Tenant, unsigned Objects);
+
+      // The tenant's counters (all 0 without tenant tags)
+    OATenantStats GetTenantStats(unsigned char Tenant) const;
+
+      // Calls the callback fn for each block of Tenant still in use
+    unsigned DumpMemoryInUse(DUMPCALLBACK fn, unsigned char Tenant) const;
+
+      // Count adjacent blocks of one page (an array of Count objects),
+      // for allocators whose blocks are back to back: no pad bytes,
+      // header blocks or alignment. Count can't exceed ObjectsPerPage_.
+      // Finds the run with a bitmap of the free list, so it costs a
+      // walk of the free list, much like FreeEmptyPages.
+    void *AllocateContiguous(unsigned Count) OA_THROW(OAException);
+
+      // Frees a run from AllocateContiguous, Count must match
+    void FreeContiguous(void *Objects, unsigned Count) OA_THROW(OAException);
+
+      // Calls the callback fn for each block that is potentially corrupted
+    unsigned ValidatePages(VALIDATECALLBACK fn) const;
+
+      // Frees all pages with every block on the free list, returns how many
+    unsigned FreeEmptyPages(void);
+
+      // Frees one page (as returned by the page source) if every block on
+      // it is on the free list, returns false otherwise
+    bool FreeEmptyPage(const void *Page);
+
+      // Testing/Debugging/Statistic methods
+    void SetDebugState(bool State);       // true=enable, false=disable (if the policy allows)
+    OAStats GetStats(void) const;         // returns the statistics for the allocator
+
+  private:
+    mutable LockPolicy Lock_;    // guards the core's state unless NoLockPolicy
+
+      // false when every feature is compiled out: slow_path_ is then
+      // never tested and Allocate/Free reduce to a list pop/push
+    static const bool MayTakeSlowPath = DebugPolicy::CanEnable || HeaderPolicy::CanEnable || 
+                                        PagePolicy::CanEnable;
+
+      // Make private to prevent copy construction and assignment
+    BasicObjectAllocator(const BasicObjectAllocator &oa);
+    BasicObjectAllocator &operator=(const BasicObjectAllocator &oa);
+
+    static OAConfig Normalize(const OAConfig& config) OA_THROW(OAException); //apply the policies to config
+};
+
+// This memory manager class. Every feature is selected at runtime through
+// OAConfig (and SetDebugState), exactly like the original allocator.
+class ObjectAllocator : public BasicObjectAllocator<RuntimeDebugPolicy, RuntimeHeaderPolicy, 
+                                                    RuntimePagePolicy, NoLockPolicy>
+{
+  public:
+      // Creates the ObjectManager per the specified values
+      // Throws an exception if the construction fails. (Memory allocation problem)
+    ObjectAllocator(unsigned ObjectSize, const OAConfig& config) OA_THROW(OAException);
+
+      // Destroys the ObjectManager (never throws)
+    ~ObjectAllocator() OA_NOTHROW;
+
+  private:
+      // Make private to prevent copy construction and assignment
+    ObjectAllocator(const ObjectAllocator &oa);
+    ObjectAllocator &operator=(const ObjectAllocator &oa);
+};
+
+/******************************************************************************/
+/*!
+      \brief
+       Constructor for the BasicObjectAllocator class
+      
+      \param ObjectSize
+        Size of each object on a page
+      
+      \param config
+        the specifications of the config struct, features the policies
+        disable are switched off before the first page is built
+
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  BasicObjectAllocator(unsigned ObjectSize, const OAConfig& config) OA_THROW(OAException)
+  : ObjectAllocatorCore(ObjectSize, Normalize(config))
+{
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Allocates a block of memory for the client and
+       returns to them a pointer to the block. Only pops the free list
+       here; everything else is done out of line by AllocateSlow.
+      
+      \return
+        a pointer to the block of memory allocated
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+inline void* BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::Allocate() OA_THROW(OAException)
+{
+  typename LockPolicy::Guard guard(Lock_);
+
+  GenericObject* temp = free_list_;
+  if((MayTakeSlowPath && slow_path_) || !temp)
+    return AllocateSlow();
+
+  free_list_ = temp->Next;
+
+   //update stats
+  --OAStats_.FreeObjects_;
+  ++OAStats_.ObjectsInUse_;
+  ++OAStats_.Allocations_;
+     
+  if(OAStats_.MostObjects_ < OAStats_.ObjectsInUse_)
+    ++OAStats_.MostObjects_;
+       
+  return temp;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       frees a block of memory. Only pushes on the free list here;
+       checks and signatures are done out of line by FreeSlow.
+      
+      \param Object
+         a pointer to the object to be freed
+              
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+inline void BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::Free(void *Object) OA_THROW(OAException)
+{
+  typename LockPolicy::Guard guard(Lock_);
+
+  if(MayTakeSlowPath && slow_path_)
+  {
+    FreeSlow(Object);
+    return;
+  }
+
+  GenericObject* temp = reinterpret_cast<GenericObject*> (Object);
+  temp->Next = free_list_;
+  free_list_ = temp;
+   
+   //update stats
+  ++OAStats_.FreeObjects_;
+  ++OAStats_.Deallocations_;
+  --OAStats_.ObjectsInUse_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Calls the callback fn for each block still in use
+        
+      \param fn
+        the callback function for each block in use
+      
+      \return
+        the number of blocks in use by client
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+unsigned BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  DumpMemoryInUse(DUMPCALLBACK fn) const
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return DumpBlocksInUse(fn);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates a block for a tenant, charged to its quota
+        
+      \param Tenant
+        the tenant's tag
+      
+      \return
+        a pointer to the block of memory allocated
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+void* BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  AllocateFor(unsigned char Tenant) OA_THROW(OAException)
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return AllocateTenant(Tenant);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Sets the most objects a tenant may have in use
+        
+      \param Tenant
+        the tenant's tag
+      
+      \param Objects
+        the quota, 0 for none
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+void BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  SetTenantQuota(unsigned char Tenant, unsigned Objects)
+{
+  typename LockPolicy::Guard guard(Lock_);
+  SetQuota(Tenant, Objects);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the statistics of one tenant
+        
+      \param Tenant
+        the tenant's tag
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+OATenantStats BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  GetTenantStats(unsigned char Tenant) const
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return TenantStats(Tenant);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Calls the callback fn for each block of one tenant still in use
+        
+      \param fn
+        the callback function for each block in use
+      
+      \param Tenant
+        the tenant's tag
+      
+      \return
+        the number of the tenant's blocks in use
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+unsigned BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  DumpMemoryInUse(DUMPCALLBACK fn, unsigned char Tenant) const
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return DumpTenantBlocks(fn, Tenant);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Allocates Count adjacent blocks
+        
+      \param Count
+        how many
+      
+      \return
+        the first of them
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+void* BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  AllocateContiguous(unsigned Count) OA_THROW(OAException)
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return AllocateRun(Count);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees Count adjacent blocks
+        
+      \param Objects
+        from AllocateContiguous
+      
+      \param Count
+        the Count it was allocated with
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+void BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  FreeContiguous(void *Objects, unsigned Count) OA_THROW(OAException)
+{
+  typename LockPolicy::Guard guard(Lock_);
+  FreeRun(Objects, Count);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Calls the callback fn for each block that is potentially corrupted
+        
+      \param fn
+        the callback function for each block that might be corrupted
+      
+      \return
+        the number of blocks that are corrupted
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+unsigned BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  ValidatePages(VALIDATECALLBACK fn) const
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return ValidateAllPages(fn);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees all empty pages
+      
+      \return
+        the number of freed pages
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+unsigned BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::FreeEmptyPages(void)
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return ReleaseEmptyPages();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Frees one page if it is empty
+      
+      \param Page
+        start of the page, as returned by the page source
+      
+      \return
+        true if the page was freed
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+bool BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::FreeEmptyPage(const void *Page)
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return ReleaseEmptyPage(Page);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Turns the debugging code on or off. Has no effect when the
+        DebugPolicy fixes the state at compile time.
+      
+      \param State
+        If in debug mode or not
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+void BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::SetDebugState(bool State)
+{
+  typename LockPolicy::Guard guard(Lock_);
+  OAConfig requested = Config_;
+  requested.DebugOn_ = State;
+  SetDebugFlag(DebugPolicy::Enabled(requested));
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the statistics for the allocator
+      
+      \return
+        Allocator stats
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+OAStats BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::GetStats(void) const
+{
+  typename LockPolicy::Guard guard(Lock_);
+  return OAStats_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Overrides the fields of a client config that a policy fixes at
+        compile time, so the page layout and the cold paths in
+        ObjectAllocatorCore agree with what Allocate/Free do.
+      
+      \param config
+        the config requested by the client
+      
+      \return
+        the config the allocator will actually use
+      
+*/
+/******************************************************************************/
+template <typename DebugPolicy, typename HeaderPolicy, typename PagePolicy, typename LockPolicy>
+OAConfig BasicObjectAllocator<DebugPolicy, HeaderPolicy, PagePolicy, LockPolicy>::
+  Normalize(const OAConfig& config) OA_THROW(OAException)
+{
+  OAConfig normalized = config;
+  normalized.UseCPPMemManager_ = PagePolicy::PassThrough(config);
+  normalized.DebugOn_ = DebugPolicy::Enabled(config);
+  normalized.HeaderBlocks_ = HeaderPolicy::Blocks(config);
+  if(!MayTakeSlowPath)
+  {
+      //the link would land in the middle of a constructed object
+    if(config.Constructor_ && config.ScratchOffset_)
+      throw OAException(OAException::E_BAD_CONFIG, 
+                        "Normalize: This allocator keeps the free list link at offset 0.");
+    normalized.ScratchOffset_ = 0;   // the fast path links at offset 0
+    normalized.Ring_ = false;        // and pops the free list
+    normalized.AddressOrdered_ = false;
+  }
+  return normalized;
+}
+
 #endif
@@ -0,0 +1,258 @@
+/******************************************************************************/
+/*!
+\file   PerfCounters.cpp
+\brief
+    perf_event_open counters for the benchmarks, see PerfCounters.h.
+    Everywhere but Linux every counter is unavailable.
+
+*/
+/******************************************************************************/
+
+#include "PerfCounters.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(__linux__)
+    // type and config of each counter
+  struct Event
+  {
+    unsigned Type;
+    unsigned long long Config;
+  };
+
+  unsigned long long CacheMiss(unsigned long long cache)
+  {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+
+  int Open(const Event &event)
+  {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.Type;
+    attr.config = event.Config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      // this thread, any CPU, no group
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Constructor for the OAPerfCounters class, opens the counters of
+       the calling thread (enabled from the start)
+
+*/
+/******************************************************************************/
+OAPerfCounters::OAPerfCounters() : error_("")
+{
+#if defined(__linux__)
+  const Event events[COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_DTLB) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+  };
+#endif
+
+  for (int i = 0; i < COUNTERS; ++i)
+  {
+#if defined(__linux__)
+    fds_[i] = Open(events[i]);
+    if (fds_[i] < 0 && !*error_)
+      error_ = std::strerror(errno);
+#else
+    fds_[i] = -1;
+    error_ = "perf_event_open needs Linux";
+#endif
+    totals_[i] = 0;
+    start_[i].Value = start_[i].Enabled = start_[i].Running = 0;
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Destructor for the OAPerfCounters class, closes the counters
+
+*/
+/******************************************************************************/
+OAPerfCounters::~OAPerfCounters()
+{
+#if defined(__linux__)
+  for (int i = 0; i < COUNTERS; ++i)
+    if (fds_[i] >= 0)
+      close(fds_[i]);
+#endif
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Starts a measured section: remembers where every counter is
+
+*/
+/******************************************************************************/
+void OAPerfCounters::Start(void)
+{
+  for (int i = 0; i < COUNTERS; ++i)
+    Read(static_cast<COUNTER>(i), start_[i]);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Ends a measured section: adds what every counter counted since
+       Start, scaled up if it only ran part of the time
+
+*/
+/******************************************************************************/
+void OAPerfCounters::Stop(void)
+{
+  for (int i = 0; i < COUNTERS; ++i)
+  {
+    Reading now;
+    if (!Read(static_cast<COUNTER>(i), now))
+      continue;
+
+    double value = static_cast<double>(now.Value - start_[i].Value);
+    unsigned long long enabled = now.Enabled - start_[i].Enabled;
+    unsigned long long running = now.Running - start_[i].Running;
+    if (running && running < enabled)
+      value *= static_cast<double>(enabled) / running;
+    totals_[i] += value;
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Zeroes the totals
+
+*/
+/******************************************************************************/
+void OAPerfCounters::Reset(void)
+{
+  for (int i = 0; i < COUNTERS; ++i)
+    totals_[i] = 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns a counter's total over every Start/Stop since Reset
+
+      \param Counter
+        the counter
+
+*/
+/******************************************************************************/
+double OAPerfCounters::Value(COUNTER Counter) const
+{
+  return totals_[Counter];
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns true if the counter could be opened
+
+      \param Counter
+        the counter
+
+*/
+/******************************************************************************/
+bool OAPerfCounters::Available(COUNTER Counter) const
+{
+  return fds_[Counter] >= 0;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns true if at least one counter could be opened
+
+*/
+/******************************************************************************/
+bool OAPerfCounters::AnyAvailable(void) const
+{
+  for (int i = 0; i < COUNTERS; ++i)
+    if (fds_[i] >= 0)
+      return true;
+  return false;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns the reason the first unavailable counter failed to open,
+       "" if they all opened
+
+*/
+/******************************************************************************/
+const char *OAPerfCounters::Error(void) const
+{
+  return error_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns a short name of the counter, for table headings
+
+      \param Counter
+        the counter
+
+*/
+/******************************************************************************/
+const char *OAPerfCounters::Name(COUNTER Counter)
+{
+  static const char *const names[COUNTERS] = {
+    "instructions", "L1D misses", "LLC misses", "dTLB misses", "branch misses"
+  };
+  return names[Counter];
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Reads a counter's value and run times
+
+      \param Counter
+        the counter
+
+      \param reading
+        filled in
+
+      \return
+        false if the counter is unavailable or the read failed
+
+*/
+/******************************************************************************/
+bool OAPerfCounters::Read(COUNTER Counter, Reading &reading) const
+{
+#if defined(__linux__)
+  if (fds_[Counter] < 0)
+    return false;
+  return read(fds_[Counter], &reading, sizeof(reading)) == static_cast<ssize_t>(sizeof(reading));
+#else
+  (void)Counter;
+  (void)reading;
+  return false;
+#endif
+}
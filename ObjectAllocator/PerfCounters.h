@@ -0,0 +1,87 @@
+/******************************************************************************/
+/*!
+\file   PerfCounters.h
+\brief
+    Hardware counters for the benchmarks, read through perf_event_open
+    (Linux, no libraries): instructions, L1D read misses, last level
+    cache read misses, dTLB read misses and branch misses of the calling
+    thread, user space only.
+
+    Counters that can't be opened (not Linux, a virtual machine without
+    a PMU, perf_event_paranoid too high, ...) are left out: Available
+    tells which ones count and Error says why the others don't. When the
+    kernel multiplexes more counters than the PMU has, the counts are
+    scaled by the time each one actually ran.
+
+    Functions include:
+    - Constructor
+    - Destructor
+    - Start
+    - Stop
+    - Reset
+    - Value
+    - Available
+    - AnyAvailable
+    - Error
+    - Name
+
+*/
+/******************************************************************************/
+
+//---------------------------------------------------------------------------
+#ifndef PERFCOUNTERSH
+#define PERFCOUNTERSH
+//---------------------------------------------------------------------------
+
+class OAPerfCounters
+{
+  public:
+    enum COUNTER
+    {
+      INSTRUCTIONS,
+      L1D_MISSES,
+      LLC_MISSES,
+      DTLB_MISSES,
+      BRANCH_MISSES,
+      COUNTERS
+    };
+
+      // Opens and starts every counter it can
+    OAPerfCounters();
+
+      // Closes the counters
+    ~OAPerfCounters();
+
+      // Counts from Start to Stop add up until Reset
+    void Start(void);
+    void Stop(void);
+    void Reset(void);
+
+    double Value(COUNTER Counter) const;      // 0 if unavailable
+    bool Available(COUNTER Counter) const;
+    bool AnyAvailable(void) const;
+    const char *Error(void) const;            // why a counter didn't open, "" if all did
+
+    static const char *Name(COUNTER Counter);
+
+  private:
+    struct Reading
+    {
+      unsigned long long Value;
+      unsigned long long Enabled;   // time the counter was enabled
+      unsigned long long Running;   // time it was on the PMU
+    };
+
+    int fds_[COUNTERS];             // -1 if unavailable
+    Reading start_[COUNTERS];
+    double totals_[COUNTERS];
+    const char *error_;
+
+      // Make private to prevent copy construction and assignment
+    OAPerfCounters(const OAPerfCounters &counters);
+    OAPerfCounters &operator=(const OAPerfCounters &counters);
+
+    bool Read(COUNTER Counter, Reading &reading) const;
+};
+
+#endif
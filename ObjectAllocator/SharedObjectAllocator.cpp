@@ -0,0 +1,807 @@
+/******************************************************************************/
+/*!
+\file   SharedObjectAllocator.cpp
+\brief
+    Implementation of the shared memory segment behind
+    SharedObjectAllocator.
+
+    Segment layout (every field at the same offset in every process):
+
+      [OASegmentHeader][page stamps][page 0][page 1]...[page MaxPages_ - 1]
+
+    Pages are ObjectsPerPage_ blocks back to back. A free block's first
+    4 bytes hold the offset of the next free block (0 ends the list).
+    A page's stamp is written once its blocks are linked, so a restart
+    can tell formatted pages from ones a crash left half carved.
+
+    A file backed segment is flock'ed shared by every process using it.
+    The first one in (it gets the lock exclusively) validates or repairs
+    the segment; every one in marks it not clean, the last one out marks
+    it clean.
+
+    Functions include:
+    - SharedObjectAllocator (Constructors, Destructor, Allocate, Free,
+      OffsetOf, AtOffset, SetRoot, Root, Sync, GetStats, GetConfig, Fd,
+      Unlink, OpenFile, Create, Attach, Recover, CarvePage, FormatPage,
+      BlockOffset)
+
+*/
+/******************************************************************************/
+
+#include "SharedObjectAllocator.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <new>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/syscall.h>
+
+static const uint32_t SEGMENT_MAGIC = 0x4741534f;   // "OSAG"
+static const uint32_t SEGMENT_VERSION = 2;
+static const uint32_t PAGE_STAMP = 0x50414745;      // "PAGE" + page number
+
+// Start of the segment. Written once by the creator (then ready is set),
+// only the atomics change afterwards.
+struct OASegmentHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint32_t> ready;          // 1 once the creator is done
+  uint32_t object_size;
+  uint32_t block_size;
+  uint32_t objects_per_page;
+  uint32_t max_pages;
+  uint32_t alignment;
+  uint32_t page_size;
+  uint32_t page_stamps;                 // offset of the page stamps
+  uint32_t first_page;                  // offset of page 0
+  uint64_t segment_size;
+
+  std::atomic<uint32_t> clean;          // file closed by its last user
+  std::atomic<uint32_t> root;           // offset of the client's root block
+
+  std::atomic<uint64_t> free_head;      // ABA counter << 32 | offset
+  std::atomic<uint32_t> pages;          // pages carved so far
+  std::atomic<uint32_t> in_use;
+  std::atomic<uint32_t> most;
+  std::atomic<uint32_t> allocations;
+  std::atomic<uint32_t> deallocations;
+};
+
+namespace
+{
+    // the link in a free block
+  std::atomic<uint32_t>* LinkAt(char* base, uint32_t offset)
+  {
+    return reinterpret_cast<std::atomic<uint32_t>*>(base + offset);
+  }
+
+    // next head: same counter + 1, new offset
+  uint64_t NextHead(uint64_t head, uint32_t offset)
+  {
+    return (((head >> 32) + 1) << 32) | offset;
+  }
+
+    // a page's stamp
+  std::atomic<uint32_t>* StampOf(char* base, const OASegmentHeader* header, uint32_t page)
+  {
+    return reinterpret_cast<std::atomic<uint32_t>*>(base + header->page_stamps) + page;
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the SharedObjectAllocator class, creates or opens
+        a named segment, or creates a memfd one
+
+      \param Name
+        shm_open name ("/something"), NULL for an anonymous memfd, or
+        the path of the backing file
+
+      \param ObjectSize
+        Size of each object on a page
+
+      \param config
+        ObjectsPerPage_, MaxPages_ and Alignment_ set the layout
+
+      \param File
+        true if Name is a file whose contents outlive the processes
+
+*/
+/******************************************************************************/
+SharedObjectAllocator::SharedObjectAllocator(const char* Name, unsigned ObjectSize,
+                                             const OAConfig& config, bool File) OA_THROW(OAException)
+  : base_(NULL), size_(0), fd_(-1), persistent_(false), header_(NULL)
+{
+  if(!config.MaxPages_ || !config.ObjectsPerPage_)
+    throw OAException(OAException::E_NO_PAGES, "SharedObjectAllocator: MaxPages_ and ObjectsPerPage_ size the segment.");
+
+  if(File && Name)
+  {
+    OpenFile(Name, ObjectSize, config);
+    return;
+  }
+
+  if(!Name)
+  {
+#ifdef SYS_memfd_create
+    fd_ = static_cast<int>(syscall(SYS_memfd_create, "SharedObjectAllocator", 0));
+#endif
+    if(fd_ < 0)
+      throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: memfd_create failed.");
+    try
+    {
+      Create(fd_, ObjectSize, config);
+    }
+    catch(...)
+    {
+      close(fd_);
+      throw;
+    }
+    return;
+  }
+
+    //first one in creates it, everybody else attaches
+  int fd = shm_open(Name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  bool creator = fd >= 0;
+  if(!creator && errno == EEXIST)
+    fd = shm_open(Name, O_RDWR, 0);
+  if(fd < 0)
+    throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: shm_open failed.");
+
+  try
+  {
+    if(creator)
+      Create(fd, ObjectSize, config);
+    else
+      Attach(fd, &config, ObjectSize);
+  }
+  catch(...)
+  {
+    if(creator)
+      shm_unlink(Name);
+    close(fd);
+    throw;
+  }
+  close(fd);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Constructor for the SharedObjectAllocator class, maps a segment
+        another process created
+
+      \param Fd
+        file descriptor of the segment, still owned by the caller
+
+*/
+/******************************************************************************/
+SharedObjectAllocator::SharedObjectAllocator(int Fd) OA_THROW(OAException)
+  : base_(NULL), size_(0), fd_(-1), persistent_(false), header_(NULL)
+{
+  Attach(Fd, NULL, 0);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Destructor for the SharedObjectAllocator class, unmaps the segment
+        (blocks still in use stay allocated for the other processes). The
+        last process to close a file backed segment writes it back and
+        marks it clean.
+
+*/
+/******************************************************************************/
+SharedObjectAllocator::~SharedObjectAllocator() OA_NOTHROW
+{
+  if(persistent_ && !flock(fd_, LOCK_EX | LOCK_NB))
+  {
+    msync(base_, size_, MS_SYNC);
+    header_->clean.store(1, std::memory_order_release);
+    msync(base_, size_, MS_SYNC);
+  }
+  munmap(base_, size_);
+  if(fd_ >= 0)
+    close(fd_);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Pops a block off the shared free list, carving a new page if it is
+        empty
+
+      \return
+        a pointer to the block of memory allocated
+
+*/
+/******************************************************************************/
+void* SharedObjectAllocator::Allocate() OA_THROW(OAException)
+{
+  uint64_t head = header_->free_head.load(std::memory_order_acquire);
+  for(;;)
+  {
+    uint32_t offset = static_cast<uint32_t>(head);
+    if(!offset)
+    {
+      if(!CarvePage())
+        throw OAException(OAException::E_NO_PAGES, "Allocate: The segment has no more pages.");
+      head = header_->free_head.load(std::memory_order_acquire);
+      continue;
+    }
+
+      //the block may be popped (and its link overwritten) meanwhile,
+      //the counter in head makes the swap fail if so
+    uint32_t next = LinkAt(base_, offset)->load(std::memory_order_relaxed);
+    if(header_->free_head.compare_exchange_weak(head, NextHead(head, next),
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_acquire))
+    {
+      header_->allocations.fetch_add(1, std::memory_order_relaxed);
+      uint32_t in_use = header_->in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+      uint32_t most = header_->most.load(std::memory_order_relaxed);
+      while(in_use > most &&
+             !header_->most.compare_exchange_weak(most, in_use, std::memory_order_relaxed))
+      {
+      }
+      return base_ + offset;
+    }
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Pushes a block on the shared free list
+
+      \param Object
+        a pointer to the object to be freed, from any process's mapping
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::Free(void* Object) OA_THROW(OAException)
+{
+  uint32_t offset = BlockOffset(Object);
+  uint64_t head = header_->free_head.load(std::memory_order_relaxed);
+  do
+  {
+    LinkAt(base_, offset)->store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+  } while(!header_->free_head.compare_exchange_weak(head, NextHead(head, offset),
+                                                     std::memory_order_release,
+                                                     std::memory_order_relaxed));
+
+  header_->deallocations.fetch_add(1, std::memory_order_relaxed);
+  header_->in_use.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Handle for a block that means the same thing in every process
+
+      \param Object
+        a block from Allocate
+
+      \return
+        the block's offset in the segment
+
+*/
+/******************************************************************************/
+unsigned SharedObjectAllocator::OffsetOf(const void* Object) const OA_THROW(OAException)
+{
+  return BlockOffset(Object);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Turns an offset from any process back into a pointer
+
+      \param Offset
+        from OffsetOf
+
+      \return
+        the block in this process's mapping
+
+*/
+/******************************************************************************/
+void* SharedObjectAllocator::AtOffset(unsigned Offset) const OA_THROW(OAException)
+{
+  void* block = base_ + Offset;
+  BlockOffset(block);
+  return block;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Records the block a restarted process starts from (the head of
+        the client's own data structure)
+
+      \param Object
+        a block from Allocate, NULL to clear the root
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::SetRoot(void* Object) OA_THROW(OAException)
+{
+  header_->root.store(Object ? BlockOffset(Object) : 0, std::memory_order_release);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the block SetRoot recorded, NULL if none
+
+*/
+/******************************************************************************/
+void* SharedObjectAllocator::Root(void) const
+{
+  uint32_t root = header_->root.load(std::memory_order_acquire);
+  return root ? base_ + root : NULL;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Writes the segment back to its file and waits for it (what a
+        machine crash may lose, as opposed to a process crash)
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::Sync(void) const OA_THROW(OAException)
+{
+  if(msync(base_, size_, MS_SYNC))
+    throw OAException(OAException::E_NO_MEMORY, "Sync: msync failed.");
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the statistics of the segment, shared by every process
+
+*/
+/******************************************************************************/
+OAStats SharedObjectAllocator::GetStats(void) const
+{
+  OAStats stats;
+  stats.ObjectSize_ = header_->object_size;
+  stats.PageSize_ = header_->page_size;
+  stats.PagesInUse_ = header_->pages.load(std::memory_order_relaxed);
+  stats.ObjectsInUse_ = header_->in_use.load(std::memory_order_relaxed);
+  stats.FreeObjects_ = stats.PagesInUse_ * header_->objects_per_page - stats.ObjectsInUse_;
+  stats.MostObjects_ = header_->most.load(std::memory_order_relaxed);
+  stats.Allocations_ = header_->allocations.load(std::memory_order_relaxed);
+  stats.Deallocations_ = header_->deallocations.load(std::memory_order_relaxed);
+  return stats;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the layout of the segment as a configuration
+
+*/
+/******************************************************************************/
+OAConfig SharedObjectAllocator::GetConfig(void) const
+{
+  return OAConfig(false, header_->objects_per_page, header_->max_pages, false, 0, 0,
+                  header_->alignment);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        returns the memfd of an anonymous segment (to pass to another
+        process) or the backing file, -1 for shm or attached segments
+
+*/
+/******************************************************************************/
+int SharedObjectAllocator::Fd(void) const
+{
+  return fd_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Removes a named segment, processes that mapped it keep using it
+
+      \param Name
+        the shm_open name
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::Unlink(const char* Name)
+{
+  shm_unlink(Name);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Opens (or creates) a file backed segment. The first process in
+        formats a new file or checks the one a previous run left behind,
+        everybody after it just maps it. Only an empty file, or a segment
+        whose creator died before it was ready, is formatted: any other
+        file is left alone.
+
+      \param Path
+        the backing file
+
+      \param ObjectSize
+        Size of each object on a page
+
+      \param config
+        the layout, an existing file must have the same
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::OpenFile(const char* Path, unsigned ObjectSize,
+                                     const OAConfig& config) OA_THROW(OAException)
+{
+  int fd = open(Path, O_RDWR | O_CREAT, 0600);
+  if(fd < 0)
+    throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: Can't open the file.");
+
+  try
+  {
+    if(!flock(fd, LOCK_EX | LOCK_NB))
+    {
+        //nobody else has it: new, never finished, or left by a previous run
+      struct stat status;
+      if(fstat(fd, &status))
+        throw OAException(OAException::E_BAD_SEGMENT, "SharedObjectAllocator: Can't read the segment.");
+      uint32_t words[3] = { 0, 0, 0 };   // magic, version, ready
+      if(status.st_size &&
+          (pread(fd, words, sizeof(words), 0) != static_cast<ssize_t>(sizeof(words)) ||
+           words[0] != SEGMENT_MAGIC || words[1] != SEGMENT_VERSION))
+        throw OAException(OAException::E_BAD_SEGMENT, "SharedObjectAllocator: The file isn't a segment.");
+
+      if(!words[2])
+      {
+        if(ftruncate(fd, 0))
+          throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: Can't size the segment.");
+        Create(fd, ObjectSize, config);
+      }
+      else
+      {
+        Attach(fd, &config, ObjectSize);
+        Recover();
+      }
+      header_->clean.store(0, std::memory_order_release);
+      flock(fd, LOCK_SH);
+    }
+    else if(flock(fd, LOCK_SH))
+      throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: Can't lock the file.");
+    else
+    {
+        //the last user may have marked it clean while we waited for the
+        //lock: it isn't, as long as we have it mapped
+      Attach(fd, &config, ObjectSize);
+      header_->clean.store(0, std::memory_order_release);
+    }
+  }
+  catch(...)
+  {
+    if(header_)
+      munmap(base_, size_);
+    close(fd);
+    throw;
+  }
+  fd_ = fd;
+  persistent_ = true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Sizes, maps and formats a new segment
+
+      \param fd
+        the empty segment
+
+      \param ObjectSize
+        Size of each object on a page
+
+      \param config
+        the layout
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::Create(int fd, unsigned ObjectSize, const OAConfig& config) OA_THROW(OAException)
+{
+  unsigned align = config.Alignment_ > 8 ? config.Alignment_ : 8;
+  unsigned block_size = ObjectSize > sizeof(uint32_t) ? ObjectSize : sizeof(uint32_t);
+  block_size = (block_size + align - 1) / align * align;
+  unsigned header_align = align > 64 ? align : 64;
+  unsigned long long page_stamps = sizeof(OASegmentHeader);
+  unsigned long long first_page = page_stamps + sizeof(uint32_t) * config.MaxPages_;
+  first_page = (first_page + header_align - 1) / header_align * header_align;
+
+  unsigned long long size = first_page +
+    static_cast<unsigned long long>(config.MaxPages_) * config.ObjectsPerPage_ * block_size;
+  if(size > 0xffffffffull)
+    throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: Segment too big for 32 bit offsets.");
+
+  if(ftruncate(fd, static_cast<off_t>(size)))
+    throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: Can't size the segment.");
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(base == MAP_FAILED)
+    throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: Can't map the segment.");
+  base_ = static_cast<char*>(base);
+  size_ = static_cast<unsigned long>(size);
+
+  header_ = new (base_) OASegmentHeader;
+  if(!header_->free_head.is_lock_free())
+  {
+    munmap(base_, size_);
+    throw OAException(OAException::E_BAD_SEGMENT, "SharedObjectAllocator: 64 bit atomics aren't lock-free here.");
+  }
+  header_->magic = SEGMENT_MAGIC;
+  header_->version = SEGMENT_VERSION;
+  header_->object_size = ObjectSize;
+  header_->block_size = block_size;
+  header_->objects_per_page = config.ObjectsPerPage_;
+  header_->max_pages = config.MaxPages_;
+  header_->alignment = config.Alignment_;
+  header_->page_size = config.ObjectsPerPage_ * block_size;
+  header_->page_stamps = static_cast<uint32_t>(page_stamps);
+  header_->first_page = static_cast<uint32_t>(first_page);
+  header_->segment_size = size;
+  header_->clean.store(0, std::memory_order_relaxed);
+  header_->root.store(0, std::memory_order_relaxed);
+  header_->free_head.store(0, std::memory_order_relaxed);
+  header_->pages.store(0, std::memory_order_relaxed);
+  header_->in_use.store(0, std::memory_order_relaxed);
+  header_->most.store(0, std::memory_order_relaxed);
+  header_->allocations.store(0, std::memory_order_relaxed);
+  header_->deallocations.store(0, std::memory_order_relaxed);
+  header_->ready.store(1, std::memory_order_release);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Maps a segment created by someone else, waiting (up to a second)
+        for its creator to finish
+
+      \param fd
+        the segment
+
+      \param expected
+        layout the caller asked for, NULL to take the segment's
+
+      \param ObjectSize
+        object size the caller asked for (with expected)
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::Attach(int fd, const OAConfig* expected, unsigned ObjectSize) OA_THROW(OAException)
+{
+  for(int tries = 0; !header_ && tries < 1000; ++tries)
+  {
+    struct stat status;
+    if(fstat(fd, &status))
+      throw OAException(OAException::E_BAD_SEGMENT, "SharedObjectAllocator: Can't read the segment.");
+
+    if(status.st_size >= static_cast<off_t>(sizeof(OASegmentHeader)))
+    {
+      void* base = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if(base == MAP_FAILED)
+        throw OAException(OAException::E_NO_MEMORY, "SharedObjectAllocator: Can't map the segment.");
+      OASegmentHeader* header = static_cast<OASegmentHeader*>(base);
+      if(header->ready.load(std::memory_order_acquire))
+      {
+        base_ = static_cast<char*>(base);
+        size_ = static_cast<unsigned long>(status.st_size);
+        header_ = header;
+        break;
+      }
+      munmap(base, status.st_size);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if(!header_)
+    throw OAException(OAException::E_BAD_SEGMENT, "SharedObjectAllocator: The segment was never set up.");
+
+  bool bad = header_->magic != SEGMENT_MAGIC || header_->version != SEGMENT_VERSION ||
+             header_->segment_size != size_ ||
+             header_->page_stamps < sizeof(OASegmentHeader) ||
+             header_->first_page < header_->page_stamps + sizeof(uint32_t) * header_->max_pages ||
+             !header_->block_size ||
+             header_->page_size != header_->objects_per_page * header_->block_size ||
+             header_->first_page + static_cast<unsigned long long>(header_->max_pages) *
+               header_->page_size > size_;
+  if(!bad && expected)
+    bad = header_->object_size != ObjectSize ||
+          header_->objects_per_page != expected->ObjectsPerPage_ ||
+          header_->max_pages != expected->MaxPages_ ||
+          header_->alignment != expected->Alignment_;
+  if(bad)
+  {
+    munmap(base_, size_);
+    header_ = NULL;
+    throw OAException(OAException::E_BAD_SEGMENT, "SharedObjectAllocator: The segment has another layout.");
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Checks a file backed segment left by a previous run, with nobody
+        else using it. Live blocks stay where they are.
+
+        A clean segment only has its page stamps checked, O(pages). After
+        a crash (or on a clean segment with a page never stamped, which a
+        peer that died was carving) the free list is walked as well (every link must be a
+        block, and the list can't be longer than the segment) and the
+        statistics are recounted from it. A page without its stamp was
+        being carved: if any of its blocks is on the free list it was
+        pushed and only gets its stamp, otherwise it is formatted again.
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::Recover(void) OA_THROW(OAException)
+{
+  bool clean = header_->clean.load(std::memory_order_acquire) != 0;
+  uint32_t pages = header_->pages.load(std::memory_order_relaxed);
+  uint32_t root = header_->root.load(std::memory_order_relaxed);
+  bool bad = pages > header_->max_pages;
+
+    //a page never stamped was being carved by a process that died
+    //while others went on, and the last of them closed it cleanly:
+    //repair it like after a crash. Any other wrong stamp is corruption.
+  for(uint32_t page = 0; clean && !bad && page < pages; ++page)
+  {
+    uint32_t stamp = StampOf(base_, header_, page)->load(std::memory_order_relaxed);
+    if(!stamp)
+      clean = false;
+    else
+      bad = stamp != PAGE_STAMP + page;
+  }
+
+  if(!bad && root)
+    try
+    {
+      BlockOffset(base_ + root);
+    }
+    catch(const OAException&)
+    {
+      bad = true;
+    }
+
+  if(!bad && !clean)
+  {
+    uint32_t blocks = pages * header_->objects_per_page;
+    uint32_t free_blocks = 0;
+    uint32_t offset = static_cast<uint32_t>(header_->free_head.load(std::memory_order_relaxed));
+    try
+    {
+        //a free block stamps its page: that page was pushed
+      for(; offset && free_blocks <= blocks; ++free_blocks)
+      {
+        offset = BlockOffset(base_ + offset);
+        uint32_t page = (offset - header_->first_page) / header_->page_size;
+        StampOf(base_, header_, page)->store(PAGE_STAMP + page, std::memory_order_relaxed);
+        offset = LinkAt(base_, offset)->load(std::memory_order_relaxed);
+      }
+    }
+    catch(const OAException&)
+    {
+      bad = true;
+    }
+    bad = bad || free_blocks > blocks;
+
+      //claimed, but never pushed on the free list
+    for(uint32_t page = 0; !bad && page < pages; ++page)
+      if(StampOf(base_, header_, page)->load(std::memory_order_relaxed) != PAGE_STAMP + page)
+      {
+        FormatPage(page);
+        free_blocks += header_->objects_per_page;
+      }
+
+    if(!bad)
+    {
+      header_->in_use.store(blocks - free_blocks, std::memory_order_relaxed);
+      if(header_->most.load(std::memory_order_relaxed) < blocks - free_blocks)
+        header_->most.store(blocks - free_blocks, std::memory_order_relaxed);
+    }
+  }
+
+  if(bad)
+  {
+    munmap(base_, size_);
+    header_ = NULL;
+    throw OAException(OAException::E_BAD_SEGMENT, "SharedObjectAllocator: The segment's pages are corrupted.");
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Claims the next page of the segment and puts its blocks on the
+        free list
+
+      \return
+        false if every page is already in use
+
+*/
+/******************************************************************************/
+bool SharedObjectAllocator::CarvePage(void)
+{
+  uint32_t page = header_->pages.load(std::memory_order_relaxed);
+  do
+  {
+    if(page >= header_->max_pages)
+      return false;
+  } while(!header_->pages.compare_exchange_weak(page, page + 1, std::memory_order_relaxed));
+
+  FormatPage(page);
+  return true;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Links a claimed page's blocks, pushes all of them on the free
+        list in one swap, then stamps the page. A page that has its stamp
+        is on the free list (see Recover).
+
+      \param page
+        index of the page
+
+*/
+/******************************************************************************/
+void SharedObjectAllocator::FormatPage(unsigned page)
+{
+    //link the page's blocks to each other, privately
+  uint32_t first = header_->first_page + page * header_->page_size;
+  uint32_t last = first + (header_->objects_per_page - 1) * header_->block_size;
+  for(uint32_t block = first; block < last; block += header_->block_size)
+    LinkAt(base_, block)->store(block + header_->block_size, std::memory_order_relaxed);
+
+  uint64_t head = header_->free_head.load(std::memory_order_relaxed);
+  do
+  {
+    LinkAt(base_, last)->store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+  } while(!header_->free_head.compare_exchange_weak(head, NextHead(head, first),
+                                                     std::memory_order_release,
+                                                     std::memory_order_relaxed));
+  StampOf(base_, header_, page)->store(PAGE_STAMP + page, std::memory_order_relaxed);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+        Checks that a pointer is a block of a carved page
+
+      \param Object
+        the pointer
+
+      \return
+        its offset
+
+*/
+/******************************************************************************/
+unsigned SharedObjectAllocator::BlockOffset(const void* Object) const OA_THROW(OAException)
+{
+  const char* block = static_cast<const char*>(Object);
+  const char* first = base_ + header_->first_page;
+  const char* end = first + static_cast<unsigned long>(header_->pages.load(std::memory_order_relaxed)) *
+                            header_->page_size;
+  if(block < first || block >= end)
+    throw OAException(OAException::E_BAD_ADDRESS, "SharedObjectAllocator: Object isn't in the segment.");
+  if((block - first) % header_->block_size)
+    throw OAException(OAException::E_BAD_BOUNDARY, "SharedObjectAllocator: Object isn't on a block boundary.");
+  return static_cast<unsigned>(block - base_);
+}
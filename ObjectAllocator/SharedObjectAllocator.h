@@ -0,0 +1,123 @@
+/******************************************************************************/
+/*!
+\file   SharedObjectAllocator.h
+\brief
+    ObjectAllocator whose pages live in one shared memory segment (a named
+    shm_open object, an anonymous memfd, or a file), so several processes
+    can Allocate and Free from the same pool at once.
+
+    Every link in the segment is an offset from its start, never a
+    pointer, so each process may map it at a different address. The free
+    list is a lock-free stack whose head holds an offset and a counter
+    (against ABA) in one 64 bit word. Pages are carved out of the segment
+    one at a time as the free list runs dry, up to MaxPages_.
+
+    A block is handed to another process by passing OffsetOf(block); the
+    receiver turns it back into a pointer with AtOffset and frees it when
+    done (zero-copy).
+
+    A file backed segment also outlives the processes: a restarted
+    process maps the file again and finds its live blocks where it left
+    them, starting from the block it passed to SetRoot. A file closed
+    cleanly is checked in O(pages); after a crash the free list is
+    walked and the statistics recounted. Blocks a crashed process had
+    allocated but not linked into the client's data stay allocated.
+    Offsets are 32 bits, so a segment is at most 4 GB.
+
+    POSIX only (Linux for memfd). There are no debug checks, pad bytes or
+    header blocks: the free list is shared by processes that don't trust
+    each other's debug state. Alignment_ is honored.
+
+    Functions include:
+    - Constructor (named, memfd or file segment)
+    - Constructor (attach to a segment's file descriptor)
+    - Destructor
+    - Allocate
+    - Free
+    - OffsetOf
+    - AtOffset
+    - SetRoot
+    - Root
+    - Sync
+    - GetStats
+    - GetConfig
+    - Fd
+    - Unlink
+
+*/
+/******************************************************************************/
+
+//---------------------------------------------------------------------------
+#ifndef SHAREDOBJECTALLOCATORH
+#define SHAREDOBJECTALLOCATORH
+//---------------------------------------------------------------------------
+
+#include "ObjectAllocator.h"
+
+struct OASegmentHeader;
+
+class SharedObjectAllocator
+{
+  public:
+      // Creates the segment Name (shm_open), or opens it if another
+      // process already has, in which case the layout must match.
+      // A NULL Name makes an anonymous memfd segment, see Fd().
+      // If File is true, Name is the path of the backing file, created
+      // if missing and otherwise reopened with the blocks it holds.
+      // MaxPages_ sizes the segment and can't be 0.
+    SharedObjectAllocator(const char* Name, unsigned ObjectSize,
+                          const OAConfig& config, bool File = false) OA_THROW(OAException);
+
+      // Maps an existing segment, e.g. a memfd passed over a socket,
+      // the layout comes from the segment
+    explicit SharedObjectAllocator(int Fd) OA_THROW(OAException);
+
+      // Unmaps the segment, it lives on until every process has unmapped
+      // it (and, if named, it is unlinked)
+    ~SharedObjectAllocator() OA_NOTHROW;
+
+      // Takes a block off the shared free list (lock-free)
+    void* Allocate() OA_THROW(OAException);
+
+      // Puts a block back on the shared free list, from any process
+    void Free(void* Object) OA_THROW(OAException);
+
+      // Position independent handles for blocks
+    unsigned OffsetOf(const void* Object) const OA_THROW(OAException);
+    void* AtOffset(unsigned Offset) const OA_THROW(OAException);
+
+      // The block a restarted process starts from (NULL if none)
+    void SetRoot(void* Object) OA_THROW(OAException);
+    void* Root(void) const;
+
+      // Writes a file backed segment to disk and waits for it
+    void Sync(void) const OA_THROW(OAException);
+
+    OAStats GetStats(void) const;    // for the whole segment, every process
+    OAConfig GetConfig(void) const;  // the segment's layout as a config
+    int Fd(void) const;              // the memfd or file (-1 for shm_open)
+
+      // Removes a named segment, mapped ones stay usable
+    static void Unlink(const char* Name);
+
+  private:
+    char* base_;                     // where this process mapped the segment
+    unsigned long size_;
+    int fd_;                         // kept for memfd and file segments only
+    bool persistent_;                // file backed, holds a shared flock
+    OASegmentHeader* header_;
+
+      // Make private to prevent copy construction and assignment
+    SharedObjectAllocator(const SharedObjectAllocator& oa);
+    SharedObjectAllocator& operator=(const SharedObjectAllocator& oa);
+
+    void OpenFile(const char* Path, unsigned ObjectSize, const OAConfig& config) OA_THROW(OAException);
+    void Create(int fd, unsigned ObjectSize, const OAConfig& config) OA_THROW(OAException);
+    void Attach(int fd, const OAConfig* expected, unsigned ObjectSize) OA_THROW(OAException);
+    void Recover(void) OA_THROW(OAException);   // checks a file left by an earlier run
+    bool CarvePage(void);            // adds one more page to the free list
+    void FormatPage(unsigned page);
+    unsigned BlockOffset(const void* Object) const OA_THROW(OAException);
+};
+
+#endif
@@ -0,0 +1,510 @@
+/******************************************************************************/
+/*!
+\file   SoAPool.h
+\brief
+    Structure of arrays pool for component data iterated in bulk. A
+    SoAPool<float, float, float, int> holds objects of four fields; each
+    page stores every field in its own contiguous array, aligned to a
+    cache line, so a loop over one field of the live objects reads
+    consecutive memory and vectorizes.
+
+    Objects are named by handles (page * SlotsPerPage() + slot), fields
+    are reached with Get<I>(handle). ForEachLive calls a function once
+    per page with an OASoASpan: the page's field arrays and its
+    occupancy mask (bit i set = slot i is live). A SIMD loop runs over
+    all SlotsPerPage() slots and blends with the mask; a scalar loop
+    skips the clear bits.
+
+    Pages come from OAConfig: ObjectsPerPage_ (rounded up to a multiple
+    of 64, one mask word), MaxPages_ (0 = unlimited), PageSource_ and
+    ReclaimHandlers_. Fields must be trivially copyable, they are zeroed
+    by Allocate. Not thread safe, like ObjectAllocator.
+
+    Functions include:
+    - Constructor
+    - Destructor
+    - Allocate
+    - Free
+    - Get
+    - IsLive
+    - ForEachLive
+    - SlotsPerPage
+    - GetStats
+    - OASoASpan::Field
+    - OASoASpan::IsLive
+
+*/
+/******************************************************************************/
+
+//---------------------------------------------------------------------------
+#ifndef SOAPOOLH
+#define SOAPOOLH
+//---------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "ObjectAllocator.h"
+
+// true if every type of the pack is trivially copyable
+template <typename... Types>
+struct OAAllTrivial;
+
+template <>
+struct OAAllTrivial<>
+{
+  static const bool value = true;
+};
+
+template <typename First, typename... Rest>
+struct OAAllTrivial<First, Rest...>
+{
+  static const bool value = std::is_trivially_copyable<First>::value && OAAllTrivial<Rest...>::value;
+};
+
+// One page of a SoAPool as ForEachLive hands it out
+template <typename... Fields>
+struct OASoASpan
+{
+  static const unsigned FIELDS = sizeof...(Fields);
+
+  unsigned First;                  // handle of slot 0
+  unsigned Count;                  // slots on the page, a multiple of 64
+  unsigned Live;                   // how many of them are live
+  const unsigned long long* Mask;  // Count / 64 words, bit i = slot i live
+  void* Arrays[FIELDS];            // the field arrays, cache line aligned
+
+    // Field I of every slot of the page
+  template <unsigned I>
+  typename std::tuple_element<I, std::tuple<Fields...> >::type* Field(void) const
+  {
+    return static_cast<typename std::tuple_element<I, std::tuple<Fields...> >::type*>(Arrays[I]);
+  }
+
+  bool IsLive(unsigned Slot) const
+  {
+    return (Mask[Slot / 64] >> (Slot % 64)) & 1;
+  }
+};
+
+template <typename... Fields>
+class SoAPool
+{
+  public:
+    static const unsigned FIELDS = sizeof...(Fields);
+    static const unsigned ALIGNMENT = 64;    // of every field array
+    static const unsigned NO_HANDLE = ~0u;
+
+    typedef unsigned Handle;
+    typedef OASoASpan<Fields...> Span;
+
+    template <unsigned I>
+    struct FieldType
+    {
+      typedef typename std::tuple_element<I, std::tuple<Fields...> >::type type;
+    };
+
+      // Builds the first page (like ObjectAllocator)
+    explicit SoAPool(const OAConfig& config) OA_THROW(OAException);
+
+      // Frees every page, live objects or not
+    ~SoAPool() OA_NOTHROW;
+
+      // A free slot, its fields zeroed
+    Handle Allocate(void) OA_THROW(OAException);
+
+      // Gives a slot back, throws E_BAD_ADDRESS or E_MULTIPLE_FREE
+    void Free(Handle Object) OA_THROW(OAException);
+
+      // Field I of a slot
+    template <unsigned I>
+    typename FieldType<I>::type& Get(Handle Object)
+    {
+      return static_cast<typename FieldType<I>::type*>(FieldArray(Object / slots_, I))[Object % slots_];
+    }
+
+    bool IsLive(Handle Object) const;
+
+      // Calls fn(const Span&) for every page with live slots
+    template <typename Function>
+    void ForEachLive(Function fn) const
+    {
+      for(unsigned page = 0; page < pages_.size(); ++page)
+      {
+        if(!live_[page])
+          continue;
+
+        Span span;
+        span.First = page * slots_;
+        span.Count = slots_;
+        span.Live = live_[page];
+        span.Mask = Mask(page);
+        for(unsigned field = 0; field < FIELDS; ++field)
+          span.Arrays[field] = FieldArray(page, field);
+        fn(static_cast<const Span&>(span));
+      }
+    }
+
+    unsigned SlotsPerPage(void) const;
+    OAStats GetStats(void) const;
+
+  private:
+    OAConfig config_;
+    unsigned slots_;                      // per page, a multiple of 64
+    unsigned words_;                      // mask words per page
+    std::size_t offsets_[FIELDS];         // of each field array in a page
+    std::size_t page_bytes_;
+    std::vector<char*> pages_;            // aligned page starts
+    std::vector<char*> memory_;           // as the page source returned them
+    std::vector<unsigned> live_;          // live slots per page
+    std::vector<unsigned> partial_;       // pages with a free slot
+    std::vector<bool> in_partial_;
+    OAStats stats_;
+
+      // Make private to prevent copy construction and assignment
+    SoAPool(const SoAPool& pool);
+    SoAPool& operator=(const SoAPool& pool);
+
+    void AddPage(void) OA_THROW(OAException);
+    void Reserve(std::size_t pages) OA_THROW(OAException);
+    unsigned long long* Mask(unsigned page) const;
+    void* FieldArray(unsigned page, unsigned field) const;
+    static std::size_t RoundUp(std::size_t bytes);
+};
+
+/******************************************************************************/
+/*!
+      \brief
+       Constructor for the SoAPool class, lays out a page: the occupancy
+       mask, then one aligned array per field
+
+      \param config
+        page size (ObjectsPerPage_), page budget and page source
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+SoAPool<Fields...>::SoAPool(const OAConfig& config) OA_THROW(OAException)
+  : config_(config), slots_(0), words_(0), page_bytes_(0)
+{
+  static_assert(sizeof...(Fields) > 0, "SoAPool needs at least one field");
+  static_assert(OAAllTrivial<Fields...>::value, "SoAPool fields must be trivially copyable");
+
+  words_ = (config_.ObjectsPerPage_ + 63) / 64;
+  if(!words_)
+    words_ = 1;
+  slots_ = words_ * 64;
+
+  const std::size_t sizes[] = { sizeof(Fields)... };
+  page_bytes_ = RoundUp(words_ * sizeof(unsigned long long));
+  stats_.ObjectSize_ = 0;
+  for(unsigned field = 0; field < FIELDS; ++field)
+  {
+    offsets_[field] = page_bytes_;
+    page_bytes_ += RoundUp(sizes[field] * slots_);
+    stats_.ObjectSize_ += static_cast<unsigned>(sizes[field]);
+  }
+  stats_.PageSize_ = static_cast<unsigned>(page_bytes_ + ALIGNMENT - 1);
+
+  AddPage();
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Destructor for the SoAPool class, gives every page back
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+SoAPool<Fields...>::~SoAPool() OA_NOTHROW
+{
+  for(unsigned page = 0; page < memory_.size(); ++page)
+  {
+    if(config_.PageSource_)
+      config_.PageSource_->FreePage(memory_[page], stats_.PageSize_);
+    else
+      delete [] memory_[page];
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Takes the lowest free slot of a page that has one, adding a page
+       if none has
+
+      \return
+        the slot's handle
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+typename SoAPool<Fields...>::Handle SoAPool<Fields...>::Allocate(void) OA_THROW(OAException)
+{
+    //pages in partial_ may have filled up since, drop those
+  while(!partial_.empty() && live_[partial_.back()] == slots_)
+  {
+    in_partial_[partial_.back()] = false;
+    partial_.pop_back();
+  }
+  if(partial_.empty())
+    AddPage();
+
+  unsigned page = partial_.back();
+  unsigned long long* mask = Mask(page);
+  unsigned word = 0;
+  while(!~mask[word])
+    ++word;
+
+  unsigned long long free_bits = ~mask[word];
+  unsigned bit = 0;
+  while(!((free_bits >> bit) & 1))
+    ++bit;
+  mask[word] |= 1ULL << bit;
+
+  unsigned slot = word * 64 + bit;
+  const std::size_t sizes[] = { sizeof(Fields)... };
+  for(unsigned field = 0; field < FIELDS; ++field)
+    std::memset(static_cast<char*>(FieldArray(page, field)) + slot * sizes[field], 0, sizes[field]);
+
+  ++live_[page];
+  --stats_.FreeObjects_;
+  ++stats_.ObjectsInUse_;
+  ++stats_.Allocations_;
+  if(stats_.MostObjects_ < stats_.ObjectsInUse_)
+    stats_.MostObjects_ = stats_.ObjectsInUse_;
+
+  return page * slots_ + slot;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Clears a slot's occupancy bit, its page can take new objects again
+
+      \param Object
+        the slot's handle
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+void SoAPool<Fields...>::Free(Handle Object) OA_THROW(OAException)
+{
+  unsigned page = Object / slots_;
+  if(Object == NO_HANDLE || page >= pages_.size())
+    throw OAException(OAException::E_BAD_ADDRESS, "Free: Handle not on a page.");
+
+  unsigned slot = Object % slots_;
+  unsigned long long* mask = Mask(page);
+  unsigned long long bit = 1ULL << (slot % 64);
+  if(!(mask[slot / 64] & bit))
+    throw OAException(OAException::E_MULTIPLE_FREE, "Free: Object has already been freed.");
+  mask[slot / 64] &= ~bit;
+
+  --live_[page];
+  if(!in_partial_[page])
+  {
+    partial_.push_back(page);
+    in_partial_[page] = true;
+  }
+
+  ++stats_.FreeObjects_;
+  --stats_.ObjectsInUse_;
+  ++stats_.Deallocations_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns true if a handle names a live object
+
+      \param Object
+        the slot's handle
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+bool SoAPool<Fields...>::IsLive(Handle Object) const
+{
+  unsigned page = Object / slots_;
+  if(Object == NO_HANDLE || page >= pages_.size())
+    return false;
+  unsigned slot = Object % slots_;
+  return (Mask(page)[slot / 64] >> (slot % 64)) & 1;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns the number of slots on each page (and in each span)
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+unsigned SoAPool<Fields...>::SlotsPerPage(void) const
+{
+  return slots_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns the statistics for the pool, ObjectSize_ is the bytes of
+       one object's fields
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+OAStats SoAPool<Fields...>::GetStats(void) const
+{
+  return stats_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Gets a page from the page source (or new), aligns it and clears
+       its mask. The bookkeeping makes room for the page before it is
+       taken, so a page is never lost. Out of pages or memory, the
+       reclaim handlers get to free some first (once).
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+void SoAPool<Fields...>::AddPage(void) OA_THROW(OAException)
+{
+  char* memory = NULL;
+  for(bool reclaimed = false;; reclaimed = true)
+  {
+    try
+    {
+      if(config_.MaxPages_ && pages_.size() == config_.MaxPages_)
+        throw OAException(OAException::E_NO_PAGES, "AddPage: The maximum number of pages has been allocated.");
+      Reserve(pages_.size() + 1);
+      if(config_.PageSource_)
+        memory = config_.PageSource_->AllocatePage(stats_.PageSize_);
+      else
+        memory = new (std::nothrow) char[stats_.PageSize_];
+      if(!memory)
+        throw OAException(OAException::E_NO_MEMORY, "AddPage: No system memory available.");
+      break;
+    }
+    catch(const OAException& e)
+    {
+      if(reclaimed || !config_.ReclaimHandlers_ ||
+          (e.code() != OAException::E_NO_PAGES && e.code() != OAException::E_NO_MEMORY) ||
+          !config_.ReclaimHandlers_->Run())
+        throw;
+    }
+
+      //a handler may have freed slots of ours
+    if(!partial_.empty())
+      return;
+  }
+
+  std::size_t misalignment = reinterpret_cast<std::size_t>(memory) % ALIGNMENT;
+  char* page = memory + (misalignment ? ALIGNMENT - misalignment : 0);
+  std::memset(page, 0, words_ * sizeof(unsigned long long));
+
+    //can't throw, reserved
+  memory_.push_back(memory);
+  pages_.push_back(page);
+  live_.push_back(0);
+  in_partial_.push_back(true);
+  partial_.push_back(static_cast<unsigned>(pages_.size() - 1));
+
+  ++stats_.PagesInUse_;
+  stats_.FreeObjects_ += slots_;
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Makes room in the bookkeeping vectors for a number of pages,
+       doubling them when they grow so adding pages stays cheap
+
+      \param pages
+        how many pages they must hold
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+void SoAPool<Fields...>::Reserve(std::size_t pages) OA_THROW(OAException)
+{
+  if(pages <= memory_.capacity() && pages <= pages_.capacity() && pages <= live_.capacity() &&
+      pages <= in_partial_.capacity() && pages <= partial_.capacity())
+    return;
+  pages = std::max(pages, 2 * memory_.capacity());
+
+  try
+  {
+    memory_.reserve(pages);
+    pages_.reserve(pages);
+    live_.reserve(pages);
+    in_partial_.reserve(pages);
+    partial_.reserve(pages);
+  }
+  catch(const std::bad_alloc&)
+  {
+    throw OAException(OAException::E_NO_MEMORY, "AddPage: No system memory available.");
+  }
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns the occupancy mask of a page
+
+      \param page
+        the page's index
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+unsigned long long* SoAPool<Fields...>::Mask(unsigned page) const
+{
+  return reinterpret_cast<unsigned long long*>(pages_[page]);
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       returns the start of one field's array on a page
+
+      \param page
+        the page's index
+
+      \param field
+        the field's index
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+void* SoAPool<Fields...>::FieldArray(unsigned page, unsigned field) const
+{
+  return pages_[page] + offsets_[field];
+}
+
+/******************************************************************************/
+/*!
+      \brief
+       Rounds a size up to a multiple of ALIGNMENT
+
+      \param bytes
+        the size
+
+*/
+/******************************************************************************/
+template <typename... Fields>
+std::size_t SoAPool<Fields...>::RoundUp(std::size_t bytes)
+{
+  return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+#endif
@@ -0,0 +1,231 @@
+/******************************************************************************/
+/*!
+\file   benchmark-compare.cpp
+\brief
+    Compares two result files of benchmark -o (a baseline and a
+    candidate, each from several repetitions) benchmark by benchmark:
+
+    - the median of each side and the change of the candidate's median
+    - a 95% confidence interval of that change (bootstrap: the medians of
+      resampled runs, percentile interval)
+    - the p value of a two sided Mann-Whitney U test (normal
+      approximation with tie correction), which doesn't assume the times
+      are normally distributed, so a few slow runs on a noisy host don't
+      sink it
+
+    A benchmark is a regression when p is below alpha and its median got
+    slower by more than the threshold, an improvement the other way
+    round, and unchanged otherwise. Fewer than 5 runs on a side aren't
+    tested: with 3 against 3 the smallest p the test can give is 0.1,
+    so nothing could ever be significant at 0.05. Exits with 1 if
+    anything regressed (2 on bad arguments), so a CI job can fail on it.
+
+    Result files hold lines of "benchmark value" (lower is better),
+    lines starting with # are skipped.
+
+    Usage: benchmark-compare baseline candidate [threshold% [alpha]]
+           (defaults 2% and 0.05)
+
+    Build:
+      g++ -std=c++11 -O2 benchmark-compare.cpp -o benchmark-compare
+
+*/
+/******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::printf;
+
+typedef std::map<std::string, std::vector<double> > Results;
+
+const unsigned resamples = 2000;     // bootstrap
+const unsigned min_runs = 5;       // 3 v 3 can't get p below 0.1
+
+  // Reads a result file, false if it can't be opened
+bool Load(const char *file, Results &results, std::vector<std::string> &order)
+{
+  std::ifstream in(file);
+  if (!in)
+    return false;
+
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    std::string name;
+    double value;
+    if (!(fields >> name >> value))
+      continue;
+    if (results.find(name) == results.end())
+      order.push_back(name);
+    results[name].push_back(value);
+  }
+  return true;
+}
+
+double Median(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  return n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
+
+  // Deterministic random numbers for the bootstrap
+unsigned Next(unsigned &state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+  // 95% interval of the relative change of the median, in percent
+void Bootstrap(const std::vector<double> &base, const std::vector<double> &cand,
+               double &low, double &high)
+{
+  unsigned state = 2463534242u;
+  std::vector<double> changes, a(base.size()), b(cand.size());
+  changes.reserve(resamples);
+  for (unsigned r = 0; r < resamples; r++)
+  {
+    for (size_t i = 0; i < a.size(); i++)
+      a[i] = base[Next(state) % base.size()];
+    for (size_t i = 0; i < b.size(); i++)
+      b[i] = cand[Next(state) % cand.size()];
+    double median = Median(a);
+    if (median > 0)
+      changes.push_back(100.0 * (Median(b) - median) / median);
+  }
+  if (changes.empty())
+  {
+    low = high = 0;
+    return;
+  }
+  std::sort(changes.begin(), changes.end());
+  low = changes[static_cast<size_t>(0.025 * (changes.size() - 1))];
+  high = changes[static_cast<size_t>(0.975 * (changes.size() - 1))];
+}
+
+  // Two sided p value of the Mann-Whitney U test
+double MannWhitney(const std::vector<double> &base, const std::vector<double> &cand)
+{
+  std::vector<std::pair<double, int> > all;
+  for (size_t i = 0; i < base.size(); i++)
+    all.push_back(std::make_pair(base[i], 0));
+  for (size_t i = 0; i < cand.size(); i++)
+    all.push_back(std::make_pair(cand[i], 1));
+  std::sort(all.begin(), all.end());
+
+    // ranks, ties get the mean of their ranks
+  double rank_sum = 0, ties = 0;
+  size_t n = all.size();
+  for (size_t i = 0; i < n;)
+  {
+    size_t j = i;
+    while (j < n && all[j].first == all[i].first)
+      ++j;
+    double rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; k++)
+      if (all[k].second == 0)
+        rank_sum += rank;
+    double t = static_cast<double>(j - i);
+    ties += t * t * t - t;
+    i = j;
+  }
+
+  double n1 = static_cast<double>(base.size()), n2 = static_cast<double>(cand.size());
+  double u = rank_sum - n1 * (n1 + 1) / 2;
+  double mean = n1 * n2 / 2;
+  double variance = n1 * n2 / 12 * ((n1 + n2 + 1) - ties / ((n1 + n2) * (n1 + n2 - 1)));
+  if (variance <= 0)
+    return 1;
+
+    // continuity correction
+  double z = (std::fabs(u - mean) - 0.5) / std::sqrt(variance);
+  if (z < 0)
+    z = 0;
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    std::fprintf(stderr, "usage: %s baseline candidate [threshold%% [alpha]]\n", argv[0]);
+    return 2;
+  }
+  double threshold = argc > 3 ? std::atof(argv[3]) : 2.0;
+  double alpha = argc > 4 ? std::atof(argv[4]) : 0.05;
+
+  Results base, cand;
+  std::vector<std::string> order, cand_order;
+  for (int i = 1; i <= 2; i++)
+    if (!Load(argv[i], i == 1 ? base : cand, i == 1 ? order : cand_order))
+    {
+      std::fprintf(stderr, "can't read %s\n", argv[i]);
+      return 2;
+    }
+  for (size_t i = 0; i < cand_order.size(); i++)
+    if (base.find(cand_order[i]) == base.end())
+      order.push_back(cand_order[i]);
+
+  printf("%-32s %10s %10s %8s %18s %8s\n", "benchmark", "baseline", "candidate",
+         "change", "95% interval", "p");
+
+  unsigned regressions = 0, improvements = 0, untested = 0;
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    const std::string &name = order[i];
+    Results::const_iterator b = base.find(name), c = cand.find(name);
+    if (b == base.end() || c == cand.end())
+    {
+      printf("%-32s %s\n", name.c_str(), b == base.end() ? "only in candidate" : "only in baseline");
+      continue;
+    }
+
+    double base_median = Median(b->second), cand_median = Median(c->second);
+    double change = base_median > 0 ? 100.0 * (cand_median - base_median) / base_median : 0;
+    printf("%-32s %10.2f %10.2f %+7.1f%%", name.c_str(), base_median, cand_median, change);
+
+    if (b->second.size() < min_runs || c->second.size() < min_runs)
+    {
+      printf("   too few runs to test\n");
+      ++untested;
+      continue;
+    }
+
+    double low, high;
+    Bootstrap(b->second, c->second, low, high);
+    double p = MannWhitney(b->second, c->second);
+    printf("  [%+6.1f%%, %+6.1f%%] %8.4f", low, high, p);
+
+    if (p < alpha && change > threshold)
+    {
+      printf("  REGRESSION");
+      ++regressions;
+    }
+    else if (p < alpha && change < -threshold)
+    {
+      printf("  improvement");
+      ++improvements;
+    }
+    printf("\n");
+  }
+
+  printf("\n%u regressions, %u improvements (threshold %.1f%%, alpha %.3f)\n",
+         regressions, improvements, threshold, alpha);
+  if (untested)
+    std::fprintf(stderr, "warning: %u benchmarks have fewer than %u runs on a side and weren't tested\n",
+                 untested, min_runs);
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,356 @@
+/******************************************************************************/
+/*!
+\file   benchmark.cpp
+\brief
+    Timing driver for the ObjectAllocator. Every workload is run against:
+
+    - new/delete
+    - out-of-line: every call goes through AllocateSlow/FreeSlow in
+      ObjectAllocator.cpp, the layout before the inline fast path
+    - ObjectAllocator: runtime configured, inline fast path
+    - BasicObjectAllocator with every policy off
+    - CachingObjectAllocator: per CPU (or per thread) cache over a locked pool
+
+    Then, where perf_event_open works, the hardware counters of the timed
+    sections per Allocate or Free: instructions, L1D, LLC and dTLB read
+    misses and branch misses (see PerfCounters.h).
+
+    Options:
+      -r N     repetitions of every workload, the table shows medians
+      -w N     untimed warmup runs of every workload first
+      -c CPU   pin the benchmark to one CPU (Linux)
+      -o FILE  write every repetition's result, for benchmark-compare
+               (which wants at least 5 repetitions)
+
+    Every warmup and repetition runs on a new allocator, so each starts
+    from the same free list. new/delete keeps its heap, so after the
+    first run its blocks come back in the shuffled order.
+
+    Build (release):
+      g++ -std=c++11 -O2 -pthread benchmark.cpp ObjectAllocator.cpp
+          CachingObjectAllocator.cpp PerfCounters.cpp PRNG.cpp
+
+*/
+/******************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "ObjectAllocator.h"
+#include "CachingObjectAllocator.h"
+#include "PerfCounters.h"
+#include "PRNG.h"
+
+using std::printf;
+
+struct Student
+{
+  int Age;
+  long Year;
+  float GPA;
+  long ID;
+};
+
+typedef BasicObjectAllocator<DebugOffPolicy, HeadersOffPolicy,
+                             PooledPagePolicy, NoLockPolicy> ReleaseObjectAllocator;
+
+  // Exposes the out of line halves of Allocate/Free so that the old
+  // layout (a call per operation, all checks at runtime) can be timed.
+class OutOfLineAllocator : public ObjectAllocator
+{
+  public:
+    OutOfLineAllocator(unsigned ObjectSize, const OAConfig& config)
+      : ObjectAllocator(ObjectSize, config) {}
+
+    void *Allocate() { return AllocateSlow(); }
+    void Free(void *Object) { FreeSlow(Object); }
+};
+
+  // Same interface as the allocators for new/delete
+class NewDeleteAllocator
+{
+  public:
+    NewDeleteAllocator(unsigned ObjectSize, const OAConfig&) : size_(ObjectSize) {}
+
+    void *Allocate() { return new char[size_]; }
+    void Free(void *Object) { delete [] reinterpret_cast<char*>(Object); }
+
+  private:
+    unsigned size_;
+};
+
+const unsigned objects = 4096;
+const unsigned pages = 100;
+const unsigned total = objects * pages;
+const unsigned rounds = 10;
+void *ptrs[total];
+
+const unsigned allocators = 5;
+const unsigned workloads = 3;
+const char *const workload_names[workloads] = { "alloc/free", "pairs", "shuffled" };
+const char *allocator_names[allocators];
+
+unsigned repetitions = 1;
+unsigned warmups = 0;
+FILE *results = 0;                        // -o, NULL if not asked for
+
+OAPerfCounters counters;
+  // per Allocate or Free (mean of the repetitions), by allocator,
+  // workload and counter
+double per_op[allocators][workloads][OAPerfCounters::COUNTERS];
+
+template <typename T>
+void Shuffle(T *array, unsigned count)
+{
+  for (unsigned int i = 0; i < count; i++)
+  {
+    int r = Digipen::Utils::Random(i, (int)count - 1);
+    T temp = array[i];
+    array[i] = array[r];
+    array[r] = temp;
+  }
+}
+
+double Now(void)
+{
+  typedef std::chrono::steady_clock clock;
+  return std::chrono::duration<double, std::nano>(clock::now().time_since_epoch()).count();
+}
+
+  // Allocate everything, free in the same (LIFO friendly) order
+template <typename Allocator>
+double AllocThenFree(Allocator &oa)
+{
+  counters.Start();
+  double start = Now();
+  for (unsigned r = 0; r < rounds; r++)
+  {
+    for (unsigned i = 0; i < total; i++)
+      ptrs[i] = oa.Allocate();
+    for (unsigned i = total; i > 0; i--)
+      oa.Free(ptrs[i - 1]);
+  }
+  double ns = (Now() - start) / (2.0 * rounds * total);
+  counters.Stop();
+  return ns;
+}
+
+  // Short lived objects: allocate, touch, free
+template <typename Allocator>
+double AllocFreePairs(Allocator &oa)
+{
+  unsigned sum = 0;
+  counters.Start();
+  double start = Now();
+  for (unsigned i = 0; i < rounds * total; i++)
+  {
+    Student *s = reinterpret_cast<Student *>(oa.Allocate());
+    s->Age = i;
+    sum += s->Age;
+    oa.Free(s);
+  }
+  double ns = (Now() - start) / (2.0 * rounds * total);
+  counters.Stop();
+  if (sum == 1)
+    printf(" ");
+  return ns;
+}
+
+  // Allocate everything, free in random order (the Stress test)
+template <typename Allocator>
+double AllocShuffledFree(Allocator &oa)
+{
+  double elapsed = 0;
+  for (unsigned r = 0; r < rounds; r++)
+  {
+    counters.Start();
+    double start = Now();
+    for (unsigned i = 0; i < total; i++)
+      ptrs[i] = oa.Allocate();
+    elapsed += Now() - start;
+    counters.Stop();
+
+    Shuffle(ptrs, total);
+
+    counters.Start();
+    start = Now();
+    for (unsigned i = 0; i < total; i++)
+      oa.Free(ptrs[i]);
+    elapsed += Now() - start;
+    counters.Stop();
+  }
+  return elapsed / (2.0 * rounds * total);
+}
+
+  // Adds the counters of the workload that just ran, per operation
+void Record(unsigned allocator, unsigned workload)
+{
+  for (int c = 0; c < OAPerfCounters::COUNTERS; c++)
+    per_op[allocator][workload][c] +=
+      counters.Value(static_cast<OAPerfCounters::COUNTER>(c)) / (2.0 * rounds * total * repetitions);
+  counters.Reset();
+}
+
+double Median(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+  unsigned n = static_cast<unsigned>(samples.size());
+  return n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
+
+  // One run of every workload on a new allocator, so each repetition
+  // starts from the same free list. Counters are recorded if index is
+  // an allocator's, ns gets the times.
+template <typename Allocator>
+void RunWorkloads(int index, std::vector<double> *ns)
+{
+  OAConfig config(false, objects, pages, false, 0, 0, 0);
+  Allocator oa(sizeof(Student), config);
+
+    // grow every page once so no workload pays for page allocation
+  for (unsigned i = 0; i < total; i++)
+    ptrs[i] = oa.Allocate();
+  for (unsigned i = 0; i < total; i++)
+    oa.Free(ptrs[i]);
+
+  Digipen::Utils::srand(521288629, 362436069);
+  counters.Reset();
+  double lifo = AllocThenFree(oa);
+  if (index >= 0)
+    Record(index, 0);
+  double pairs = AllocFreePairs(oa);
+  if (index >= 0)
+    Record(index, 1);
+  double shuffled = AllocShuffledFree(oa);
+  if (index >= 0)
+    Record(index, 2);
+
+  ns[0].push_back(lifo);
+  ns[1].push_back(pairs);
+  ns[2].push_back(shuffled);
+}
+
+template <typename Allocator>
+void RunAllocator(unsigned index, const char *name)
+{
+    // warm caches, branch predictors and the CPU's clock up
+  std::vector<double> ns[workloads];
+  for (unsigned w = 0; w < warmups; w++)
+    RunWorkloads<Allocator>(-1, ns);
+
+  for (unsigned w = 0; w < workloads; w++)
+    ns[w].clear();
+  for (unsigned r = 0; r < repetitions; r++)
+    RunWorkloads<Allocator>(index, ns);
+
+  allocator_names[index] = name;
+  printf("%-22s %12.2f %12.2f %12.2f\n", name, Median(ns[0]), Median(ns[1]), Median(ns[2]));
+  if (results)
+    for (unsigned w = 0; w < workloads; w++)
+      for (unsigned r = 0; r < repetitions; r++)
+        std::fprintf(results, "%s:%s %.4f\n", name, workload_names[w], ns[w][r]);
+}
+
+  // Runs the calling thread on one CPU only
+bool Pin(int cpu)
+{
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+  // A table per workload of the counters per Allocate or Free
+void PrintCounters(void)
+{
+  if (!counters.AnyAvailable())
+  {
+    printf("\nHardware counters unavailable (%s)\n", counters.Error());
+    return;
+  }
+
+  for (unsigned w = 0; w < workloads; w++)
+  {
+    printf("\n%s, per Allocate or Free\n%-22s", workload_names[w], "");
+    for (int c = 0; c < OAPerfCounters::COUNTERS; c++)
+      printf(" %14s", OAPerfCounters::Name(static_cast<OAPerfCounters::COUNTER>(c)));
+    printf("\n");
+
+    for (unsigned a = 0; a < allocators; a++)
+    {
+      printf("%-22s", allocator_names[a]);
+      for (int c = 0; c < OAPerfCounters::COUNTERS; c++)
+        if (counters.Available(static_cast<OAPerfCounters::COUNTER>(c)))
+          printf(" %14.3f", per_op[a][w][c]);
+        else
+          printf(" %14s", "n/a");
+      printf("\n");
+    }
+  }
+  if (*counters.Error())
+    printf("\nn/a: %s\n", counters.Error());
+}
+
+int main(int argc, char **argv)
+{
+  int cpu = -1;
+  for (int i = 1; i < argc; i++)
+  {
+    bool value = i + 1 < argc;
+    if (!std::strcmp(argv[i], "-r") && value)
+      repetitions = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "-w") && value)
+      warmups = std::max(0, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "-c") && value)
+      cpu = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "-o") && value)
+    {
+      results = std::fopen(argv[++i], "w");
+      if (!results)
+      {
+        std::fprintf(stderr, "can't write %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: %s [-r repetitions] [-w warmups] [-c cpu] [-o results]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (cpu >= 0 && !Pin(cpu))
+    std::fprintf(stderr, "can't pin to CPU %d, running unpinned\n", cpu);
+  if (results)
+    std::fprintf(results, "# %u objects of %u bytes, %u rounds, %u repetitions, %u warmups, cpu %d\n",
+                 total, (unsigned)sizeof(Student), rounds, repetitions, warmups, cpu);
+
+  printf("%u objects of %u bytes, %u rounds, ns per Allocate or Free", total,
+         (unsigned)sizeof(Student), rounds);
+  if (repetitions > 1)
+    printf(" (median of %u)", repetitions);
+  printf("\n\n");
+  printf("%-22s %12s %12s %12s\n", "", "alloc/free", "pairs", "shuffled");
+  RunAllocator<NewDeleteAllocator>(0, "new/delete");
+  RunAllocator<OutOfLineAllocator>(1, "out-of-line");
+  RunAllocator<ObjectAllocator>(2, "ObjectAllocator");
+  RunAllocator<ReleaseObjectAllocator>(3, "BasicObjectAllocator");
+  RunAllocator<CachingObjectAllocator>(4, "CachingObjectAllocator");
+  PrintCounters();
+  if (results)
+    std::fclose(results);
+  return 0;
+}
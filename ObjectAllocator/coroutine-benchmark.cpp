@@ -0,0 +1,156 @@
+/******************************************************************************/
+/*!
+\file   coroutine-benchmark.cpp
+\brief
+    Frame creation throughput of C++20 coroutines whose frames come from
+    the global heap against ones whose promise uses OAPooledPromise.
+
+    - one at a time: create, run to completion, destroy
+    - batches: many suspended coroutines alive at once, destroyed in
+      creation order
+    - across threads: created on one thread, destroyed on another
+
+    Build (release):
+      g++ -std=c++20 -O2 -pthread coroutine-benchmark.cpp
+          CoroutineFramePool.cpp ConcurrentObjectAllocator.cpp
+          ObjectAllocator.cpp
+
+*/
+/******************************************************************************/
+
+#include <cstdio>
+#include <chrono>
+#include <coroutine>
+#include <thread>
+#include <vector>
+
+#include "CoroutineFramePool.h"
+
+using std::printf;
+
+const unsigned frames = 1000000;
+const unsigned batch = 1000;
+
+  // A lazily started coroutine that yields once, the caller owns it.
+  // Base picks where its frame comes from.
+template <typename Base>
+class Task
+{
+  public:
+    struct promise_type : Base
+    {
+      int value;
+
+      Task get_return_object()
+      {
+        return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+      std::suspend_always yield_value(int v) { value = v; return {}; }
+      void return_void() {}
+      void unhandled_exception() {}
+    };
+
+    Task(Task &&other) : handle_(other.handle_) { other.handle_ = nullptr; }
+    ~Task() { if (handle_) handle_.destroy(); }
+
+    int Next()
+    {
+      handle_.resume();
+      return handle_.promise().value;
+    }
+
+  private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+
+struct HeapFrame {};
+
+template <typename Base>
+Task<Base> Work(int seed)
+{
+  int locals[16];   // a frame of a few hundred bytes
+  for (int i = 0; i < 16; ++i)
+    locals[i] = seed + i;
+  int sum = 0;
+  for (int i = 0; i < 16; ++i)
+    sum += locals[i];
+  co_yield sum;
+}
+
+double Now(void)
+{
+  typedef std::chrono::steady_clock clock;
+  return std::chrono::duration<double, std::nano>(clock::now().time_since_epoch()).count();
+}
+
+template <typename Base>
+double OneAtATime(void)
+{
+  long sum = 0;
+  double start = Now();
+  for (unsigned i = 0; i < frames; ++i)
+    sum += Work<Base>(i).Next();
+  double ns = (Now() - start) / frames;
+  if (sum == 1)
+    printf(" ");
+  return ns;
+}
+
+template <typename Base>
+double Batches(void)
+{
+  std::vector<Task<Base> > tasks;
+  tasks.reserve(batch);
+  long sum = 0;
+  double start = Now();
+  for (unsigned i = 0; i < frames / batch; ++i)
+  {
+    for (unsigned j = 0; j < batch; ++j)
+      tasks.push_back(Work<Base>(j));
+    for (unsigned j = 0; j < batch; ++j)
+      sum += tasks[j].Next();
+    tasks.clear();
+  }
+  double ns = (Now() - start) / frames;
+  if (sum == 1)
+    printf(" ");
+  return ns;
+}
+
+template <typename Base>
+double AcrossThreads(void)
+{
+  double start = Now();
+  for (unsigned i = 0; i < frames / batch / 10; ++i)
+  {
+    std::vector<Task<Base> > tasks;
+    tasks.reserve(batch);
+    for (unsigned j = 0; j < batch; ++j)
+      tasks.push_back(Work<Base>(j));
+    std::thread consumer([&tasks] { tasks.clear(); });
+    consumer.join();
+  }
+  return (Now() - start) / (frames / 10);
+}
+
+template <typename Base>
+void Run(const char *name)
+{
+  OneAtATime<Base>();   // warm up (pools, caches)
+  double single = OneAtATime<Base>();
+  double batches = Batches<Base>();
+  double threads = AcrossThreads<Base>();
+  printf("%-22s %12.2f %12.2f %12.2f\n", name, single, batches, threads);
+}
+
+int main(void)
+{
+  printf("%u coroutine frames, ns per create + resume + destroy\n\n", frames);
+  printf("%-22s %12s %12s %12s\n", "", "one at a time", "batches", "threads");
+  Run<HeapFrame>("global heap");
+  Run<OAPooledPromise>("OAPooledPromise");
+  return 0;
+}
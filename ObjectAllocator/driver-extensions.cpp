@@ -0,0 +1,1332 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#include <exception>
+#endif
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using std::cout;
+using std::endl;
+
+//#define SHOW_EXCEPTIONS
+
+#include "ObjectAllocator.h"
+#include "ConcurrentObjectAllocator.h"
+#include "SharedObjectAllocator.h"
+#include "CoroutineFramePool.h"
+#include "CachingObjectAllocator.h"
+#include "SoAPool.h"
+
+struct Student
+{
+  int Age;
+  long Year;
+  float GPA;
+  long ID;
+};
+
+  // A node of a list kept in a shared segment, linked by offsets
+struct Record
+{
+  unsigned Next;
+  int Value;
+};
+
+unsigned failures = 0;
+unsigned handlerCalls = 0;
+
+unsigned destroyed = 0;
+
+void CountDestroyed(void *)
+{
+  ++destroyed;
+}
+
+void CountDumped(const void *, unsigned)
+{
+}
+
+  // An object that stays constructed while it is free, the allocator
+  // only writes Scratch
+struct Cached
+{
+  int ID;
+  char Name[20];
+  void *Scratch[2];
+};
+
+unsigned constructed = 0;
+
+void ConstructCached(void *object)
+{
+  Cached *cached = new (object) Cached;
+  cached->ID = ++constructed;
+  std::strcpy(cached->Name, "constructed");
+}
+
+void DestroyCached(void *object)
+{
+  static_cast<Cached *>(object)->~Cached();
+  ++destroyed;
+}
+
+#ifdef __cpp_impl_coroutine
+  // A coroutine that starts right away and has no result
+struct Task
+{
+  struct promise_type
+  {
+    Task get_return_object() { return Task(); }
+    std::suspend_never initial_suspend() { return std::suspend_never(); }
+    std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+  // Takes a block, waiting for one if there is none, and records the order
+Task AwaitBlock(ConcurrentObjectAllocator &oa, std::vector<void *> &blocks)
+{
+  void *block = co_await oa.AllocateAsync();
+  blocks.push_back(block);
+}
+#endif
+
+  // A reclaim handler that gives back another pool's empty pages
+bool ShrinkPool(void *pool)
+{
+  ++handlerCalls;
+  return static_cast<ObjectAllocator *>(pool)->FreeEmptyPages() > 0;
+}
+
+  // A reclaim handler that always claims to have freed something
+bool ClaimFreed(void *)
+{
+  ++handlerCalls;
+  return true;
+}
+
+// Support functions
+void PrintCounts(const OAStats &stats);
+void Check(bool passed, const char *what);
+void CheckThrows(void (*fn)(void), OAException::OA_EXCEPTION code, const char *what);
+
+void TestRemoteFrees(void);        // concurrent: frees from another thread
+void TestRemoteReuse(void);        // concurrent: the owner takes its blocks back
+void TestMemfdRoundTrip(void);     // shared: a second mapping of a memfd
+void TestCrashRecovery(void);      // shared: a file reopened after a crash
+void TestRetireReclaim(void);      // concurrent: retired blocks wait for readers
+void TestRingReuse(void);          // ring: empty pages further round come back
+void TestRingErrors(void);         // ring: double free, no runs
+void TestOrdered(void);            // address ordered: lowest block first
+void TestOrderedPages(void);       // address ordered: pages coming and going
+void TestTenants(void);            // tenant tags, quotas
+void TestContiguous(void);         // runs of blocks
+void TestRunReclaim(void);         // runs: handlers run once, then E_NO_PAGES
+void TestFrameAlignment(void);     // frame pool: every frame 16 byte aligned
+void TestPassThrough(void);        // new/delete mode: leaks, double frees
+void TestStealing(void);           // concurrent: empty pages move between heaps
+void TestObjectCaching(void);      // constructor/destructor callbacks, scratch region
+void BadScratchRegion(void);
+void MisalignedScratch(void);
+void TestPolicies(void);           // compile time policies override the config
+void TestCaches(bool PerCpu);      // caching: per CPU (rseq) or per thread caches
+void TestCacheDecay(void);         // caching: decay, flush at exit, FreeEmptyPages
+void TestNodes(void);              // concurrent: made up NUMA nodes, per node stats
+void TestWaiters(void);            // concurrent: AllocateWait, AllocateAsync hand-offs
+void TestMemoryBudget(void);       // pools sharing a budget, reclaim handlers
+void TestSoAPool(void);            // structure of arrays: fields, live masks
+
+void PrintCounts(const OAStats &stats)
+{
+  cout << "Pages in use: " << stats.PagesInUse_;
+  cout << ", Objects in use: " << stats.ObjectsInUse_;
+  cout << ", Available objects: " << stats.FreeObjects_;
+  cout << ", Allocs: " << stats.Allocations_;
+  cout << ", Frees: " << stats.Deallocations_ << endl;
+}
+
+void Check(bool passed, const char *what)
+{
+  cout << (passed ? "passed: " : "FAILED: ") << what << endl;
+  if (!passed)
+    ++failures;
+}
+
+void CheckThrows(void (*fn)(void), OAException::OA_EXCEPTION code, const char *what)
+{
+  try
+  {
+    fn();
+    Check(false, what);
+  }
+  catch (const OAException &e)
+  {
+#ifdef SHOW_EXCEPTIONS
+    cout << e.what() << endl;
+#endif
+    Check(e.code() == code, what);
+  }
+}
+
+void TestRemoteFrees(void)
+{
+  OAConfig config(false, 8, 0, false, 0, 0, 0);
+  ConcurrentObjectAllocator oa(sizeof(Student), config);
+
+  void *ptrs[20];
+  for (unsigned i = 0; i < 20; i++)
+    ptrs[i] = oa.Allocate();
+  PrintCounts(oa.GetStats());
+
+    // a thread that never allocates frees 12 of them
+  std::thread other([&]() {
+    for (unsigned i = 0; i < 12; i++)
+      oa.Free(ptrs[i]);
+  });
+  other.join();
+
+  OAStats stats = oa.GetStats();
+  PrintCounts(stats);
+  cout << "Remote frees: " << stats.RemoteFrees_ << ", Heaps: " << oa.HeapCount() << endl;
+  Check(stats.RemoteFrees_ == 12, "every free from the other thread went to the owner's queue");
+  Check(oa.HeapCount() == 1, "freeing gives the other thread no heap");
+  Check(stats.ObjectsInUse_ == 20, "queued remote frees are in use until the owner takes them");
+
+    // frees from the owner aren't remote
+  for (unsigned i = 12; i < 20; i++)
+    oa.Free(ptrs[i]);
+  stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(stats.RemoteFrees_ == 12, "the owner's own frees stay local");
+
+    // the free list runs dry on the 13th, the queue is taken back
+  for (unsigned i = 0; i < 13; i++)
+    ptrs[i] = oa.Allocate();
+  for (unsigned i = 0; i < 13; i++)
+    oa.Free(ptrs[i]);
+  stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(stats.PagesInUse_ == 3, "the queue was taken back before a new page");
+  Check(stats.ObjectsInUse_ == 0 && stats.Allocations_ == stats.Deallocations_, "everything came back");
+}
+
+void TestRemoteReuse(void)
+{
+  OAConfig config(false, 8, 0, false, 0, 0, 0);
+  ConcurrentObjectAllocator oa(sizeof(Student), config);
+
+  void *ptrs[24];
+  for (unsigned i = 0; i < 24; i++)
+    ptrs[i] = oa.Allocate();
+  unsigned pages = oa.GetStats().PagesInUse_;
+
+  std::thread other([&]() {
+    for (unsigned i = 0; i < 24; i++)
+      oa.Free(ptrs[i]);
+  });
+  other.join();
+
+    // the owner's free list is dry: the queue is taken back before a page
+  for (unsigned i = 0; i < 24; i++)
+    ptrs[i] = oa.Allocate();
+  OAStats stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(stats.PagesInUse_ == pages, "remotely freed blocks are reused before a new page");
+
+  for (unsigned i = 0; i < 24; i++)
+    oa.Free(ptrs[i]);
+  PrintCounts(oa.GetStats());
+}
+
+void TestMemfdRoundTrip(void)
+{
+  OAConfig config(false, 16, 4, false, 0, 0, 0);
+  SharedObjectAllocator oa(NULL, sizeof(Record), config);
+
+  Record *head = NULL;
+  for (int i = 0; i < 40; i++)
+  {
+    Record *record = reinterpret_cast<Record *>(oa.Allocate());
+    record->Value = i;
+    record->Next = head ? oa.OffsetOf(head) : 0;
+    head = record;
+  }
+  oa.SetRoot(head);
+  PrintCounts(oa.GetStats());
+
+    // a second mapping, as a process handed the descriptor would make
+  SharedObjectAllocator other(oa.Fd());
+  int sum = 0, count = 0;
+  for (Record *record = reinterpret_cast<Record *>(other.Root()); record;
+       record = record->Next ? reinterpret_cast<Record *>(other.AtOffset(record->Next)) : NULL)
+  {
+    sum += record->Value;
+    ++count;
+  }
+  cout << "Records: " << count << ", Sum: " << sum << endl;
+  Check(count == 40 && sum == 780, "the other mapping reads the list through offsets");
+  Check(other.GetConfig().MaxPages_ == 4, "the layout comes from the segment");
+
+    // a block freed through one mapping is free in the other
+  void *block = other.AtOffset(oa.OffsetOf(head));
+  other.SetRoot(other.AtOffset(head->Next));
+  other.Free(block);
+  PrintCounts(oa.GetStats());
+  Check(oa.GetStats().ObjectsInUse_ == 39, "a free through the other mapping shows in both");
+
+  Student outside;
+  try
+  {
+    other.Free(&outside);
+    Check(false, "a block from outside the segment is refused");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_ADDRESS, "a block from outside the segment is refused");
+  }
+}
+
+void TestCrashRecovery(void)
+{
+  char path[] = "/tmp/driver-extensions-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+  {
+    Check(false, "a temporary file for the segment");
+    return;
+  }
+  close(fd);   // empty, the allocator formats it
+
+  OAConfig config(false, 16, 8, false, 0, 0, 0);
+  {
+    SharedObjectAllocator oa(path, sizeof(Record), config, true);
+    Record *head = NULL;
+    for (int i = 0; i < 50; i++)
+    {
+      Record *record = reinterpret_cast<Record *>(oa.Allocate());
+      record->Value = i;
+      record->Next = head ? oa.OffsetOf(head) : 0;
+      head = record;
+    }
+    oa.SetRoot(head);
+  }
+
+    // a process that dies without unmapping, half way through its work
+  pid_t child = fork();
+  if (child < 0)
+  {
+    Check(false, "a process to crash");
+    unlink(path);
+    return;
+  }
+  if (!child)
+  {
+    SharedObjectAllocator *oa = new SharedObjectAllocator(path, sizeof(Record), config, true);
+    std::vector<void *> ptrs;
+    for (int i = 0; i < 30; i++)
+      ptrs.push_back(oa->Allocate());
+    for (int i = 0; i < 30; i += 2)
+      oa->Free(ptrs[i]);
+    _exit(0);
+  }
+  waitpid(child, NULL, 0);
+
+  {
+    SharedObjectAllocator oa(path, sizeof(Record), config, true);
+    int sum = 0, count = 0;
+    for (Record *record = reinterpret_cast<Record *>(oa.Root()); record;
+         record = record->Next ? reinterpret_cast<Record *>(oa.AtOffset(record->Next)) : NULL)
+    {
+      sum += record->Value;
+      ++count;
+    }
+    OAStats stats = oa.GetStats();
+    PrintCounts(stats);
+    cout << "Records: " << count << ", Sum: " << sum << endl;
+    Check(count == 50 && sum == 1225, "the list survives the crash");
+    Check(stats.ObjectsInUse_ == 65, "the crashed process's blocks are still in use");
+
+      // every free block can be taken once, none is a live record
+    std::vector<void *> ptrs;
+    for (unsigned i = stats.FreeObjects_; i; --i)
+      ptrs.push_back(oa.Allocate());
+    bool clash = false;
+    for (Record *record = reinterpret_cast<Record *>(oa.Root()); record;
+         record = record->Next ? reinterpret_cast<Record *>(oa.AtOffset(record->Next)) : NULL)
+      for (unsigned i = 0; i < ptrs.size(); i++)
+        if (ptrs[i] == record)
+          clash = true;
+    Check(!clash, "no free block is a live record");
+    for (unsigned i = 0; i < ptrs.size(); i++)
+      oa.Free(ptrs[i]);
+  }
+
+  try
+  {
+    SharedObjectAllocator oa(path, sizeof(Record) * 2, config, true);
+    Check(false, "another layout is refused");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_SEGMENT, "another layout is refused");
+  }
+  unlink(path);
+}
+
+void TestRetireReclaim(void)
+{
+  OAConfig config(false, 8, 0, false, 0, 0, 0);
+  {
+      // blocks have no retired link unless asked for
+    ConcurrentObjectAllocator plain(sizeof(Student), config);
+    void *block = plain.Allocate();
+    try
+    {
+      plain.RetireObject(block);
+      Check(false, "RetireObject needs RetireBlocks_");
+    }
+    catch (const OAException &e)
+    {
+      Check(e.code() == OAException::E_BAD_CONFIG, "RetireObject needs RetireBlocks_");
+    }
+    plain.Free(block);
+  }
+
+  config.RetireBlocks_ = true;
+  ConcurrentObjectAllocator oa(sizeof(Student), config);
+
+  Student *student = reinterpret_cast<Student *>(oa.Allocate());
+  student->ID = 1234;
+
+    // a reader is still in: nothing retired after it came in is freed
+  oa.EnterCritical();
+  oa.RetireObject(student);
+  oa.Reclaim();
+  OAStats stats = oa.GetStats();
+  PrintCounts(stats);
+  cout << "Retired: " << stats.RetiredObjects_ << endl;
+  Check(stats.RetiredObjects_ == 1 && stats.ObjectsInUse_ == 1, "a retired block waits for the reader");
+  Check(student->ID == 1234, "the reader still sees the block's contents");
+
+  void *other = oa.Allocate();
+  Check(other != student, "a retired block isn't handed out again");
+
+  oa.ExitCritical();
+  unsigned freed = oa.Reclaim();
+  stats = oa.GetStats();
+  PrintCounts(stats);
+  cout << "Reclaimed: " << freed << ", Retired: " << stats.RetiredObjects_ << endl;
+  Check(freed == 1 && stats.RetiredObjects_ == 0, "the reader left, the block is freed");
+
+    // blocks retired with no reader in are freed by the next Reclaim
+  oa.RetireObject(other);
+  oa.Reclaim();
+  stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(stats.ObjectsInUse_ == 0 && stats.RetiredObjects_ == 0, "everything retired was freed");
+}
+
+void TestRingReuse(void)
+{
+  OAConfig config(false, 4, 3, false, 0, 0, 0);
+  config.Ring_ = true;
+  ObjectAllocator oa(sizeof(Student), config);
+
+  void *ptrs[12];
+  for (unsigned i = 0; i < 12; i++)
+    ptrs[i] = oa.Allocate();
+  PrintCounts(oa.GetStats());
+
+    // the second page empties, the first (next after the head) doesn't
+  for (unsigned i = 4; i < 8; i++)
+    oa.Free(ptrs[i]);
+  oa.Free(ptrs[0]);
+  void *block = oa.Allocate();
+  PrintCounts(oa.GetStats());
+  Check(block == ptrs[4], "the head moves on to an empty page further round");
+
+  for (unsigned i = 5; i < 8; i++)
+    ptrs[i] = oa.Allocate();
+  ptrs[4] = block;
+  try
+  {
+    oa.Allocate();
+    Check(false, "out of order frees alone don't make room");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_NO_PAGES, "out of order frees alone don't make room");
+  }
+
+  for (unsigned i = 1; i < 12; i++)
+    oa.Free(ptrs[i]);
+  PrintCounts(oa.GetStats());
+  Check(oa.FreeEmptyPages() == 2, "every page but the head is given back");
+}
+
+ObjectAllocator *ringObjectMgr;
+
+void RingDoubleFree(void)
+{
+  void *block = ringObjectMgr->Allocate();
+  ringObjectMgr->Free(block);
+  ringObjectMgr->Free(block);
+}
+
+void RingRun(void)
+{
+  ringObjectMgr->AllocateContiguous(2);
+}
+
+void TestRingErrors(void)
+{
+  OAConfig config(false, 4, 0, false, 0, 0, 0);
+  config.Ring_ = true;
+  ObjectAllocator oa(sizeof(Student), config);
+  ringObjectMgr = &oa;
+
+  CheckThrows(RingDoubleFree, OAException::E_MULTIPLE_FREE, "a double free in the ring is caught");
+  CheckThrows(RingRun, OAException::E_BAD_RUN, "the ring has no runs");
+  PrintCounts(oa.GetStats());
+}
+
+void TestOrdered(void)
+{
+  OAConfig config(false, 4, 0, false, 0, 0, 0);
+  config.AddressOrdered_ = true;
+  ObjectAllocator oa(sizeof(Student), config);
+
+  std::vector<char *> ptrs;
+  for (unsigned i = 0; i < 12; i++)
+    ptrs.push_back(reinterpret_cast<char *>(oa.Allocate()));
+
+    // free one block high and one low, the low one comes back first
+  char *high = std::max(ptrs[1], ptrs[9]);
+  char *low = std::min(ptrs[1], ptrs[9]);
+  oa.Free(high);
+  oa.Free(low);
+  char *first = reinterpret_cast<char *>(oa.Allocate());
+  char *second = reinterpret_cast<char *>(oa.Allocate());
+  Check(first == low && second == high, "the lowest free block is handed out first");
+
+    // empty the pages and give back all but what's still in use
+  for (unsigned i = 0; i < 12; i++)
+    oa.Free(ptrs[i]);
+  PrintCounts(oa.GetStats());
+  Check(oa.FreeEmptyPages() == 3, "empty pages are given back");
+  PrintCounts(oa.GetStats());
+
+  try
+  {
+    oa.Free(ptrs[0]);
+    Check(false, "a double free is caught");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_ADDRESS || e.code() == OAException::E_MULTIPLE_FREE,
+          "a double free is caught");
+  }
+}
+
+void TestTenants(void)
+{
+  OAConfig config(false, 4, 0, true, 2, 2, 0);
+  config.TenantTags_ = true;
+  ObjectAllocator oa(sizeof(Student), config);
+
+  oa.SetTenantQuota(3, 2);
+  void *a = oa.AllocateFor(3);
+  void *b = oa.AllocateFor(3);
+  void *c = oa.AllocateFor(7);
+  unsigned pages = oa.GetStats().PagesInUse_;
+  try
+  {
+    oa.AllocateFor(3);
+    Check(false, "a tenant at its quota is refused");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_QUOTA_EXCEEDED, "a tenant at its quota is refused");
+  }
+  Check(oa.GetStats().PagesInUse_ == pages, "a refused allocation takes no page");
+
+  OATenantStats tenant = oa.GetTenantStats(3);
+  cout << "Tenant 3 in use: " << tenant.ObjectsInUse_ << ", Most: " << tenant.MostObjects_;
+  cout << ", Quota: " << tenant.Quota_ << ", Rejections: " << tenant.Rejections_ << endl;
+  Check(tenant.ObjectsInUse_ == 2 && tenant.Rejections_ == 1, "the tenant's counters");
+
+    // a free makes room under the quota again
+  oa.Free(a);
+  a = oa.AllocateFor(3);
+  Check(oa.GetTenantStats(3).ObjectsInUse_ == 2, "a freed block counts against the quota no more");
+
+  oa.Free(a);
+  oa.Free(b);
+  oa.Free(c);
+  Check(oa.GetTenantStats(3).ObjectsInUse_ == 0 && oa.GetTenantStats(7).ObjectsInUse_ == 0,
+        "frees are counted by tenant");
+  PrintCounts(oa.GetStats());
+
+  OAConfig plain(false, 4, 0, false, 0, 2, 0);
+  ObjectAllocator untagged(sizeof(Student), plain);
+  try
+  {
+    untagged.AllocateFor(1);
+    Check(false, "no tenant tags without TenantTags_");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_CONFIG, "no tenant tags without TenantTags_");
+  }
+
+  plain.HeaderBlocks_ = 1;
+  plain.TenantTags_ = true;
+  try
+  {
+    ObjectAllocator small(sizeof(Student), plain);
+    Check(false, "tenant tags need 2 header bytes");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_CONFIG, "tenant tags need 2 header bytes");
+  }
+}
+
+void TestContiguous(void)
+{
+  OAConfig config(false, 8, 0, false, 0, 0, 0);
+  ObjectAllocator oa(sizeof(Student), config);
+
+  std::vector<char *> ptrs;
+  for (unsigned i = 0; i < 8; i++)
+    ptrs.push_back(reinterpret_cast<char *>(oa.Allocate()));
+
+    // only blocks 2..4 are free back to back
+  oa.Free(ptrs[0]);
+  oa.Free(ptrs[6]);
+  for (unsigned i = 2; i < 5; i++)
+    oa.Free(ptrs[i]);
+  char *run = reinterpret_cast<char *>(oa.AllocateContiguous(3));
+  char *lowest = std::min(ptrs[2], ptrs[4]);
+  Check(run == lowest, "a run is taken from free blocks in a row");
+  Check(oa.GetStats().PagesInUse_ == 1, "no page was needed for it");
+
+  char *fresh = reinterpret_cast<char *>(oa.AllocateContiguous(8));
+  Check(oa.GetStats().PagesInUse_ == 2, "a whole page run takes a new page");
+  PrintCounts(oa.GetStats());
+
+  try
+  {
+    oa.AllocateContiguous(9);
+    Check(false, "a run longer than a page is refused");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_RUN, "a run longer than a page is refused");
+  }
+
+  oa.FreeContiguous(run, 3);
+  oa.FreeContiguous(fresh, 8);
+  oa.Free(ptrs[1]);
+  oa.Free(ptrs[5]);
+  oa.Free(ptrs[7]);
+  PrintCounts(oa.GetStats());
+  Check(oa.GetStats().ObjectsInUse_ == 0, "runs come back block by block");
+
+  OAConfig padded(false, 8, 0, false, 2, 0, 0);
+  ObjectAllocator gaps(sizeof(Student), padded);
+  try
+  {
+    gaps.AllocateContiguous(2);
+    Check(false, "pad bytes break up runs");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_RUN, "pad bytes break up runs");
+  }
+}
+
+void TestRunReclaim(void)
+{
+  OAReclaimHandlers handlers;
+  handlers.Add(ClaimFreed, NULL);
+  OAConfig config(false, 4, 1, false, 0, 0, 0);
+  config.ReclaimHandlers_ = &handlers;
+  ObjectAllocator oa(sizeof(Student), config);
+
+    // blocks 0 and 2 are free, but not in a row
+  void *ptrs[4];
+  for (unsigned i = 0; i < 4; i++)
+    ptrs[i] = oa.Allocate();
+  oa.Free(ptrs[0]);
+  oa.Free(ptrs[2]);
+
+  handlerCalls = 0;
+  try
+  {
+    oa.AllocateContiguous(2);
+    Check(false, "no run and no page left");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_NO_PAGES, "no run and no page left");
+  }
+  cout << "Handler calls: " << handlerCalls << endl;
+  Check(handlerCalls == 1, "the handlers run once per failed run");
+  PrintCounts(oa.GetStats());
+}
+
+void TestFrameAlignment(void)
+{
+  bool aligned = true, fits = true;
+  for (unsigned bucket = 0; bucket < OAFramePool::BUCKETS; bucket++)
+  {
+    unsigned size = OAFramePool::BucketSize(bucket);
+    void *frames[3];
+    for (unsigned i = 0; i < 3; i++)
+    {
+      frames[i] = OAFramePool::Allocate(size);
+      if (reinterpret_cast<uintptr_t>(frames[i]) % 16)
+        aligned = false;
+      std::memset(frames[i], 0xAB, size);
+    }
+    for (unsigned i = 0; i < 3; i++)
+      OAFramePool::Free(frames[i], size);
+    if (size < 64 || (bucket && size != 2 * OAFramePool::BucketSize(bucket - 1)))
+      fits = false;
+  }
+  Check(aligned, "every frame of every bucket is 16 byte aligned");
+  Check(fits, "buckets are 64 bytes and up, doubling");
+  Check(OAFramePool::BucketSize(OAFramePool::BUCKETS) == 0, "no bucket past the last");
+}
+
+void TestPassThrough(void)
+{
+    // no debugging: the comparison baseline
+  OAConfig config(true, 4, 2, false, 0, 0, 0);
+  config.Destructor_ = CountDestroyed;
+  destroyed = 0;
+  {
+    ObjectAllocator oa(sizeof(Student), config);
+    void *ptrs[3];
+    for (unsigned i = 0; i < 3; i++)
+      ptrs[i] = oa.Allocate();
+    oa.Free(ptrs[1]);
+    try
+    {
+      oa.Free(ptrs[1]);
+      Check(false, "a double free is caught without DebugOn_");
+    }
+    catch (const OAException &e)
+    {
+      Check(e.code() == OAException::E_MULTIPLE_FREE, "a double free is caught without DebugOn_");
+    }
+    unsigned leaks = oa.DumpMemoryInUse(CountDumped);
+    cout << "Leaks: " << leaks << endl;
+    Check(leaks == 2, "leaks are dumped without DebugOn_");
+    PrintCounts(oa.GetStats());
+  }
+  Check(destroyed == 3, "the leaked objects are deleted with the allocator");
+
+  config.TrackLiveObjects_ = false;
+  ObjectAllocator plain(sizeof(Student), config);
+  void *block = plain.Allocate();
+  Check(plain.DumpMemoryInUse(CountDumped) == 0, "TrackLiveObjects_ off is a plain new/delete");
+  plain.Free(block);
+}
+
+void TestStealing(void)
+{
+    // 8 pages of 64 for every heap together
+  OAConfig config(false, 64, 8, false, 0, 0, 0);
+  ConcurrentObjectAllocator oa(32, config);
+
+  void *mine = oa.Allocate();
+  std::vector<void *> ptrs;
+  std::thread other([&]() {
+    for (unsigned i = 0; i < 7 * 64; i++)
+      ptrs.push_back(oa.Allocate());
+  });
+  other.join();
+  OAStats stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(stats.PagesInUse_ == 8, "the other thread got the rest of the budget");
+
+    // its pages empty out; this thread can only get them by stealing
+  for (unsigned i = 0; i < ptrs.size(); i++)
+    oa.Free(ptrs[i]);
+  ptrs.clear();
+  for (unsigned i = 0; i < 7 * 64 + 63; i++)
+    ptrs.push_back(oa.Allocate());
+  stats = oa.GetStats();
+  PrintCounts(stats);
+  cout << "Stolen pages: " << stats.StolenPages_ << ", Heaps: " << oa.HeapCount() << endl;
+  Check(stats.StolenPages_ == 7, "every emptied page was stolen");
+  Check(stats.PagesInUse_ == 8, "stealing takes nothing from the budget");
+
+  try
+  {
+    oa.Allocate();
+    Check(false, "MaxPages_ is shared by every heap");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_NO_PAGES, "MaxPages_ is shared by every heap");
+  }
+
+  for (unsigned i = 0; i < ptrs.size(); i++)
+    oa.Free(ptrs[i]);
+  oa.Free(mine);
+  PrintCounts(oa.GetStats());
+}
+
+void TestOrderedPages(void)
+{
+  OAConfig config(false, 2, 0, false, 0, 0, 0);
+  config.AddressOrdered_ = true;
+  ObjectAllocator oa(sizeof(Student), config);
+
+    // enough pages for several words of page bits
+  std::vector<char *> ptrs;
+  for (unsigned i = 0; i < 400; i++)
+    ptrs.push_back(reinterpret_cast<char *>(oa.Allocate()));
+  std::sort(ptrs.begin(), ptrs.end());
+
+    // every third page empties out and is given back, every fifth has
+    // one free block left
+  std::vector<char *> free_blocks;
+  for (unsigned page = 0; page < 200; page++)
+    if (page % 3 == 0)
+    {
+      oa.Free(ptrs[2 * page]);
+      oa.Free(ptrs[2 * page + 1]);
+    }
+    else if (page % 5 == 0)
+    {
+      oa.Free(ptrs[2 * page + 1]);
+      free_blocks.push_back(ptrs[2 * page + 1]);
+    }
+  Check(oa.FreeEmptyPages() == 67, "the emptied pages are given back");
+  PrintCounts(oa.GetStats());
+
+  bool lowest = true;
+  for (unsigned i = 0; i < free_blocks.size(); i++)
+    lowest = lowest && oa.Allocate() == free_blocks[i];
+  Check(lowest, "the blocks left free come back lowest first");
+
+    // new pages go in between the others, the lowest still comes first
+  std::vector<char *> more;
+  for (unsigned i = 0; i < 40; i++)
+    more.push_back(reinterpret_cast<char *>(oa.Allocate()));
+  char *high = ptrs[2 * 199 + 1];
+  char *low = ptrs[2 * 1];
+  oa.Free(high);
+  oa.Free(low);
+  Check(oa.Allocate() == low && oa.Allocate() == high, "the lowest free block is handed out first");
+  PrintCounts(oa.GetStats());
+}
+
+void BadScratchRegion(void)
+{
+  OAConfig config(false, 4, 0, false, 0, 0, 0);
+  config.ScratchOffset_ = sizeof(void *);
+  config.ScratchSize_ = sizeof(Cached);
+  ObjectAllocator oa(sizeof(Cached), config);
+}
+
+void MisalignedScratch(void)
+{
+  OAConfig config(false, 4, 0, false, 0, 0, 0);
+  config.ScratchOffset_ = 4;
+  ObjectAllocator oa(sizeof(Cached), config);
+}
+
+void TestObjectCaching(void)
+{
+  OAConfig config(false, 4, 0, true, 4, 0, 0);
+  config.Constructor_ = ConstructCached;
+  config.Destructor_ = DestroyCached;
+  config.ScratchOffset_ = offsetof(Cached, Scratch);
+  config.ScratchSize_ = sizeof(void *) * 2;
+  constructed = destroyed = 0;
+  {
+    ObjectAllocator oa(sizeof(Cached), config);
+
+    Cached *ptrs[6];
+    for (unsigned i = 0; i < 6; i++)
+      ptrs[i] = static_cast<Cached *>(oa.Allocate());
+    Check(constructed == 8, "every block of a new page is constructed");
+    Check(std::strcmp(ptrs[5]->Name, "constructed") == 0, "blocks come out constructed");
+
+      // free and take back: the same objects, not constructed again
+    int id = ptrs[5]->ID;
+    for (unsigned i = 0; i < 6; i++)
+      oa.Free(ptrs[i]);
+    bool kept = true;
+    for (unsigned i = 0; i < 6; i++)
+    {
+      Cached *cached = static_cast<Cached *>(oa.Allocate());
+      kept = kept && cached->ID > 0 && std::strcmp(cached->Name, "constructed") == 0;
+      ptrs[i] = cached;
+    }
+    Check(kept, "only the scratch region is written while a block is free");
+    Check(constructed == 8 && (ptrs[0]->ID == id || ptrs[5]->ID == id), "freed objects are reused as they are");
+    Check(oa.ValidatePages(CountDumped) == 0, "the pad bytes around the objects are intact");
+
+      // empty pages are destroyed as they are given back
+    for (unsigned i = 0; i < 6; i++)
+      oa.Free(ptrs[i]);
+    Check(oa.FreeEmptyPages() == 2 && destroyed == 8, "given back pages are destroyed");
+    ptrs[0] = static_cast<Cached *>(oa.Allocate());
+  }
+  Check(constructed == 12 && destroyed == 12, "the allocator destroys what's left");
+
+  CheckThrows(BadScratchRegion, OAException::E_BAD_CONFIG, "a scratch region past the object");
+  CheckThrows(MisalignedScratch, OAException::E_BAD_CONFIG, "a scratch region that isn't pointer aligned");
+}
+
+void TestPolicies(void)
+{
+  typedef BasicObjectAllocator<DebugOffPolicy, HeadersOffPolicy, PooledPagePolicy, NoLockPolicy> Fast;
+  typedef BasicObjectAllocator<DebugOnPolicy, HeadersOnPolicy, PooledPagePolicy, MutexLockPolicy> Safe;
+
+    // the config asks for everything, the policies leave it out
+  Fast fast(sizeof(Student), OAConfig(true, 4, 2, true, 0, 2, 0));
+  OAConfig config = fast.GetConfig();
+  Check(!config.DebugOn_ && !config.HeaderBlocks_ && !config.UseCPPMemManager_,
+        "debugging, headers and new/delete compile out");
+  char *first = reinterpret_cast<char *>(fast.Allocate());
+  char *second = reinterpret_cast<char *>(fast.Allocate());
+  PrintCounts(fast.GetStats());
+  Check(fast.GetStats().PagesInUse_ == 1, "blocks come from pages");
+  Check(std::max(first, second) - std::min(first, second) == static_cast<long>(sizeof(Student)),
+        "blocks are just the object");
+  fast.Free(first);
+  fast.Free(second);
+
+    // the config asks for nothing, the policies turn it on
+  Safe safe(sizeof(Student), OAConfig(false, 4, 2, false, 0, 0, 0));
+  config = safe.GetConfig();
+  Check(config.DebugOn_ && config.HeaderBlocks_ == 1, "debugging and headers are always on");
+  void *block = safe.Allocate();
+  safe.Free(block);
+  try
+  {
+    safe.Free(block);
+    Check(false, "a double free is caught");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_MULTIPLE_FREE, "a double free is caught");
+  }
+}
+
+void TestCaches(bool PerCpu)
+{
+  OAConfig config(false, 64, 0, false, 0, 0, 0);
+  CachingObjectAllocator oa(sizeof(Student), config, 32, PerCpu);
+  cout << "Per CPU caches: " << oa.UsesPerCpuCaches() << endl;
+  if (!PerCpu)
+    Check(!oa.UsesPerCpuCaches(), "per thread caches when asked for");
+
+  void *block = oa.Allocate();
+  oa.Free(block);
+  OAStats stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(stats.CachedObjects_ > 0 && stats.CachedObjects_ <= stats.FreeObjects_,
+        "a free block stays in the cache, counted as free");
+
+    // threads filling and emptying their caches never share a block
+  bool clean = true;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 4; t++)
+    threads.push_back(std::thread([&oa, &clean, t]() {
+      std::vector<Student *> students;
+      for (unsigned round = 0; round < 50; round++)
+      {
+        for (unsigned i = 0; i < 100; i++)
+        {
+          students.push_back(reinterpret_cast<Student *>(oa.Allocate()));
+          students.back()->ID = t;
+        }
+        for (unsigned i = 0; i < students.size(); i++)
+        {
+          if (students[i]->ID != static_cast<long>(t))
+            clean = false;
+          oa.Free(students[i]);
+        }
+        students.clear();
+      }
+    }));
+  for (unsigned t = 0; t < threads.size(); t++)
+    threads[t].join();
+  stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(clean, "no block was handed to two threads");
+  Check(stats.ObjectsInUse_ == 0, "every block came back");
+}
+
+void TestCacheDecay(void)
+{
+    // per thread caches of 64, decaying every 100 operations
+  OAConfig config(false, 64, 0, false, 0, 0, 0);
+  CachingObjectAllocator oa(sizeof(Student), config, 64, false, 100);
+
+  unsigned cached = 0;
+  std::thread other([&]() {
+    std::vector<void *> ptrs;
+    for (unsigned i = 0; i < 64; i++)
+      ptrs.push_back(oa.Allocate());
+    for (unsigned i = 0; i < ptrs.size(); i++)
+      oa.Free(ptrs[i]);
+    unsigned full = oa.GetStats().CachedObjects_;
+
+      // one block in use at a time: the rest of the cache goes unused
+    for (unsigned i = 0; i < 1000; i++)
+      oa.Free(oa.Allocate());
+    OAStats stats = oa.GetStats();
+    PrintCounts(stats);
+    cout << "Cached: " << full << " then " << stats.CachedObjects_ << ", Decays: " << stats.CacheDecays_ << endl;
+    cached = stats.CachedObjects_;
+    Check(cached < full && stats.CacheDecays_ > 0, "unused cached blocks decay to the pool");
+  });
+  other.join();
+
+  OAStats stats = oa.GetStats();
+  Check(cached > 0 && stats.CachedObjects_ == 0, "an exiting thread flushes its cache");
+
+    // this thread's cache is flushed too before the empty pages go
+  void *block = oa.Allocate();
+  oa.Free(block);
+  Check(oa.GetStats().CachedObjects_ > 0, "the block went to this thread's cache");
+  unsigned freed = oa.FreeEmptyPages();
+  stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(freed > 0 && stats.PagesInUse_ == 0 && stats.CachedObjects_ == 0,
+        "FreeEmptyPages flushes the caches and frees every page");
+}
+
+void TestNodes(void)
+{
+    // more nodes than the machine has: threads get them round robin
+  OAConfig config(false, 64, 0, false, 0, 0, 0);
+  ConcurrentObjectAllocator oa(sizeof(Student), config, true, 3);
+  Check(oa.NodeCount() == 3, "the allocator has the nodes asked for");
+
+    // the next three threads are on the three nodes, so one of them is
+    // on the owner's node
+  std::thread owner([&]() {
+    void *ptrs[3];
+    for (unsigned i = 0; i < 3; i++)
+      ptrs[i] = oa.Allocate();
+    for (unsigned i = 0; i < 3; i++)
+    {
+      std::thread other([&]() { oa.Free(ptrs[i]); });
+      other.join();
+    }
+
+    OAStats stats = oa.GetStats();
+    cout << "Remote frees: " << stats.RemoteFrees_ << ", From other nodes: " << stats.NodeRemoteFrees_ << endl;
+    Check(stats.RemoteFrees_ == 3 && stats.NodeRemoteFrees_ == 2, "frees from other nodes are counted");
+
+      // the owner's heap, with its page, is on one node
+    unsigned in_use = 0, node_remote = 0, busy = 0;
+    for (unsigned node = 0; node < oa.NodeCount(); node++)
+    {
+      OAStats node_stats = oa.GetNodeStats(node);
+      in_use += node_stats.ObjectsInUse_;
+      node_remote += node_stats.NodeRemoteFrees_;
+      if (node_stats.PagesInUse_)
+        ++busy;
+    }
+    Check(in_use == stats.ObjectsInUse_ && node_remote == 2, "the nodes add up to the total");
+    Check(busy == 1, "only the owner's node has pages");
+  });
+  owner.join();
+}
+
+void TestWaiters(void)
+{
+    // one page of 4 blocks, all of them taken
+  OAConfig config(false, 4, 1, false, 0, 0, 0);
+  ConcurrentObjectAllocator oa(sizeof(Student), config);
+  std::vector<void *> ptrs;
+  for (unsigned i = 0; i < 4; i++)
+    ptrs.push_back(oa.Allocate());
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  try
+  {
+    oa.AllocateWait(50);
+    Check(false, "AllocateWait gives up when nothing is freed");
+  }
+  catch (const OAException &e)
+  {
+    long waited = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+    Check(e.code() == OAException::E_NO_PAGES && waited >= 50, "AllocateWait gives up when nothing is freed");
+  }
+
+    // a waiting thread is handed the next block freed
+  void *handed = NULL;
+  std::thread waiter([&]() { handed = oa.AllocateWait(5000); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  void *freed = ptrs.back();
+  ptrs.pop_back();
+  oa.Free(freed);
+  waiter.join();
+  Check(handed == freed, "the waiting thread got the freed block");
+  ptrs.push_back(handed);
+
+#ifdef __cpp_impl_coroutine
+    // coroutines queue as they suspend and are resumed first come, first
+    // served, each by the Free that hands it a block
+  std::vector<void *> blocks;
+  AwaitBlock(oa, blocks);
+  AwaitBlock(oa, blocks);
+  Check(blocks.empty(), "the coroutines wait for a block");
+  oa.Free(ptrs[0]);
+  Check(blocks.size() == 1 && blocks[0] == ptrs[0], "the first coroutine is resumed first");
+  oa.Free(ptrs[1]);
+  Check(blocks.size() == 2 && blocks[1] == ptrs[1], "then the second");
+  ptrs[0] = blocks[0];
+  ptrs[1] = blocks[1];
+
+  oa.Free(ptrs.back());
+  ptrs.pop_back();
+  AwaitBlock(oa, blocks);
+  Check(blocks.size() == 3, "a coroutine doesn't wait when a block is free");
+  ptrs.push_back(blocks.back());
+#endif
+
+  for (unsigned i = 0; i < ptrs.size(); i++)
+    oa.Free(ptrs[i]);
+  OAStats stats = oa.GetStats();
+  PrintCounts(stats);
+  Check(stats.ObjectsInUse_ == 0, "every block came back");
+}
+
+void TestMemoryBudget(void)
+{
+  OAConfig config(false, 4, 0, false, 0, 0, 0);
+  unsigned page_size = ObjectAllocator(sizeof(Student), config).GetStats().PageSize_;
+
+    // two pages for both pools together, each starts with one
+  OAMemoryBudget budget(2 * page_size);
+  OAReclaimHandlers handlers;
+  config.PageSource_ = &budget;
+  config.ReclaimHandlers_ = &handlers;
+  ObjectAllocator first(sizeof(Student), config);
+  ObjectAllocator second(sizeof(Student), config);
+  Check(budget.Used() == 2 * page_size, "the pools used the whole budget");
+  handlers.Add(ShrinkPool, &second);
+
+    // the second pool's empty page goes to the first
+  std::vector<void *> ptrs;
+  handlerCalls = 0;
+  for (unsigned i = 0; i < 8; i++)
+    ptrs.push_back(first.Allocate());
+  PrintCounts(first.GetStats());
+  PrintCounts(second.GetStats());
+  Check(handlerCalls == 1 && first.GetStats().PagesInUse_ == 2 && second.GetStats().PagesInUse_ == 0,
+        "the handler gave the first pool the second's page");
+  Check(budget.Used() == 2 * page_size, "the budget is still full");
+
+    // nothing left to reclaim: the handler runs once, then E_NO_PAGES
+  handlerCalls = 0;
+  try
+  {
+    first.Allocate();
+    Check(false, "the first pool is out of budget");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_NO_PAGES && handlerCalls == 1, "the first pool is out of budget");
+  }
+
+  for (unsigned i = 0; i < ptrs.size(); i++)
+    first.Free(ptrs[i]);
+  handlers.Remove(ShrinkPool, &second);
+}
+
+void TestSoAPool(void)
+{
+  typedef SoAPool<float, int> Particles;
+
+    // 100 a page rounds up to 128, a mask word per 64
+  OAConfig config(false, 100, 0, false, 0, 0, 0);
+  Particles pool(config);
+  Check(pool.SlotsPerPage() == 128, "slots per page round up to a mask word");
+
+  std::vector<Particles::Handle> handles;
+  for (unsigned i = 0; i < 300; i++)
+  {
+    Particles::Handle handle = pool.Allocate();
+    pool.Get<0>(handle) = 0.5f;
+    pool.Get<1>(handle) = static_cast<int>(handle);
+    handles.push_back(handle);
+  }
+
+    // every third one dies, and all of the second page
+  long expected = 0;
+  unsigned live = 0;
+  for (unsigned i = 0; i < handles.size(); i++)
+    if (i % 3 == 0 || handles[i] / 128 == 1)
+      pool.Free(handles[i]);
+    else
+    {
+      expected += handles[i];
+      ++live;
+    }
+  Check(!pool.IsLive(handles[0]) && pool.IsLive(handles[1]), "IsLive follows Free");
+
+    // a masked loop over every slot and a loop over the set bits agree
+  long masked = 0, skipped = 0;
+  unsigned spans = 0, counted = 0, aligned = 0;
+  pool.ForEachLive([&](const Particles::Span &span) {
+    ++spans;
+    const int *ids = span.Field<1>();
+    for (unsigned slot = 0; slot < span.Count; slot++)
+    {
+      masked += ids[slot] & -static_cast<int>((span.Mask[slot / 64] >> (slot % 64)) & 1);
+      if (span.IsLive(slot))
+      {
+        skipped += ids[slot];
+        ++counted;
+      }
+    }
+    counted -= span.Live;
+    for (unsigned field = 0; field < Particles::FIELDS; field++)
+      if (reinterpret_cast<uintptr_t>(span.Arrays[field]) % Particles::ALIGNMENT == 0)
+        ++aligned;
+  });
+  cout << "Spans: " << spans << ", Live: " << live << endl;
+  Check(spans == 2, "pages with no live slot are skipped");
+  Check(masked == expected && skipped == expected, "the masks mark exactly the live slots");
+  Check(counted == 0, "each span counts its live slots");
+  Check(aligned == 2 * Particles::FIELDS, "every field array is aligned");
+
+    // a slot is zeroed when it is handed out again
+  Particles::Handle again = pool.Allocate();
+  Check(pool.Get<0>(again) == 0.0f && pool.Get<1>(again) == 0, "a reused slot is zeroed");
+  pool.Free(again);
+
+  try
+  {
+    pool.Free(handles[0]);
+    Check(false, "a double free is caught");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_MULTIPLE_FREE, "a double free is caught");
+  }
+  try
+  {
+    pool.Free(100000);
+    Check(false, "a handle past the pages is refused");
+  }
+  catch (const OAException &e)
+  {
+    Check(e.code() == OAException::E_BAD_ADDRESS, "a handle past the pages is refused");
+  }
+}
+
+int main(void)
+{
+  try
+  {
+    cout << "============================== Test remote frees..." << endl;
+    TestRemoteFrees();
+    cout << endl;
+    cout << "============================== Test remote reuse..." << endl;
+    TestRemoteReuse();
+    cout << endl;
+    cout << "============================== Test memfd round trip..." << endl;
+    TestMemfdRoundTrip();
+    cout << endl;
+    cout << "============================== Test crash recovery..." << endl;
+    TestCrashRecovery();
+    cout << endl;
+    cout << "============================== Test retire and reclaim..." << endl;
+    TestRetireReclaim();
+    cout << endl;
+    cout << "============================== Test ring reuse..." << endl;
+    TestRingReuse();
+    cout << endl;
+    cout << "============================== Test ring errors..." << endl;
+    TestRingErrors();
+    cout << endl;
+    cout << "============================== Test address ordered..." << endl;
+    TestOrdered();
+    cout << endl;
+    cout << "============================== Test address ordered pages..." << endl;
+    TestOrderedPages();
+    cout << endl;
+    cout << "============================== Test tenants..." << endl;
+    TestTenants();
+    cout << endl;
+    cout << "============================== Test contiguous runs..." << endl;
+    TestContiguous();
+    cout << endl;
+    cout << "============================== Test run reclaim..." << endl;
+    TestRunReclaim();
+    cout << endl;
+    cout << "============================== Test frame alignment..." << endl;
+    TestFrameAlignment();
+    cout << endl;
+    cout << "============================== Test pass-through..." << endl;
+    TestPassThrough();
+    cout << endl;
+    cout << "============================== Test page stealing..." << endl;
+    TestStealing();
+    cout << endl;
+    cout << "============================== Test object caching..." << endl;
+    TestObjectCaching();
+    cout << endl;
+    cout << "============================== Test policies..." << endl;
+    TestPolicies();
+    cout << endl;
+    cout << "============================== Test per CPU caches..." << endl;
+    TestCaches(true);
+    cout << endl;
+    cout << "============================== Test per thread caches..." << endl;
+    TestCaches(false);
+    cout << endl;
+    cout << "============================== Test cache decay..." << endl;
+    TestCacheDecay();
+    cout << endl;
+    cout << "============================== Test NUMA nodes..." << endl;
+    TestNodes();
+    cout << endl;
+    cout << "============================== Test waiters..." << endl;
+    TestWaiters();
+    cout << endl;
+    cout << "============================== Test memory budget..." << endl;
+    TestMemoryBudget();
+    cout << endl;
+    cout << "============================== Test SoA pool..." << endl;
+    TestSoAPool();
+  }
+  catch (const OAException &e)
+  {
+    cout << "********************** Something bad happened ...." << endl;
+    cout << e.what() << endl;
+    return 1;
+  }
+
+  cout << endl << failures << " checks failed" << endl;
+  return failures ? 1 : 0;
+}
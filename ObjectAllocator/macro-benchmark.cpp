@@ -0,0 +1,463 @@
+/******************************************************************************/
+/*!
+\file   macro-benchmark.cpp
+\brief
+    Data structures built the way applications build them, with their
+    nodes from an ObjectAllocator (one per node type) or from the
+    default heap (new/delete):
+
+    - list: a linked list of Employee nodes (as in DoEmployees), aged by
+      unlinking every other node and appending as many new ones, then
+      walked
+    - tree: a binary search tree of random keys, walked in order and
+      searched
+    - LRU: a hash table plus recency list cache under a skewed key
+      stream (misses evict and free the least recently used entry), then
+      walked from most to least recent
+    - graph: adjacency lists of edge nodes added in random order, then
+      searched breadth first
+
+    Reported: build time, traversal time (a proxy for locality: the same
+    pointers are chased either way) and the footprint, the bytes the
+    structure holds in the C++ heap (pool pages included) where glibc's
+    mallinfo2 can tell, else the pools' pages and the nodes' sizes.
+
+    Build (release):
+      g++ -std=c++11 -O2 macro-benchmark.cpp ObjectAllocator.cpp PRNG.cpp
+
+*/
+/******************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define HAVE_MALLINFO2
+#endif
+
+#include "ObjectAllocator.h"
+#include "PRNG.h"
+
+using std::printf;
+
+struct Employee
+{
+  Employee *Next;
+  char lastName[12];
+  char firstName[12];
+  float salary;
+  int years;
+};
+
+struct TreeNode
+{
+  TreeNode *Left;
+  TreeNode *Right;
+  unsigned Key;
+  unsigned Value;
+};
+
+struct LruEntry
+{
+  LruEntry *Older;      // recency list
+  LruEntry *Newer;
+  LruEntry *Chain;      // hash bucket
+  unsigned Key;
+  char Value[36];
+};
+
+struct Edge
+{
+  Edge *Next;
+  unsigned To;
+  unsigned Weight;
+};
+
+const unsigned employees = 200000;
+const unsigned tree_keys = 200000;
+const unsigned lru_capacity = 50000;
+const unsigned lru_requests = 1000000;
+const unsigned lru_buckets = 65536;       // power of 2
+const unsigned vertices = 50000;
+const unsigned edges_per_vertex = 8;
+const unsigned passes = 10;               // traversals per structure
+const unsigned objects = 1024;            // per pool page
+
+  // Nodes from one ObjectAllocator per node type
+template <typename Node>
+class Pooled
+{
+  public:
+    Pooled() : oa_(sizeof(Node), OAConfig(false, objects, 0, false, 0, 0, 0)) {}
+
+    Node *Create() { return new (oa_.Allocate()) Node(); }
+    void Destroy(Node *node) { node->~Node(); oa_.Free(node); }
+
+      // pages held, the footprint where the heap can't be asked
+    unsigned long Bytes() const
+    {
+      OAStats stats = oa_.GetStats();
+      return static_cast<unsigned long>(stats.PagesInUse_) * stats.PageSize_;
+    }
+
+  private:
+    ObjectAllocator oa_;
+};
+
+  // Nodes from new/delete
+template <typename Node>
+class Heap
+{
+  public:
+    Heap() : live_(0) {}
+
+    Node *Create() { ++live_; return new Node(); }
+    void Destroy(Node *node) { --live_; delete node; }
+    unsigned long Bytes() const { return live_ * sizeof(Node); }
+
+  private:
+    unsigned long live_;
+};
+
+struct Result
+{
+  double Build;         // ms
+  double Traverse;      // ms
+  unsigned long Bytes;
+};
+
+double Now(void)
+{
+  typedef std::chrono::steady_clock clock;
+  return std::chrono::duration<double, std::milli>(clock::now().time_since_epoch()).count();
+}
+
+  // Bytes in use in the C++ heap, 0 if it can't be asked
+unsigned long HeapInUse(void)
+{
+#if defined(HAVE_MALLINFO2)
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+  // The heap's growth since before if it can be measured, else the estimate
+unsigned long Footprint(unsigned long before, unsigned long estimate)
+{
+  unsigned long now = HeapInUse();
+  return now > before ? now - before : estimate;
+}
+
+unsigned Random(unsigned limit)
+{
+  return static_cast<unsigned>(Digipen::Utils::Random(0, static_cast<int>(limit) - 1));
+}
+
+template <template <typename> class Storage>
+Result List(void)
+{
+  static const char *const names[] = { "Waters", "Gilmore", "Mason", "Wright" };
+  Result result;
+  unsigned long before = HeapInUse();
+  Storage<Employee> storage;
+
+  double start = Now();
+  Employee *head = 0, **tail = &head;
+  for (unsigned i = 0; i < employees; i++)
+  {
+    Employee *e = storage.Create();
+    std::strcpy(e->lastName, names[i % 4]);
+    std::strcpy(e->firstName, names[(i + 1) % 4]);
+    e->salary = 10000.0f + i % 9000;
+    e->years = i % 40;
+    *tail = e;
+    tail = &e->Next;
+  }
+  *tail = 0;
+
+    // age it: every other employee leaves, as many join at the end
+  for (Employee *e = head; e && e->Next; e = e->Next)
+  {
+    Employee *gone = e->Next;
+    e->Next = gone->Next;
+    if (tail == &gone->Next)
+      tail = &e->Next;
+    storage.Destroy(gone);
+  }
+  while (*tail)
+    tail = &(*tail)->Next;
+  for (unsigned i = 0; i < employees / 2; i++)
+  {
+    Employee *e = storage.Create();
+    std::strcpy(e->lastName, names[i % 4]);
+    e->salary = 20000.0f + i % 9000;
+    e->years = i % 40;
+    *tail = e;
+    tail = &e->Next;
+  }
+  *tail = 0;
+  result.Build = Now() - start;
+  result.Bytes = Footprint(before, storage.Bytes());
+
+  double payroll = 0;
+  start = Now();
+  for (unsigned p = 0; p < passes; p++)
+    for (Employee *e = head; e; e = e->Next)
+      payroll += e->salary * e->years;
+  result.Traverse = Now() - start;
+
+  while (head)
+  {
+    Employee *next = head->Next;
+    storage.Destroy(head);
+    head = next;
+  }
+  if (payroll == 1)
+    printf(" ");
+  return result;
+}
+
+template <template <typename> class Storage>
+void FreeTree(Storage<TreeNode> &storage, TreeNode *node)
+{
+  while (node)
+  {
+    FreeTree(storage, node->Left);
+    TreeNode *right = node->Right;
+    storage.Destroy(node);
+    node = right;
+  }
+}
+
+template <template <typename> class Storage>
+Result Tree(void)
+{
+  Result result;
+  unsigned long before = HeapInUse();
+  Storage<TreeNode> storage;
+
+  double start = Now();
+  TreeNode *root = 0;
+  for (unsigned i = 0; i < tree_keys; i++)
+  {
+    unsigned key = Digipen::Utils::rand();
+    TreeNode **link = &root;
+    while (*link && (*link)->Key != key)
+      link = key < (*link)->Key ? &(*link)->Left : &(*link)->Right;
+    if (*link)
+      continue;
+    TreeNode *node = storage.Create();
+    node->Key = key;
+    node->Value = i;
+    *link = node;
+  }
+  result.Build = Now() - start;
+  result.Bytes = Footprint(before, storage.Bytes());
+
+    // in order walks (with an explicit stack) and searches
+  std::vector<TreeNode *> stack;
+  stack.reserve(128);
+  unsigned long sum = 0;
+  start = Now();
+  for (unsigned p = 0; p < passes; p++)
+  {
+    TreeNode *node = root;
+    while (node || !stack.empty())
+    {
+      for (; node; node = node->Left)
+        stack.push_back(node);
+      node = stack.back();
+      stack.pop_back();
+      sum += node->Value;
+      node = node->Right;
+    }
+    for (unsigned i = 0; i < tree_keys / 10; i++)
+    {
+      unsigned key = Digipen::Utils::rand();
+      for (TreeNode *n = root; n && n->Key != key; n = key < n->Key ? n->Left : n->Right)
+        ++sum;
+    }
+  }
+  result.Traverse = Now() - start;
+
+  FreeTree(storage, root);
+  if (sum == 1)
+    printf(" ");
+  return result;
+}
+
+template <template <typename> class Storage>
+Result Lru(void)
+{
+  Result result;
+  std::vector<LruEntry *> buckets(lru_buckets);
+  unsigned long before = HeapInUse();
+  Storage<LruEntry> storage;
+  LruEntry *newest = 0, *oldest = 0;
+  unsigned size = 0, hits = 0;
+
+  double start = Now();
+  for (unsigned r = 0; r < lru_requests; r++)
+  {
+      // skewed: most requests go to a hot set smaller than the cache
+    unsigned key = Random(4) ? Random(lru_capacity / 2) : Random(lru_capacity * 8);
+    LruEntry **bucket = &buckets[(key * 2654435761u) & (lru_buckets - 1)];
+    LruEntry *entry = *bucket;
+    while (entry && entry->Key != key)
+      entry = entry->Chain;
+
+    if (entry)
+    {
+      ++hits;
+      if (entry == newest)
+        continue;
+      entry->Newer->Older = entry->Older;
+      if (entry->Older)
+        entry->Older->Newer = entry->Newer;
+      else
+        oldest = entry->Newer;
+    }
+    else
+    {
+      if (size == lru_capacity)
+      {
+        LruEntry *victim = oldest;
+        oldest = victim->Newer;
+        oldest->Older = 0;
+        LruEntry **link = &buckets[(victim->Key * 2654435761u) & (lru_buckets - 1)];
+        while (*link != victim)
+          link = &(*link)->Chain;
+        *link = victim->Chain;
+        storage.Destroy(victim);
+        --size;
+      }
+      entry = storage.Create();
+      entry->Key = key;
+      std::memset(entry->Value, static_cast<int>(key), sizeof(entry->Value));
+      entry->Chain = *bucket;
+      *bucket = entry;
+      ++size;
+      if (!oldest)
+        oldest = entry;
+    }
+
+    entry->Older = newest;
+    entry->Newer = 0;
+    if (newest)
+      newest->Newer = entry;
+    newest = entry;
+  }
+  result.Build = Now() - start;
+  result.Bytes = Footprint(before, storage.Bytes());
+
+  unsigned long sum = 0;
+  start = Now();
+  for (unsigned p = 0; p < passes; p++)
+    for (LruEntry *e = newest; e; e = e->Older)
+      sum += e->Key + e->Value[0];
+  result.Traverse = Now() - start;
+
+  while (oldest)
+  {
+    LruEntry *next = oldest->Newer;
+    storage.Destroy(oldest);
+    oldest = next;
+  }
+  if (sum + hits == 1)
+    printf(" ");
+  return result;
+}
+
+template <template <typename> class Storage>
+Result Graph(void)
+{
+  Result result;
+  std::vector<Edge *> adjacency(vertices);
+  std::vector<unsigned> distance(vertices), queue(vertices);
+  unsigned long before = HeapInUse();
+  Storage<Edge> storage;
+
+  double start = Now();
+  for (unsigned i = 0; i < vertices * edges_per_vertex; i++)
+  {
+      // a ring keeps it connected, the rest are random
+    unsigned from = i < vertices ? i : Random(vertices);
+    unsigned to = i < vertices ? (i + 1) % vertices : Random(vertices);
+    Edge *edge = storage.Create();
+    edge->To = to;
+    edge->Weight = i;
+    edge->Next = adjacency[from];
+    adjacency[from] = edge;
+  }
+  result.Build = Now() - start;
+  result.Bytes = Footprint(before, storage.Bytes());
+
+  unsigned long sum = 0;
+  start = Now();
+  for (unsigned p = 0; p < passes; p++)
+  {
+    distance.assign(vertices, ~0u);
+    unsigned head = 0, tail = 0;
+    unsigned source = p * (vertices / passes);
+    distance[source] = 0;
+    queue[tail++] = source;
+    while (head < tail)
+    {
+      unsigned v = queue[head++];
+      for (Edge *e = adjacency[v]; e; e = e->Next)
+        if (distance[e->To] == ~0u)
+        {
+          distance[e->To] = distance[v] + 1;
+          queue[tail++] = e->To;
+          sum += distance[e->To];
+        }
+    }
+  }
+  result.Traverse = Now() - start;
+
+  for (unsigned v = 0; v < vertices; v++)
+    while (adjacency[v])
+    {
+      Edge *next = adjacency[v]->Next;
+      storage.Destroy(adjacency[v]);
+      adjacency[v] = next;
+    }
+  if (sum == 1)
+    printf(" ");
+  return result;
+}
+
+void Print(const char *name, const char *storage, const Result &result)
+{
+  printf("%-8s %-16s %12.2f %12.2f %12lu\n", name, storage, result.Build, result.Traverse,
+         result.Bytes / 1024);
+}
+
+  // Both kinds of storage see the same random numbers
+template <Result (*HeapRun)(void), Result (*PoolRun)(void)>
+void Run(const char *name)
+{
+  Digipen::Utils::srand(521288629, 362436069);
+  Result heap = HeapRun();
+  Digipen::Utils::srand(521288629, 362436069);
+  Result pool = PoolRun();
+  Print(name, "new/delete", heap);
+  Print(name, "ObjectAllocator", pool);
+}
+
+int main(void)
+{
+  printf("build and traversal in ms (%u traversals), footprint in KB%s\n\n", passes,
+         HeapInUse() ? "" : " (estimated)");
+  printf("%-8s %-16s %12s %12s %12s\n", "", "", "build", "traverse", "footprint");
+  Run<List<Heap>, List<Pooled> >("list");
+  Run<Tree<Heap>, Tree<Pooled> >("tree");
+  Run<Lru<Heap>, Lru<Pooled> >("LRU");
+  Run<Graph<Heap>, Graph<Pooled> >("graph");
+  return 0;
+}
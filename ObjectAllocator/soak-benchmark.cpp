@@ -0,0 +1,197 @@
+/******************************************************************************/
+/*!
+\file   soak-benchmark.cpp
+\brief
+    Long running churn in compressed time: every tick is a simulated
+    second in which a load that follows a daily curve allocates objects
+    of mixed lifetimes (seconds, minutes, hours), and the objects whose
+    time is up are freed. Every few simulated minutes a sample goes to
+    a CSV time series:
+
+      policy, simulated seconds and hours, RSS (from /proc/self/statm),
+      PagesInUse_, ObjectsInUse_, FreeObjects_ and the fragmentation
+      ratio (free blocks / all blocks on the pages)
+
+    The same workload (same seed) runs under each policy:
+
+    - lifo: free list, pages are never given back
+    - lifo+trim: free list, FreeEmptyPages at every sample
+    - ordered+trim: AddressOrdered_, FreeEmptyPages at every sample
+
+    Pages are mapped and unmapped directly (Linux), so a page that is
+    given back leaves RSS instead of staying in the C++ heap.
+
+    Usage: soak-benchmark [hours [file.csv]], 24 hours to stdout by
+    default. A summary per policy goes to stderr.
+
+    Build (release):
+      g++ -std=c++11 -O2 soak-benchmark.cpp ObjectAllocator.cpp PRNG.cpp
+
+*/
+/******************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "ObjectAllocator.h"
+#include "PRNG.h"
+
+const unsigned object_size = 64;
+const unsigned objects = 1024;             // per page (64K pages)
+const unsigned rate = 60;                  // allocations per second at full load
+const unsigned sample_seconds = 300;       // a CSV row every 5 simulated minutes
+const unsigned longest = 8 * 3600;         // longest lifetime
+const double day = 24 * 3600.0;
+
+  // Pages straight from the system, so freeing one lowers RSS
+class MappedPageSource : public OAPageSource
+{
+  public:
+    char *AllocatePage(unsigned PageSize)
+    {
+#if defined(__linux__)
+      void *page = mmap(NULL, PageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      return page == MAP_FAILED ? NULL : reinterpret_cast<char *>(page);
+#else
+      return new char[PageSize];
+#endif
+    }
+
+    void FreePage(char *Page, unsigned PageSize)
+    {
+#if defined(__linux__)
+      munmap(Page, PageSize);
+#else
+      (void)PageSize;
+      delete [] Page;
+#endif
+    }
+};
+
+  // Resident set size of the process in bytes, 0 where /proc isn't there
+unsigned long Rss(void)
+{
+  unsigned long size = 0, resident = 0;
+  FILE *statm = std::fopen("/proc/self/statm", "r");
+  if (!statm)
+    return 0;
+  if (std::fscanf(statm, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  std::fclose(statm);
+#if defined(__linux__)
+  return resident * static_cast<unsigned long>(sysconf(_SC_PAGESIZE));
+#else
+  return resident * 4096;
+#endif
+}
+
+  // Seconds an object lives: mostly short, some for minutes, a few for hours
+unsigned Lifetime(void)
+{
+  int r = Digipen::Utils::Random(0, 99);
+  if (r < 70)
+    return Digipen::Utils::Random(1, 10);
+  if (r < 95)
+    return Digipen::Utils::Random(60, 1800);
+  return Digipen::Utils::Random(3600, longest);
+}
+
+void Soak(const char *policy, bool ordered, bool trim, unsigned seconds, FILE *csv)
+{
+  MappedPageSource source;
+  OAConfig config(false, objects, 0, false, 0, 0, 0);
+  config.PageSource_ = &source;
+  config.AddressOrdered_ = ordered;
+  ObjectAllocator oa(object_size, config);
+
+    // objects by the second they are freed in, each object links the
+    // next one (so the bookkeeping hardly shows in RSS)
+  std::vector<void *> wheel(longest + 1);
+  double owed = 0;
+  unsigned most_pages = 0;
+  unsigned long most_rss = 0;
+  double fragmentation_sum = 0;
+  unsigned samples = 0;
+
+  Digipen::Utils::srand(521288629, 362436069);
+  for (unsigned now = 0; now < seconds; ++now)
+  {
+    void *&expired = wheel[now % wheel.size()];
+    while (expired)
+    {
+      void *next = *reinterpret_cast<void **>(expired);
+      oa.Free(expired);
+      expired = next;
+    }
+
+      // busiest at 6 hours, quietest at 18
+    owed += rate * (0.55 + 0.45 * std::sin(2 * 3.14159265358979 * now / day));
+    for (; owed >= 1; owed -= 1)
+    {
+      void *object = oa.Allocate();
+      void *&slot = wheel[(now + Lifetime()) % wheel.size()];
+      *reinterpret_cast<void **>(object) = slot;
+      slot = object;
+    }
+
+    if (now % sample_seconds)
+      continue;
+    if (trim)
+      oa.FreeEmptyPages();
+
+    OAStats stats = oa.GetStats();
+    unsigned blocks = stats.ObjectsInUse_ + stats.FreeObjects_;
+    double fragmentation = blocks ? static_cast<double>(stats.FreeObjects_) / blocks : 0;
+    unsigned long rss = Rss();
+    std::fprintf(csv, "%s,%u,%.3f,%lu,%u,%u,%u,%.4f\n", policy, now, now / 3600.0, rss,
+                 stats.PagesInUse_, stats.ObjectsInUse_, stats.FreeObjects_, fragmentation);
+
+    if (stats.PagesInUse_ > most_pages)
+      most_pages = stats.PagesInUse_;
+    if (rss > most_rss)
+      most_rss = rss;
+    fragmentation_sum += fragmentation;
+    ++samples;
+  }
+
+  for (unsigned i = 0; i < wheel.size(); ++i)
+    while (wheel[i])
+    {
+      void *next = *reinterpret_cast<void **>(wheel[i]);
+      oa.Free(wheel[i]);
+      wheel[i] = next;
+    }
+
+  std::fprintf(stderr, "%-14s most pages %6u, most RSS %8lu KB, mean fragmentation %.3f\n",
+               policy, most_pages, most_rss / 1024, samples ? fragmentation_sum / samples : 0);
+}
+
+int main(int argc, char **argv)
+{
+  double hours = argc > 1 ? std::atof(argv[1]) : 24;
+  if (hours <= 0)
+    hours = 24;
+  FILE *csv = argc > 2 ? std::fopen(argv[2], "w") : stdout;
+  if (!csv)
+  {
+    std::fprintf(stderr, "can't write %s\n", argv[2]);
+    return 1;
+  }
+
+  unsigned seconds = static_cast<unsigned>(hours * 3600);
+  std::fprintf(csv, "policy,seconds,hours,rss_bytes,pages_in_use,objects_in_use,free_objects,fragmentation\n");
+  Soak("lifo", false, false, seconds, csv);
+  Soak("lifo+trim", false, true, seconds, csv);
+  Soak("ordered+trim", true, true, seconds, csv);
+
+  if (csv != stdout)
+    std::fclose(csv);
+  return 0;
+}
@@ -0,0 +1,298 @@
+/******************************************************************************/
+/*!
+\file   thread-benchmark.cpp
+\brief
+    Scalability of the allocators over 1..N threads. Every workload is
+    run against:
+
+    - new/delete
+    - ObjectAllocator behind a mutex (BasicObjectAllocator with
+      MutexLockPolicy)
+    - ConcurrentObjectAllocator: thread heaps, remote free queues
+    - CachingObjectAllocator: per CPU (or per thread) caches over a
+      locked pool
+
+    Workloads:
+
+    - local: each thread allocates a batch and frees it, nothing crosses
+      threads
+    - producer/consumer: each thread allocates and hands its objects to
+      the next thread (a ring of single producer mailboxes), which frees
+      them
+    - shared: every thread swaps new objects into random slots of one
+      shared array and frees what it takes out, so frees land on any
+      thread and every allocator sees the same objects
+
+    Reported: millions of operations (an Allocate or a Free) per second
+    over all threads, and the scaling efficiency, the throughput divided
+    by the thread count times the single thread throughput. Thread
+    counts are 1, 2, 4, ... and N (the first argument, default the
+    number of hardware threads).
+
+    Build (release):
+      g++ -std=c++11 -O2 -pthread thread-benchmark.cpp ObjectAllocator.cpp
+          ConcurrentObjectAllocator.cpp CachingObjectAllocator.cpp
+
+*/
+/******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "ObjectAllocator.h"
+#include "ConcurrentObjectAllocator.h"
+#include "CachingObjectAllocator.h"
+
+using std::printf;
+
+struct Student
+{
+  int Age;
+  long Year;
+  float GPA;
+  long ID;
+};
+
+typedef BasicObjectAllocator<DebugOffPolicy, HeadersOffPolicy,
+                             PooledPagePolicy, MutexLockPolicy> LockedObjectAllocator;
+
+  // Same interface as the allocators for new/delete
+class NewDeleteAllocator
+{
+  public:
+    NewDeleteAllocator(unsigned ObjectSize, const OAConfig&) : size_(ObjectSize) {}
+
+    void *Allocate() { return new char[size_]; }
+    void Free(void *Object) { delete [] reinterpret_cast<char*>(Object); }
+
+  private:
+    unsigned size_;
+};
+
+const unsigned iterations = 500000;    // Allocate + Free pairs per thread
+const unsigned batch = 64;             // objects a local batch holds
+const unsigned mailbox_size = 1024;    // producer/consumer queue length
+const unsigned shared_slots = 4096;    // shared workload array
+const unsigned objects = 1000;         // per page (just under 32K spans)
+const unsigned max_threads = 256;
+
+  // Single producer, single consumer queue of objects
+class Mailbox
+{
+  public:
+    Mailbox() : head_(0), tail_(0) {}
+
+    bool Push(void *Object)
+    {
+      unsigned tail = tail_.load(std::memory_order_relaxed);
+      if (tail - head_.load(std::memory_order_acquire) == mailbox_size)
+        return false;
+      slots_[tail % mailbox_size] = Object;
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool Pop(void *&Object)
+    {
+      unsigned head = head_.load(std::memory_order_relaxed);
+      if (head == tail_.load(std::memory_order_acquire))
+        return false;
+      Object = slots_[head % mailbox_size];
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    void *slots_[mailbox_size];
+    alignas(64) std::atomic<unsigned> head_;
+    alignas(64) std::atomic<unsigned> tail_;
+};
+
+Mailbox mailboxes[max_threads];
+std::atomic<void *> shared[shared_slots];
+
+  // Per thread random numbers (the PRNG module keeps global state)
+unsigned Next(unsigned &state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+template <typename Allocator>
+void Local(Allocator &oa, unsigned, unsigned)
+{
+  void *ptrs[batch];
+  for (unsigned i = 0; i < iterations / batch; i++)
+  {
+    for (unsigned j = 0; j < batch; j++)
+    {
+      ptrs[j] = oa.Allocate();
+      reinterpret_cast<Student *>(ptrs[j])->Age = j;
+    }
+    for (unsigned j = batch; j > 0; j--)
+      oa.Free(ptrs[j - 1]);
+  }
+}
+
+template <typename Allocator>
+void ProducerConsumer(Allocator &oa, unsigned thread, unsigned threads)
+{
+  Mailbox &out = mailboxes[(thread + 1) % threads];
+  Mailbox &in = mailboxes[thread];
+  unsigned produced = 0, consumed = 0;
+  void *object;
+
+  while (produced < iterations || consumed < iterations)
+  {
+    if (produced < iterations)
+    {
+      object = oa.Allocate();
+      reinterpret_cast<Student *>(object)->Age = produced;
+        // a full mailbox: free incoming objects until the consumer catches up
+      while (!out.Push(object))
+      {
+        void *incoming;
+        if (in.Pop(incoming))
+        {
+          oa.Free(incoming);
+          ++consumed;
+        }
+        else
+          std::this_thread::yield();
+      }
+      ++produced;
+    }
+    bool idle = produced == iterations;
+    while (in.Pop(object))
+    {
+      oa.Free(object);
+      ++consumed;
+      idle = false;
+    }
+      // done producing, waiting on the previous thread
+    if (idle)
+      std::this_thread::yield();
+  }
+}
+
+template <typename Allocator>
+void Shared(Allocator &oa, unsigned thread, unsigned)
+{
+  unsigned state = 2463534242u + thread * 7919u;
+  for (unsigned i = 0; i < iterations; i++)
+  {
+    void *object = oa.Allocate();
+    reinterpret_cast<Student *>(object)->Age = i;
+    void *old = shared[Next(state) % shared_slots].exchange(object);
+    if (old)
+      oa.Free(old);
+  }
+}
+
+double Now(void)
+{
+  typedef std::chrono::steady_clock clock;
+  return std::chrono::duration<double, std::nano>(clock::now().time_since_epoch()).count();
+}
+
+  // Millions of Allocate/Free calls per second with threads running Workload
+template <typename Allocator>
+double Run(void (*Workload)(Allocator &, unsigned, unsigned), unsigned threads)
+{
+  OAConfig config(false, objects, 0, false, 0, 0, 0);
+  Allocator oa(sizeof(Student), config);
+  std::atomic<unsigned> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> workers;
+
+  for (unsigned t = 0; t < threads; t++)
+    workers.push_back(std::thread([&, t] {
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      Workload(oa, t, threads);
+    }));
+  while (ready.load() != threads)
+    std::this_thread::yield();
+
+  double start = Now();
+  go.store(true, std::memory_order_release);
+  for (unsigned t = 0; t < threads; t++)
+    workers[t].join();
+  double elapsed = Now() - start;
+
+    // objects left in the shared array go back before the allocator does
+  for (unsigned i = 0; i < shared_slots; i++)
+    if (void *old = shared[i].exchange(0))
+      oa.Free(old);
+
+  return 2.0 * iterations * threads / elapsed * 1000.0;
+}
+
+  // One table: a row per thread count, a column per allocator
+void Table(const char *name, const std::vector<unsigned> &counts,
+           double (*const runs[])(unsigned), unsigned allocators)
+{
+  printf("\n%s, Mops/s (scaling efficiency)\n", name);
+  printf("%-8s %20s %20s %20s %20s\n", "threads", "new/delete", "locked OA",
+         "Concurrent OA", "Caching OA");
+
+  std::vector<double> single(allocators);
+  for (unsigned i = 0; i < counts.size(); i++)
+  {
+    printf("%-8u", counts[i]);
+    for (unsigned a = 0; a < allocators; a++)
+    {
+      double mops = runs[a](counts[i]);
+      if (i == 0)
+        single[a] = mops;
+      printf(" %12.1f (%4.0f%%)", mops, 100.0 * mops / (single[a] * counts[i]));
+    }
+    printf("\n");
+  }
+}
+
+template <typename Allocator>
+double RunLocal(unsigned threads) { return Run<Allocator>(&Local<Allocator>, threads); }
+template <typename Allocator>
+double RunProducerConsumer(unsigned threads) { return Run<Allocator>(&ProducerConsumer<Allocator>, threads); }
+template <typename Allocator>
+double RunShared(unsigned threads) { return Run<Allocator>(&Shared<Allocator>, threads); }
+
+int main(int argc, char **argv)
+{
+  unsigned max = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+  if (max < 1)
+    max = 1;
+  if (max > max_threads)
+    max = max_threads;
+
+  std::vector<unsigned> counts;
+  for (unsigned n = 1; n < max; n *= 2)
+    counts.push_back(n);
+  counts.push_back(max);
+
+  printf("%u Allocate + Free pairs per thread, objects of %u bytes\n",
+         iterations, (unsigned)sizeof(Student));
+
+  double (*const local[])(unsigned) = {
+    RunLocal<NewDeleteAllocator>, RunLocal<LockedObjectAllocator>,
+    RunLocal<ConcurrentObjectAllocator>, RunLocal<CachingObjectAllocator> };
+  double (*const producer_consumer[])(unsigned) = {
+    RunProducerConsumer<NewDeleteAllocator>, RunProducerConsumer<LockedObjectAllocator>,
+    RunProducerConsumer<ConcurrentObjectAllocator>, RunProducerConsumer<CachingObjectAllocator> };
+  double (*const shared_pool[])(unsigned) = {
+    RunShared<NewDeleteAllocator>, RunShared<LockedObjectAllocator>,
+    RunShared<ConcurrentObjectAllocator>, RunShared<CachingObjectAllocator> };
+
+  Table("local", counts, local, 4);
+  Table("producer/consumer", counts, producer_consumer, 4);
+  Table("shared", counts, shared_pool, 4);
+  return 0;
+}